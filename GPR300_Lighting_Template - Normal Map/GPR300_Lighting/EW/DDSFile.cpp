@@ -0,0 +1,194 @@
+//Author: Eric Winebrenner
+
+#include "DDSFile.h"
+#include <stdio.h>
+#include <fstream>
+#include <algorithm>
+
+namespace ew {
+	//Little endian four character code
+	constexpr uint32_t makeFourCC(char a, char b, char c, char d) {
+		return (uint32_t)(uint8_t)a | ((uint32_t)(uint8_t)b << 8) | ((uint32_t)(uint8_t)c << 16) | ((uint32_t)(uint8_t)d << 24);
+	}
+
+	constexpr uint32_t DDS_MAGIC = makeFourCC('D', 'D', 'S', ' ');
+	constexpr uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000;
+	constexpr uint32_t DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+	constexpr uint32_t DDPF_FOURCC = 0x4;
+	constexpr uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+	//DXGI_FORMAT values used by the DX10 extended header
+	constexpr uint32_t DXGI_FORMAT_BC1_UNORM = 71, DXGI_FORMAT_BC3_UNORM = 77, DXGI_FORMAT_BC5_UNORM = 83;
+
+	struct DDSPixelFormat {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t fourCC;
+		uint32_t rgbBitCount;
+		uint32_t rBitMask, gBitMask, bBitMask, aBitMask;
+	};
+
+	struct DDSHeader {
+		uint32_t size;
+		uint32_t flags;
+		uint32_t height;
+		uint32_t width;
+		uint32_t pitchOrLinearSize;
+		uint32_t depth;
+		uint32_t mipMapCount;
+		uint32_t reserved1[11];
+		DDSPixelFormat pixelFormat;
+		uint32_t caps, caps2, caps3, caps4;
+		uint32_t reserved2;
+	};
+	static_assert(sizeof(DDSHeader) == 124, "DDS header must be 124 bytes");
+
+	struct DDSHeaderDX10 {
+		uint32_t dxgiFormat;
+		uint32_t resourceDimension;
+		uint32_t miscFlag;
+		uint32_t arraySize;
+		uint32_t miscFlags2;
+	};
+
+	int bytesPerBlock(BlockFormat format) {
+		return format == BlockFormat::BC1 ? 8 : 16;
+	}
+
+	size_t blockCompressedSize(BlockFormat format, int width, int height) {
+		size_t blocksX = (size_t)std::max(1, (width + 3) / 4);
+		size_t blocksY = (size_t)std::max(1, (height + 3) / 4);
+		return blocksX * blocksY * bytesPerBlock(format);
+	}
+
+	static uint32_t fourCCFromFormat(BlockFormat format) {
+		switch (format) {
+		case BlockFormat::BC3:
+			return makeFourCC('D', 'X', 'T', '5');
+		case BlockFormat::BC5:
+			return makeFourCC('A', 'T', 'I', '2');
+		default:
+			return makeFourCC('D', 'X', 'T', '1');
+		}
+	}
+
+	static bool formatFromFourCC(uint32_t fourCC, BlockFormat& format) {
+		if (fourCC == makeFourCC('D', 'X', 'T', '1')) {
+			format = BlockFormat::BC1;
+		}
+		else if (fourCC == makeFourCC('D', 'X', 'T', '5')) {
+			format = BlockFormat::BC3;
+		}
+		else if (fourCC == makeFourCC('A', 'T', 'I', '2') || fourCC == makeFourCC('B', 'C', '5', 'U')) {
+			format = BlockFormat::BC5;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	static bool formatFromDXGI(uint32_t dxgiFormat, BlockFormat& format) {
+		switch (dxgiFormat) {
+		case DXGI_FORMAT_BC1_UNORM:
+			format = BlockFormat::BC1;
+			return true;
+		case DXGI_FORMAT_BC3_UNORM:
+			format = BlockFormat::BC3;
+			return true;
+		case DXGI_FORMAT_BC5_UNORM:
+			format = BlockFormat::BC5;
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	bool readDDS(const std::string& filePath, DDSImage& image) {
+		std::ifstream file(filePath, std::ios::binary);
+		if (!file.is_open()) {
+			return false;
+		}
+
+		uint32_t magic = 0;
+		DDSHeader header = {};
+		bool valid = file.read((char*)&magic, sizeof(magic)) && magic == DDS_MAGIC
+			&& file.read((char*)&header, sizeof(header)) && header.size == sizeof(DDSHeader)
+			&& (header.pixelFormat.flags & DDPF_FOURCC);
+		if (valid) {
+			if (header.pixelFormat.fourCC == makeFourCC('D', 'X', '1', '0')) {
+				DDSHeaderDX10 dx10 = {};
+				valid = file.read((char*)&dx10, sizeof(dx10)) && formatFromDXGI(dx10.dxgiFormat, image.format);
+			}
+			else {
+				valid = formatFromFourCC(header.pixelFormat.fourCC, image.format);
+			}
+		}
+		if (!valid) {
+			printf("%s is not a BC1/BC3/BC5 DDS file\n", filePath.c_str());
+			return false;
+		}
+
+		image.width = (int)header.width;
+		image.height = (int)header.height;
+		if (image.width <= 0 || image.height <= 0) {
+			printf("%s has no pixels\n", filePath.c_str());
+			return false;
+		}
+		//Never trust the header for more levels than a full chain down to 1x1
+		int maxMips = 1;
+		while ((image.width >> maxMips) > 0 || (image.height >> maxMips) > 0) {
+			maxMips++;
+		}
+		int numMips = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1u, header.mipMapCount) : 1;
+		numMips = std::min(numMips, maxMips);
+
+		image.mips.clear();
+		size_t totalSize = 0;
+		int width = image.width, height = image.height;
+		for (int i = 0; i < numMips; i++) {
+			DDSMip mip = { width, height, totalSize, blockCompressedSize(image.format, width, height) };
+			image.mips.push_back(mip);
+			totalSize += mip.size;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+
+		image.data.resize(totalSize);
+		valid = (bool)file.read((char*)image.data.data(), totalSize);
+		if (!valid) {
+			printf("%s is truncated\n", filePath.c_str());
+		}
+		return valid;
+	}
+
+	bool writeDDS(const std::string& filePath, const DDSImage& image) {
+		std::ofstream file(filePath, std::ios::binary);
+		if (!file.is_open()) {
+			printf("Failed to open %s for writing\n", filePath.c_str());
+			return false;
+		}
+
+		DDSHeader header = {};
+		header.size = sizeof(DDSHeader);
+		header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+		header.height = (uint32_t)image.height;
+		header.width = (uint32_t)image.width;
+		header.pitchOrLinearSize = image.mips.empty() ? 0 : (uint32_t)image.mips[0].size;
+		header.mipMapCount = (uint32_t)image.mips.size();
+		header.pixelFormat.size = sizeof(DDSPixelFormat);
+		header.pixelFormat.flags = DDPF_FOURCC;
+		header.pixelFormat.fourCC = fourCCFromFormat(image.format);
+		header.caps = DDSCAPS_TEXTURE;
+		if (image.mips.size() > 1) {
+			header.caps |= DDSCAPS_COMPLEX | DDSCAPS_MIPMAP;
+		}
+
+		bool valid = file.write((const char*)&DDS_MAGIC, sizeof(DDS_MAGIC))
+			&& file.write((const char*)&header, sizeof(header))
+			&& file.write((const char*)image.data.data(), image.data.size());
+		if (!valid) {
+			printf("Failed to write %s\n", filePath.c_str());
+		}
+		return valid;
+	}
+}
@@ -0,0 +1,96 @@
+//Author: Eric Winebrenner
+
+#include "FileWatcher.h"
+#include <chrono>
+
+namespace ew {
+	static std::filesystem::file_time_type getLastWriteTime(const std::string& filePath) {
+		std::error_code error;
+		std::filesystem::file_time_type time = std::filesystem::last_write_time(filePath, error);
+		//Editors often delete and recreate files on save, so a missing file just reads as unchanged
+		return error ? std::filesystem::file_time_type::min() : time;
+	}
+
+	FileWatcher::FileWatcher(int pollIntervalMs)
+		: mStopping(false), mPollIntervalMs(pollIntervalMs)
+	{
+		mThread = std::thread(&FileWatcher::pollLoop, this);
+	}
+
+	FileWatcher::~FileWatcher()
+	{
+		mStopping = true;
+		mThread.join();
+	}
+
+	int FileWatcher::watch(const std::string& filePath)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		WatchedFile file = { filePath, getLastWriteTime(filePath), false, true };
+		//Reuse a slot freed by unwatch() so shaders created and destroyed over and over don't grow the list
+		for (size_t i = 0; i < mFiles.size(); i++) {
+			if (!mFiles[i].active) {
+				mFiles[i] = file;
+				return (int)i;
+			}
+		}
+		mFiles.push_back(file);
+		return (int)mFiles.size() - 1;
+	}
+
+	void FileWatcher::unwatch(int id)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (id < 0 || id >= (int)mFiles.size()) {
+			return;
+		}
+		mFiles[id] = { "", std::filesystem::file_time_type::min(), false, false };
+	}
+
+	bool FileWatcher::consumeChange(int id)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		bool changed = mFiles[id].changed;
+		mFiles[id].changed = false;
+		return changed;
+	}
+
+	FileWatcher& FileWatcher::get()
+	{
+		static FileWatcher watcher;
+		return watcher;
+	}
+
+	void FileWatcher::pollLoop()
+	{
+		while (!mStopping) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(mPollIntervalMs));
+
+			//Copy the paths out so file system calls don't hold the lock
+			std::vector<std::string> paths;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				for (const WatchedFile& file : mFiles) {
+					paths.push_back(file.active ? file.filePath : "");
+				}
+			}
+			std::vector<std::filesystem::file_time_type> times;
+			for (const std::string& path : paths) {
+				times.push_back(path.empty() ? std::filesystem::file_time_type::min() : getLastWriteTime(path));
+			}
+
+			std::lock_guard<std::mutex> lock(mMutex);
+			for (size_t i = 0; i < times.size(); i++) {
+				WatchedFile& file = mFiles[i];
+				//The slot may have been unwatched or given to another file while the lock was released
+				if (!file.active || file.filePath != paths[i]) {
+					continue;
+				}
+				if (times[i] != std::filesystem::file_time_type::min() && times[i] != file.lastWriteTime) {
+					file.lastWriteTime = times[i];
+					file.changed = true;
+				}
+			}
+		}
+	}
+}
@@ -0,0 +1,174 @@
+//Author: Eric Winebrenner
+
+#include "GeometryPool.h"
+#include "GLState.h"
+#include <algorithm>
+
+namespace ew {
+	RangeAllocator::RangeAllocator(uint32_t capacity)
+		: mCapacity(0)
+	{
+		grow(capacity);
+	}
+
+	void RangeAllocator::addFreeRange(uint32_t offset, uint32_t size)
+	{
+		mFreeByOffset[offset] = size;
+		mFreeBySize.insert({ size, offset });
+	}
+
+	void RangeAllocator::removeFreeRange(uint32_t offset, uint32_t size)
+	{
+		mFreeByOffset.erase(offset);
+		auto range = mFreeBySize.equal_range(size);
+		for (auto it = range.first; it != range.second; ++it) {
+			if (it->second == offset) {
+				mFreeBySize.erase(it);
+				break;
+			}
+		}
+	}
+
+	uint32_t RangeAllocator::allocate(uint32_t size)
+	{
+		if (size == 0) {
+			return 0;
+		}
+		//Smallest free range that fits, the remainder goes back as a smaller free range
+		auto bestFit = mFreeBySize.lower_bound(size);
+		if (bestFit == mFreeBySize.end()) {
+			return INVALID_OFFSET;
+		}
+		uint32_t rangeSize = bestFit->first;
+		uint32_t offset = bestFit->second;
+		removeFreeRange(offset, rangeSize);
+		if (rangeSize > size) {
+			addFreeRange(offset + size, rangeSize - size);
+		}
+		mUsed += size;
+		return offset;
+	}
+
+	void RangeAllocator::free(uint32_t offset, uint32_t size)
+	{
+		if (size == 0) {
+			return;
+		}
+		mUsed -= size;
+		//Merge with the free range ending where this starts, then the one starting where this ends
+		auto next = mFreeByOffset.lower_bound(offset);
+		if (next != mFreeByOffset.begin()) {
+			auto previous = std::prev(next);
+			if (previous->first + previous->second == offset) {
+				offset = previous->first;
+				size += previous->second;
+				removeFreeRange(previous->first, previous->second);
+			}
+		}
+		next = mFreeByOffset.find(offset + size);
+		if (next != mFreeByOffset.end()) {
+			size += next->second;
+			removeFreeRange(next->first, next->second);
+		}
+		addFreeRange(offset, size);
+	}
+
+	void RangeAllocator::grow(uint32_t newCapacity)
+	{
+		if (newCapacity <= mCapacity) {
+			return;
+		}
+		uint32_t oldCapacity = mCapacity;
+		mCapacity = newCapacity;
+		//Freeing the new space merges it with a free range at the old end
+		mUsed += newCapacity - oldCapacity;
+		free(oldCapacity, newCapacity - oldCapacity);
+	}
+
+	GeometryPool::GeometryPool(uint32_t vertexCapacity, uint32_t indexCapacity)
+	{
+		glGenVertexArrays(1, &mVAO);
+		growBuffer(mVBO, mVertexRanges, sizeof(Vertex), vertexCapacity);
+		growBuffer(mEBO, mIndexRanges, sizeof(unsigned int), indexCapacity);
+	}
+
+	GeometryPool::~GeometryPool()
+	{
+		GLState::get().forgetVertexArray(mVAO);
+		glDeleteVertexArrays(1, &mVAO);
+		glDeleteBuffers(1, &mVBO);
+		glDeleteBuffers(1, &mEBO);
+	}
+
+	//Uploads go through the copy targets so the element buffer of whatever VAO is bound isn't touched
+	GeometryAllocation GeometryPool::allocate(const MeshData& meshData)
+	{
+		GeometryAllocation allocation;
+		allocation.numVertices = (uint32_t)meshData.vertices.size();
+		allocation.numIndices = (uint32_t)meshData.indices.size();
+
+		allocation.firstVertex = mVertexRanges.allocate(allocation.numVertices);
+		if (allocation.firstVertex == RangeAllocator::INVALID_OFFSET) {
+			growBuffer(mVBO, mVertexRanges, sizeof(Vertex), std::max(mVertexRanges.getCapacity() * 2, mVertexRanges.getCapacity() + allocation.numVertices));
+			allocation.firstVertex = mVertexRanges.allocate(allocation.numVertices);
+		}
+		allocation.firstIndex = mIndexRanges.allocate(allocation.numIndices);
+		if (allocation.firstIndex == RangeAllocator::INVALID_OFFSET) {
+			growBuffer(mEBO, mIndexRanges, sizeof(unsigned int), std::max(mIndexRanges.getCapacity() * 2, mIndexRanges.getCapacity() + allocation.numIndices));
+			allocation.firstIndex = mIndexRanges.allocate(allocation.numIndices);
+		}
+
+		if (allocation.numVertices > 0) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, mVBO);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstVertex * sizeof(Vertex), allocation.numVertices * sizeof(Vertex), meshData.vertices.data());
+		}
+		if (allocation.numIndices > 0) {
+			glBindBuffer(GL_COPY_WRITE_BUFFER, mEBO);
+			glBufferSubData(GL_COPY_WRITE_BUFFER, allocation.firstIndex * sizeof(unsigned int), allocation.numIndices * sizeof(unsigned int), meshData.indices.data());
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		return allocation;
+	}
+
+	void GeometryPool::free(const GeometryAllocation& allocation)
+	{
+		mVertexRanges.free(allocation.firstVertex, allocation.numVertices);
+		mIndexRanges.free(allocation.firstIndex, allocation.numIndices);
+	}
+
+	void GeometryPool::bind()
+	{
+		GLState::get().bindVertexArray(mVAO);
+	}
+
+	//Replaces buffer with a bigger one holding the same contents
+	void GeometryPool::growBuffer(GLuint& buffer, RangeAllocator& ranges, uint32_t elementSize, uint32_t minCapacity)
+	{
+		GLuint newBuffer;
+		glGenBuffers(1, &newBuffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, newBuffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)minCapacity * elementSize, NULL, GL_STATIC_DRAW);
+		if (buffer != 0) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, (GLsizeiptr)ranges.getCapacity() * elementSize);
+			glBindBuffer(GL_COPY_READ_BUFFER, 0);
+			glDeleteBuffers(1, &buffer);
+		}
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+		buffer = newBuffer;
+		ranges.grow(minCapacity);
+		setupVAO();
+	}
+
+	void GeometryPool::setupVAO()
+	{
+		if (mVBO == 0 || mEBO == 0) {
+			return;
+		}
+		GLState::get().bindVertexArray(mVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, mVBO);
+		setVertexAttributes();
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
+		GLState::get().bindVertexArray(0);
+	}
+}
@@ -0,0 +1,238 @@
+//Author: Eric Winebrenner
+
+#include "HiZCuller.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+
+namespace ew {
+	//Levels this size or smaller are read back. Coarser levels are cheap to copy and enough to hide whole objects.
+	const int MAX_READBACK_SIZE = 256;
+
+	HiZCuller::HiZCuller(GLuint textureUnit)
+		: mDownsampleShader("shaders/hiZ.vert", "shaders/hiZDownsample.frag"), mTextureUnit(textureUnit)
+	{
+		mSourceUniform = mDownsampleShader.getUniform("_Source");
+		glGenFramebuffers(1, &mFramebuffer);
+		glGenVertexArrays(1, &mEmptyVAO);
+		glGenBuffers(1, &mReadbackBuffer);
+	}
+
+	HiZCuller::~HiZCuller()
+	{
+		deletePyramid();
+		glDeleteFramebuffers(1, &mFramebuffer);
+		GLState::get().forgetVertexArray(mEmptyVAO);
+		glDeleteVertexArrays(1, &mEmptyVAO);
+		glDeleteBuffers(1, &mReadbackBuffer);
+	}
+
+	void HiZCuller::deletePyramid()
+	{
+		if (mReadbackFence != 0) {
+			glDeleteSync(mReadbackFence);
+			mReadbackFence = 0;
+		}
+		if (mPyramid != 0) {
+			GLState::get().forgetTexture(mPyramid);
+			glDeleteTextures(1, &mPyramid);
+			mPyramid = 0;
+		}
+		mHasDepth = false;
+	}
+
+	//Level 0 is half the depth buffer's size, since a full size copy would only repeat it
+	void HiZCuller::createPyramid(int depthWidth, int depthHeight)
+	{
+		deletePyramid();
+		mDepthWidth = depthWidth;
+		mDepthHeight = depthHeight;
+		int width = std::max(depthWidth / 2, 1);
+		int height = std::max(depthHeight / 2, 1);
+		mNumLevels = (int)std::log2((float)std::max(width, height)) + 1;
+
+		GLState::get().activeTexture(GL_TEXTURE0 + mTextureUnit);
+		glGenTextures(1, &mPyramid);
+		GLState::get().bindTexture(GL_TEXTURE_2D, mPyramid);
+		glTexStorage2D(GL_TEXTURE_2D, mNumLevels, GL_R32F, width, height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		mLevels.clear();
+		int numTexels = 0;
+		mFirstReadbackLevel = -1;
+		for (int level = 0; level < mNumLevels; level++) {
+			if (mFirstReadbackLevel < 0 && width <= MAX_READBACK_SIZE && height <= MAX_READBACK_SIZE) {
+				mFirstReadbackLevel = level;
+			}
+			if (mFirstReadbackLevel >= 0) {
+				mLevels.push_back({ width, height, numTexels });
+				numTexels += width * height;
+			}
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		mDepths.assign(numTexels, 1.0f);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, mReadbackBuffer);
+		glBufferData(GL_PIXEL_PACK_BUFFER, numTexels * sizeof(float), NULL, GL_STREAM_READ);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	void HiZCuller::build(GLuint depthTexture, const glm::mat4& viewProjection)
+	{
+		ProfileScope scope("HiZBuild");
+		GLState& state = GLState::get();
+		GLenum activeTexture = state.getActiveTexture();
+		state.activeTexture(GL_TEXTURE0 + mTextureUnit);
+		GLint depthWidth, depthHeight;
+		state.bindTexture(GL_TEXTURE_2D, depthTexture);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &depthWidth);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &depthHeight);
+		if (depthWidth != mDepthWidth || depthHeight != mDepthHeight) {
+			createPyramid(depthWidth, depthHeight);
+		}
+
+		//Everything changed here is put back, the caller's draws shouldn't notice
+		GLint framebuffer, viewport[4], polygonMode[2];
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+		state.getViewport(viewport);
+		glGetIntegerv(GL_POLYGON_MODE, polygonMode);
+		GLboolean depthTest = state.isEnabled(GL_DEPTH_TEST);
+		state.disable(GL_DEPTH_TEST);
+		glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, mFramebuffer);
+		state.bindVertexArray(mEmptyVAO);
+		mDownsampleShader.use();
+		mDownsampleShader.setInt(mSourceUniform, mTextureUnit);
+		int width = std::max(mDepthWidth / 2, 1);
+		int height = std::max(mDepthHeight / 2, 1);
+		for (int level = 0; level < mNumLevels; level++) {
+			//Sampling only the level above keeps the level being drawn out of reach, so it isn't a feedback loop
+			if (level == 0) {
+				state.bindTexture(GL_TEXTURE_2D, depthTexture);
+			}
+			else {
+				state.bindTexture(GL_TEXTURE_2D, mPyramid);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+			}
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, mPyramid, level);
+			state.viewport(0, 0, width, height);
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			width = std::max(width / 2, 1);
+			height = std::max(height / 2, 1);
+		}
+		state.bindTexture(GL_TEXTURE_2D, mPyramid);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, mNumLevels - 1);
+
+		//Only one readback is in flight. If the last hasn't landed yet, this frame's pyramid just isn't read.
+		update();
+		if (mReadbackFence == 0) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, mReadbackBuffer);
+			for (int i = 0; i < (int)mLevels.size(); i++) {
+				glGetTexImage(GL_TEXTURE_2D, mFirstReadbackLevel + i, GL_RED, GL_FLOAT, (void*)(mLevels[i].offset * sizeof(float)));
+			}
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			mReadbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+			mPendingViewProjection = viewProjection;
+		}
+
+		state.bindVertexArray(0);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+		state.viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		glPolygonMode(GL_FRONT_AND_BACK, polygonMode[0]);
+		if (depthTest) {
+			state.enable(GL_DEPTH_TEST);
+		}
+		state.activeTexture(activeTexture);
+	}
+
+	void HiZCuller::update(bool wait)
+	{
+		if (mReadbackFence == 0) {
+			return;
+		}
+		//Waiting has to flush, or the fence may never reach the GPU
+		GLenum status = wait ? glClientWaitSync(mReadbackFence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED)
+			: glClientWaitSync(mReadbackFence, 0, 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+			return;
+		}
+		glDeleteSync(mReadbackFence);
+		mReadbackFence = 0;
+
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, mReadbackBuffer);
+		const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, mDepths.size() * sizeof(float), GL_MAP_READ_BIT);
+		if (data != NULL) {
+			memcpy(mDepths.data(), data, mDepths.size() * sizeof(float));
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+			mViewProjection = mPendingViewProjection;
+			mHasDepth = true;
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	bool HiZCuller::isOccluded(const AABB& worldBounds)const
+	{
+		if (!mHasDepth) {
+			return false;
+		}
+
+		glm::vec2 ndcMin = glm::vec2(INFINITY);
+		glm::vec2 ndcMax = glm::vec2(-INFINITY);
+		float nearestDepth = INFINITY;
+		for (int corner = 0; corner < 8; corner++) {
+			glm::vec3 position = glm::vec3(corner & 1 ? worldBounds.max.x : worldBounds.min.x,
+				corner & 2 ? worldBounds.max.y : worldBounds.min.y,
+				corner & 4 ? worldBounds.max.z : worldBounds.min.z);
+			glm::vec4 clip = mViewProjection * glm::vec4(position, 1.0f);
+			//Corners behind the eye don't project sensibly, and a box that close is never worth hiding
+			if (clip.w <= 1e-5f) {
+				return false;
+			}
+			glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			ndcMin = glm::min(ndcMin, glm::vec2(ndc));
+			ndcMax = glm::max(ndcMax, glm::vec2(ndc));
+			nearestDepth = std::min(nearestDepth, ndc.z * 0.5f + 0.5f);
+		}
+		//Off screen when the depth was drawn, so it says nothing about this box
+		if (ndcMax.x < -1.0f || ndcMin.x > 1.0f || ndcMax.y < -1.0f || ndcMin.y > 1.0f) {
+			return false;
+		}
+
+		//Pixel rectangle the box covers in the depth buffer
+		ndcMin = glm::clamp(ndcMin, glm::vec2(-1.0f), glm::vec2(1.0f));
+		ndcMax = glm::clamp(ndcMax, glm::vec2(-1.0f), glm::vec2(1.0f));
+		glm::vec2 depthSize = glm::vec2((float)mDepthWidth, (float)mDepthHeight);
+		glm::vec2 pixelMin = (ndcMin * 0.5f + 0.5f) * depthSize;
+		glm::vec2 pixelMax = (ndcMax * 0.5f + 0.5f) * depthSize;
+		int minX = std::min((int)pixelMin.x, mDepthWidth - 1);
+		int minY = std::min((int)pixelMin.y, mDepthHeight - 1);
+		int maxX = std::max(std::min((int)std::ceil(pixelMax.x) - 1, mDepthWidth - 1), minX);
+		int maxY = std::max(std::min((int)std::ceil(pixelMax.y) - 1, mDepthHeight - 1), minY);
+
+		//Pyramid level i has a texel per 2^(i+1) pixels. Pick the one where the rectangle is about 2 texels across.
+		int size = std::max(maxX - minX, maxY - minY) + 1;
+		int level = (int)std::ceil(std::log2((float)size)) - 2;
+		level = std::min(std::max(level, mFirstReadbackLevel), mFirstReadbackLevel + (int)mLevels.size() - 1);
+		const Level& data = mLevels[level - mFirstReadbackLevel];
+
+		//Halving rounds down, so the last texel of each level also covers the odd pixels past it
+		int shift = level + 1;
+		int texelMinX = std::min(minX >> shift, data.width - 1);
+		int texelMaxX = std::min(maxX >> shift, data.width - 1);
+		int texelMinY = std::min(minY >> shift, data.height - 1);
+		int texelMaxY = std::min(maxY >> shift, data.height - 1);
+		float farthestDepth = 0.0f;
+		for (int y = texelMinY; y <= texelMaxY; y++) {
+			for (int x = texelMinX; x <= texelMaxX; x++) {
+				farthestDepth = std::max(farthestDepth, mDepths[data.offset + y * data.width + x]);
+			}
+		}
+		return nearestDepth > farthestDepth;
+	}
+}
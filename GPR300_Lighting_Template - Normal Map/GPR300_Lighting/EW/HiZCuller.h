@@ -0,0 +1,70 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "Shader.h"
+#include "BVH.h"
+
+namespace ew {
+	/// <summary>
+	/// Hierarchical Z occlusion culling. build() downsamples a frame's depth into a mip pyramid where each texel
+	/// holds the farthest depth beneath it, then starts reading the coarse levels back.
+	/// isOccluded() tests boxes against the most recent pyramid that has arrived, projected with the view it was drawn from.
+	/// Anything the pyramid can't vouch for counts as visible: no pyramid yet, boxes off screen in that view,
+	/// and boxes crossing its near plane.
+	/// Depth from an older view can hide objects the camera has since uncovered, so for culling draw last frame's
+	/// visible objects first, build() from that depth, update(), then test and draw the rest.
+	/// update(true) tests the rest against the depth just drawn, but it waits until the GPU has finished everything
+	/// submitted so far. Called every frame, that stall usually costs more than culling saves. update() without waiting
+	/// uses the newest pyramid that has arrived, normally the previous frame's, so uncovered objects can show a frame late.
+	/// </summary>
+	class HiZCuller {
+	public:
+		//The pyramid is bound to textureUnit while building
+		HiZCuller(GLuint textureUnit);
+		~HiZCuller();
+		//Call after drawing, with the depth texture drawn into and the view projection it was drawn with.
+		//Picks up a finished readback first, so the next one can start from this frame.
+		void build(GLuint depthTexture, const glm::mat4& viewProjection);
+		//Picks up the latest readback if it has finished, or once it has if wait is true.
+		//Waiting blocks the CPU until the GPU has caught up with every command before it.
+		void update(bool wait = false);
+		//True only if the box is certainly behind depth in the pyramid
+		bool isOccluded(const AABB& worldBounds)const;
+		inline bool hasDepth()const { return mHasDepth; }
+		inline GLuint getPyramidTexture()const { return mPyramid; }
+	private:
+		HiZCuller(const HiZCuller& r) = delete;
+		void createPyramid(int depthWidth, int depthHeight);
+		void deletePyramid();
+
+		//A pyramid level read back to the CPU
+		struct Level {
+			int width;
+			int height;
+			//Index of its first texel in mDepths
+			int offset;
+		};
+
+		Shader mDownsampleShader;
+		UniformHandle mSourceUniform;
+		GLuint mTextureUnit;
+		GLuint mPyramid = 0;
+		GLuint mFramebuffer = 0;
+		GLuint mEmptyVAO = 0;
+		GLuint mReadbackBuffer = 0;
+		GLsync mReadbackFence = 0;
+		int mDepthWidth = 0;
+		int mDepthHeight = 0;
+		int mNumLevels = 0;
+		//Pyramid level of mLevels[0]. Finer levels stay on the GPU.
+		int mFirstReadbackLevel = 0;
+		std::vector<Level> mLevels;
+		std::vector<float> mDepths;
+		glm::mat4 mViewProjection = glm::mat4(1);
+		glm::mat4 mPendingViewProjection = glm::mat4(1);
+		bool mHasDepth = false;
+	};
+}
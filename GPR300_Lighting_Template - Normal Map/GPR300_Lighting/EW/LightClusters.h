@@ -0,0 +1,82 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstddef>
+#include "LightBlock.h"
+#include "UniformBuffer.h"
+#include "StorageBuffer.h"
+
+namespace ew {
+	//Uniform block binding, after LIGHT_BLOCK_BINDING and MATERIAL_BLOCK_BINDING
+	const unsigned int CLUSTER_BLOCK_BINDING = 2;
+
+	//Shader storage buffer bindings, above the multi-draw object and culling buffers (0-5) so they're never rebound
+	const unsigned int CLUSTER_PT_LIGHT_BINDING = 6;
+	const unsigned int CLUSTER_SP_LIGHT_BINDING = 7;
+	const unsigned int CLUSTER_GRID_BINDING = 8;
+	const unsigned int CLUSTER_INDEX_BINDING = 9;
+
+	/// <summary>
+	/// Matches "uniform ClusterBlock" in defaultLit.frag.
+	/// depthParams.x/y are the scale and bias that turn log(view depth) into a depth slice.
+	/// </summary>
+	struct ClusterBlock {
+		glm::mat4 view = glm::mat4(1);
+		glm::uvec4 gridSize = glm::uvec4(0);
+		glm::vec4 depthParams = glm::vec4(0);
+		glm::vec2 screenSize = glm::vec2(0);
+		glm::vec2 _pad0 = glm::vec2(0);
+	};
+	static_assert(offsetof(ClusterBlock, view) == 0, "std140 mismatch");
+	static_assert(offsetof(ClusterBlock, gridSize) == 64, "std140 mismatch");
+	static_assert(offsetof(ClusterBlock, depthParams) == 80, "std140 mismatch");
+	static_assert(offsetof(ClusterBlock, screenSize) == 96, "std140 mismatch");
+	static_assert(sizeof(ClusterBlock) == 112, "std140 mismatch");
+
+	/// <summary>
+	/// Bins point and spot lights into view-space froxels (screen tiles x exponential depth slices).
+	/// Each cluster stores an offset into a shared index list followed by its point then spot light counts,
+	/// so a fragment only loops over the lights that can reach it.
+	/// </summary>
+	class LightClusters {
+	public:
+		LightClusters(int gridX = 16, int gridY = 9, int gridZ = 24);
+		void build(const std::vector<PtLightData>& ptLights, const std::vector<SpLightData>& spLights,
+			const glm::mat4& view, const glm::mat4& projection, int screenWidth, int screenHeight);
+		//View depths the slices are spread over, normally the camera's near and far planes
+		inline void setDepthRange(float nearZ, float farZ) { mNearZ = nearZ; mFarZ = farZ; }
+		inline int getNumClusters()const { return mGridX * mGridY * mGridZ; }
+		inline int getNumIndices()const { return (int)mIndices.size(); }
+		inline int getMaxLightsPerCluster()const { return mMaxLightsPerCluster; }
+	private:
+		LightClusters(const LightClusters& r) = delete;
+
+		//Inclusive cluster coordinates a light overlaps. Empty when minX > maxX.
+		struct ClusterRange {
+			int minX = 1, maxX = 0;
+			int minY = 1, maxY = 0;
+			int minZ = 1, maxZ = 0;
+		};
+		ClusterRange getClusterRange(const glm::vec3& worldPosition, float radius, const glm::mat4& view, const glm::mat4& projection) const;
+		int getDepthSlice(float viewDepth) const;
+
+		int mGridX, mGridY, mGridZ;
+		float mNearZ = 0.1f;
+		float mFarZ = 100.0f;
+		int mMaxLightsPerCluster = 0;
+
+		std::vector<ClusterRange> mPtRanges;
+		std::vector<ClusterRange> mSpRanges;
+		//x = offset into mIndices, y = point light count, z = spot light count
+		std::vector<glm::uvec4> mGrid;
+		std::vector<unsigned int> mIndices;
+
+		UniformBuffer mClusterUBO;
+		StorageBuffer mPtLightBuffer;
+		StorageBuffer mSpLightBuffer;
+		StorageBuffer mGridBuffer;
+		StorageBuffer mIndexBuffer;
+	};
+}
@@ -0,0 +1,166 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "Trace.h"
+
+namespace ew {
+	//Summary of a set of timings in milliseconds
+	struct ProfileStats {
+		double mean = 0.0;
+		double min = 0.0;
+		double p50 = 0.0;
+		double p90 = 0.0;
+		double p95 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+	//Nearest rank percentiles, all zeros for no samples
+	ProfileStats computeStats(const std::vector<double>& samples);
+
+	//One scope in a finished frame. Start times are from the start of the frame, on the same clock as the duration.
+	struct ProfileSample {
+		int node;
+		int depth;
+		double cpuStartMs;
+		double cpuMs;
+		double gpuStartMs;
+		double gpuMs;
+	};
+
+	struct ProfileFrame {
+		uint64_t frameNumber = 0;
+		double cpuMs = 0.0;
+		double gpuMs = 0.0;
+		//In the order scopes were opened, so a parent always comes before its children
+		std::vector<ProfileSample> samples;
+	};
+
+	/// <summary>
+	/// Times named scopes on the CPU and the GPU every frame. Scopes nest into a call tree, the same name under
+	/// a different parent is a different node, and each node keeps a rolling history to take stats from.
+	/// GPU times are GL_TIMESTAMP queries read once the GPU has passed them, a frame or two later, so profiling doesn't stall.
+	/// Only the GL thread opens scopes, any other thread's are ignored.
+	/// While the shared TraceRecorder is on, frames and scopes also go to it, with the GPU times on a track of their own.
+	/// </summary>
+	class Profiler {
+	public:
+		//Frames of history per node
+		static const int HISTORY_FRAMES = 240;
+		//Unread frames allowed before the oldest is waited on
+		static const int MAX_FRAMES_IN_FLIGHT = 3;
+		Profiler() = default;
+		//Scopes only open between beginFrame() and endFrame()
+		void beginFrame();
+		void endFrame();
+		//ProfileScope is the usual way in. Ending with no scope open does nothing.
+		//The name is kept by pointer for tracing, so it should be a string literal.
+		void beginScope(const char* name);
+		void endScope();
+		//Waits for every frame still on the GPU
+		void flush();
+		//Takes effect from the next frame
+		inline void setEnabled(bool enabled) { mEnabled = enabled; }
+		inline bool isEnabled()const { return mEnabled; }
+		//Number the next frame will get
+		inline uint64_t getFrameNumber()const { return mNextFrameNumber; }
+		//Called with each frame as its GPU times come in, in frame order
+		inline void setFrameCallback(std::function<void(const ProfileFrame&)> callback) { mFrameCallback = callback; }
+		inline int getNumNodes()const { return (int)mNodes.size(); }
+		inline const std::string& getNodeName(int node)const { return mNodes[node].name; }
+		//-1 for top level scopes
+		inline int getNodeParent(int node)const { return mNodes[node].parent; }
+		//Over the node's history. A scope opened several times in a frame counts as their total.
+		ProfileStats getCpuStats(int node)const;
+		ProfileStats getGpuStats(int node)const;
+		//A per frame count shown under the scopes, eg. state changes. Ignored while disabled.
+		void setCounter(const char* name, double value);
+		//Stats for every node and a flame graph of the latest finished frame
+		void drawUI();
+		//Shared profiler used by ProfileScope
+		static Profiler& get();
+	private:
+		Profiler(const Profiler& r) = delete;
+		//Ring buffer of the last HISTORY_FRAMES values
+		struct History {
+			std::vector<double> samples;
+			int next = 0;
+			void push(double value);
+		};
+		struct Node {
+			std::string name;
+			int parent;
+			int depth;
+			std::vector<int> children;
+			History cpuHistory;
+			History gpuHistory;
+		};
+		struct Counter {
+			std::string name;
+			double last;
+			History history;
+		};
+		struct PendingScope {
+			const char* name;
+			int node;
+			int depth;
+			std::chrono::steady_clock::time_point cpuBegin;
+			std::chrono::steady_clock::time_point cpuEnd;
+			GLuint beginQuery;
+			GLuint endQuery;
+		};
+		struct PendingFrame {
+			uint64_t frameNumber;
+			std::chrono::steady_clock::time_point cpuBegin;
+			std::chrono::steady_clock::time_point cpuEnd;
+			GLuint beginQuery;
+			GLuint endQuery;
+			std::vector<PendingScope> scopes;
+		};
+		GLuint acquireQuery();
+		int findNode(int parent, const char* name);
+		//Reads the oldest pending frame, false if wait is false and the GPU isn't done with it
+		bool resolveOldest(bool wait);
+		void drawFlameGraph(const char* label, bool gpu);
+		void drawNodeRow(int node);
+
+		bool mEnabled = true;
+		bool mFrameOpen = false;
+		uint64_t mNextFrameNumber = 0;
+		std::thread::id mThread;
+		PendingFrame mCurrentFrame;
+		//Indices of the open scopes in mCurrentFrame
+		std::vector<int> mScopeStack;
+		std::deque<PendingFrame> mPendingFrames;
+		//Queries die with the GL context, which the shared profiler outlives, so they are recycled but never deleted
+		std::vector<GLuint> mFreeQueries;
+		std::vector<Node> mNodes;
+		std::vector<int> mRootNodes;
+		std::vector<Counter> mCounters;
+		History mFrameCpuHistory;
+		History mFrameGpuHistory;
+		ProfileFrame mLastFrame;
+		bool mHasLastFrame = false;
+		std::function<void(const ProfileFrame&)> mFrameCallback;
+		//Trace track for GPU times, made the first time one is traced
+		int mGpuTraceTrack = -1;
+	};
+
+	/// <summary>
+	/// Times the enclosing block with the shared Profiler, eg. ProfileScope scope("ShadowPass");
+	/// </summary>
+	class ProfileScope {
+	public:
+		ProfileScope(const char* name) { Profiler::get().beginScope(name); }
+		~ProfileScope() { Profiler::get().endScope(); }
+	private:
+		ProfileScope(const ProfileScope& r) = delete;
+	};
+}
@@ -0,0 +1,95 @@
+//Author: Eric Winebrenner
+
+#include "RenderQueue.h"
+#include "Profiler.h"
+#include <algorithm>
+
+namespace ew {
+	//Low byte of every key is left empty, sort() skips it
+	static const int PASS_SHIFT = 64 - RenderQueue::PASS_BITS;
+	static const int RADIX_BITS = 8;
+	static const int RADIX_BUCKETS = 1 << RADIX_BITS;
+	static const int RADIX_DIGITS = 64 / RADIX_BITS;
+
+	static uint64_t field(uint32_t value, int bits, int shift)
+	{
+		return (uint64_t)(value & ((1u << bits) - 1)) << shift;
+	}
+
+	uint64_t RenderQueue::makeOpaqueKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t depthBucket)
+	{
+		const int shaderShift = PASS_SHIFT - SHADER_BITS;
+		const int materialShift = shaderShift - MATERIAL_BITS;
+		const int depthShift = materialShift - DEPTH_BITS;
+		return field(pass, PASS_BITS, PASS_SHIFT) | field(shader, SHADER_BITS, shaderShift)
+			| field(material, MATERIAL_BITS, materialShift) | field(depthBucket, DEPTH_BITS, depthShift);
+	}
+
+	uint64_t RenderQueue::makeBlendedKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t depthBucket)
+	{
+		//Inverted so the farthest sorts first
+		const int depthShift = PASS_SHIFT - DEPTH_BITS;
+		const int shaderShift = depthShift - SHADER_BITS;
+		const int materialShift = shaderShift - MATERIAL_BITS;
+		return field(pass, PASS_BITS, PASS_SHIFT) | field(~depthBucket, DEPTH_BITS, depthShift)
+			| field(shader, SHADER_BITS, shaderShift) | field(material, MATERIAL_BITS, materialShift);
+	}
+
+	uint32_t RenderQueue::getDepthBucket(float viewDepth, float farPlane)
+	{
+		const uint32_t maxBucket = (1u << DEPTH_BITS) - 1;
+		float normalized = std::min(std::max(viewDepth / farPlane, 0.0f), 1.0f);
+		return (uint32_t)(normalized * maxBucket);
+	}
+
+	uint32_t RenderQueue::getPass(uint64_t key)
+	{
+		return (uint32_t)(key >> PASS_SHIFT);
+	}
+
+	void RenderQueue::clear()
+	{
+		mItems.clear();
+	}
+
+	void RenderQueue::submit(uint64_t key, int command)
+	{
+		mItems.push_back(RenderItem{ key, command });
+	}
+
+	void RenderQueue::sort()
+	{
+		ProfileScope scope("RenderSort");
+		int numItems = (int)mItems.size();
+		if (numItems < 2) {
+			return;
+		}
+		//Every digit's histogram in one read of the keys
+		std::vector<int> counts(RADIX_DIGITS * RADIX_BUCKETS, 0);
+		for (const RenderItem& item : mItems) {
+			for (int digit = 0; digit < RADIX_DIGITS; digit++) {
+				counts[digit * RADIX_BUCKETS + ((item.key >> (digit * RADIX_BITS)) & (RADIX_BUCKETS - 1))]++;
+			}
+		}
+		mScratch.resize(numItems);
+		for (int digit = 0; digit < RADIX_DIGITS; digit++) {
+			int* digitCounts = &counts[digit * RADIX_BUCKETS];
+			int shift = digit * RADIX_BITS;
+			//A byte every key shares can't reorder anything
+			if (digitCounts[(mItems[0].key >> shift) & (RADIX_BUCKETS - 1)] == numItems) {
+				continue;
+			}
+			int offset = 0;
+			for (int bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+				int count = digitCounts[bucket];
+				digitCounts[bucket] = offset;
+				offset += count;
+			}
+			//Scattering in input order keeps each pass stable, which the lower digits' order relies on
+			for (const RenderItem& item : mItems) {
+				mScratch[digitCounts[(item.key >> shift) & (RADIX_BUCKETS - 1)]++] = item;
+			}
+			mItems.swap(mScratch);
+		}
+	}
+}
@@ -0,0 +1,46 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace ew {
+	struct RenderItem {
+		uint64_t key;
+		//Caller's index for the draw, eg. into its own array of draw commands
+		int command;
+	};
+
+	/// <summary>
+	/// A frame's draws, each with a 64 bit sort key, radix sorted so they can be run in key order.
+	/// Opaque keys sort by pass, then shader, then material, then depth front to back, so programs and textures change
+	/// as rarely as possible and near objects fill the depth buffer first for early-Z to reject what's behind them.
+	/// Blended keys sort by pass, then depth back to front, since blending has to happen in that order, then shader and material.
+	/// Draws with equal keys keep the order they were submitted in.
+	/// clear() and submit() every draw each frame, sort(), then run getItems() in order.
+	/// </summary>
+	class RenderQueue {
+	public:
+		//Field widths. Passes, shaders and materials are small ids chosen by the caller, wider values are cut off.
+		static const int PASS_BITS = 4;
+		static const int SHADER_BITS = 12;
+		static const int MATERIAL_BITS = 16;
+		static const int DEPTH_BITS = 24;
+		static uint64_t makeOpaqueKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t depthBucket);
+		static uint64_t makeBlendedKey(uint32_t pass, uint32_t shader, uint32_t material, uint32_t depthBucket);
+		//View space distance quantized to DEPTH_BITS, clamped to farPlane
+		static uint32_t getDepthBucket(float viewDepth, float farPlane);
+		static uint32_t getPass(uint64_t key);
+
+		void clear();
+		void submit(uint64_t key, int command);
+		//Least significant byte first, skipping bytes every key has the same value in
+		void sort();
+		inline const std::vector<RenderItem>& getItems()const { return mItems; }
+		inline int getNumItems()const { return (int)mItems.size(); }
+	private:
+		std::vector<RenderItem> mItems;
+		//Other half of each radix pass, kept to avoid reallocating every frame
+		std::vector<RenderItem> mScratch;
+	};
+}
@@ -0,0 +1,54 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "Transform.h"
+
+namespace ew {
+	/// <summary>
+	/// Parent/child hierarchy of transforms. World matrix = parent's world matrix * local matrix.
+	/// Nodes are kept in one array in depth first order, so every subtree is a contiguous range that starts at its root.
+	/// Changing a node only marks it dirty; update() then walks just the ranges under dirty nodes,
+	/// so a frame where little moved costs little no matter how big the graph is.
+	/// </summary>
+	class SceneGraph {
+	public:
+		//parent < 0 makes a root. Returns the node's id, which never changes.
+		int addNode(const Transform& localTransform = Transform(), int parent = -1);
+		void setLocalTransform(int node, const Transform& localTransform);
+		inline const Transform& getLocalTransform(int node)const { return mNodes[mSlots[node]].local; }
+		inline int getParent(int node)const { return mNodes[mSlots[node]].parent; }
+		inline int getNumNodes()const { return (int)mNodes.size(); }
+		//Recomputes world matrices under every node changed since the last update. Returns how many nodes were recomputed.
+		int update();
+		//Valid after update()
+		inline const glm::mat4& getWorldMatrix(int node)const { return mWorldMatrices[mSlots[node]]; }
+		inline const glm::mat3& getWorldNormalMatrix(int node)const { return mWorldNormalMatrices[mSlots[node]]; }
+	private:
+		//Everything here is stored by slot, the node's position in depth first order
+		struct Node {
+			int id;
+			int parent;
+			//Slot of the parent, -1 for roots
+			int parentSlot;
+			//One past the last slot of this node's subtree
+			int subtreeEnd;
+			bool localDirty;
+			Transform local;
+			glm::mat4 localMatrix;
+			glm::mat3 localNormalMatrix;
+		};
+		void sortNodes();
+
+		std::vector<Node> mNodes;
+		std::vector<glm::mat4> mWorldMatrices;
+		std::vector<glm::mat3> mWorldNormalMatrices;
+		//Node id -> slot
+		std::vector<int> mSlots;
+		//Node ids changed since the last update
+		std::vector<int> mDirtyNodes;
+		//Set when nodes are added, the depth first order is rebuilt on the next update
+		bool mOrderDirty = false;
+	};
+}
@@ -1,8 +1,17 @@
 //Author: Eric Winebrenner
 
 #include "Shader.h"
+#include "GLState.h"
+#include "FileWatcher.h"
+#include "Trace.h"
+#include <stdio.h>
 #include <fstream>
 #include <sstream>
+#include <vector>
+#include <chrono>
+#include <filesystem>
+#include <algorithm>
+#include <utility>
 
 #include <glm/vec3.hpp> // glm::vec3
 #include <glm/vec4.hpp> // glm::vec4
@@ -10,67 +19,818 @@
 #include <glm/ext/matrix_transform.hpp> // glm::translate, glm::rotate, glm::scale
 #include <glm/gtc/type_ptr.hpp>
 
-Shader::Shader(std::string vertexShaderPath, std::string fragmentShaderPath)
+std::string Shader::s_binaryCacheDirectory = "shadercache";
+
+//Header written in front of every cached program binary
+struct ProgramBinaryHeader {
+	uint32_t magic;
+	GLenum format;
+	GLint length;
+};
+constexpr uint32_t PROGRAM_BINARY_MAGIC = 0x42535745; //"EWSB"
+
+Shader::Shader(std::string vertexShaderPath, std::string fragmentShaderPath, std::vector<std::string> features)
+	: Shader({ { GL_VERTEX_SHADER, vertexShaderPath }, { GL_FRAGMENT_SHADER, fragmentShaderPath } }, features)
+{
+}
+
+Shader::Shader(std::string computeShaderPath)
+	: Shader({ { GL_COMPUTE_SHADER, computeShaderPath } }, {})
+{
+}
+
+Shader::Shader(std::vector<Stage> stages, std::vector<std::string> features)
+	: m_stages(stages), m_features(features)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	for (Stage& stage : m_stages) {
+		stage.source = readFile(stage.path);
+	}
+
+	//The variant with no features is built up front so the shader is usable straight away
+	m_fromBinaryCache = startBuild(0);
+	finishBuilds(true);
+
+	m_buildTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+Shader::Shader(Shader&& other) noexcept
+{
+	*this = std::move(other);
+}
+
+Shader& Shader::operator=(Shader&& other) noexcept
+{
+	if (this == &other) {
+		return *this;
+	}
+	release();
+	m_id = std::exchange(other.m_id, 0);
+	//Watch ids go with the stages
+	m_stages = std::move(other.m_stages);
+	m_features = std::move(other.m_features);
+	m_fromBinaryCache = other.m_fromBinaryCache;
+	m_buildTime = other.m_buildTime;
+	//Moving the map hands over its nodes without relocating them, so m_current still points into it
+	m_variants = std::move(other.m_variants);
+	m_pendingBuilds = std::move(other.m_pendingBuilds);
+	m_current = std::exchange(other.m_current, nullptr);
+	m_currentMask = other.m_currentMask;
+	m_requestedMask = other.m_requestedMask;
+	m_uniformSlots = std::move(other.m_uniformSlots);
+	m_hotReload = std::exchange(other.m_hotReload, false);
+	other.m_stages.clear();
+	other.m_variants.clear();
+	other.m_pendingBuilds.clear();
+	return *this;
+}
+
+Shader::~Shader()
+{
+	release();
+}
+
+void Shader::release()
+{
+	for (PendingBuild& build : m_pendingBuilds) {
+		for (GLuint shader : build.shaders) {
+			glDeleteShader(shader);
+		}
+		ew::GLState::get().forgetProgram(build.program);
+		glDeleteProgram(build.program);
+	}
+	m_pendingBuilds.clear();
+	for (auto& variant : m_variants) {
+		ew::GLState::get().forgetProgram(variant.second.program);
+		glDeleteProgram(variant.second.program);
+	}
+	m_variants.clear();
+	m_current = nullptr;
+	m_id = 0;
+	for (Stage& stage : m_stages) {
+		if (stage.watchId >= 0) {
+			ew::FileWatcher::get().unwatch(stage.watchId);
+			stage.watchId = -1;
+		}
+	}
+	m_hotReload = false;
+}
+
+void Shader::setBinaryCacheDirectory(const std::string& directory)
+{
+	s_binaryCacheDirectory = directory;
+}
+
+//Types whose value is a single int: int, bool, and every sampler and image unit
+static bool isSingleIntType(GLenum type)
+{
+	switch (type) {
+	case GL_INT:
+	case GL_BOOL:
+	case GL_SAMPLER_1D:
+	case GL_SAMPLER_2D:
+	case GL_SAMPLER_3D:
+	case GL_SAMPLER_CUBE:
+	case GL_SAMPLER_1D_SHADOW:
+	case GL_SAMPLER_2D_SHADOW:
+	case GL_SAMPLER_1D_ARRAY:
+	case GL_SAMPLER_2D_ARRAY:
+	case GL_SAMPLER_1D_ARRAY_SHADOW:
+	case GL_SAMPLER_2D_ARRAY_SHADOW:
+	case GL_SAMPLER_2D_MULTISAMPLE:
+	case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
+	case GL_SAMPLER_CUBE_SHADOW:
+	case GL_SAMPLER_CUBE_MAP_ARRAY:
+	case GL_SAMPLER_CUBE_MAP_ARRAY_SHADOW:
+	case GL_SAMPLER_BUFFER:
+	case GL_SAMPLER_2D_RECT:
+	case GL_SAMPLER_2D_RECT_SHADOW:
+	case GL_INT_SAMPLER_1D:
+	case GL_INT_SAMPLER_2D:
+	case GL_INT_SAMPLER_3D:
+	case GL_INT_SAMPLER_CUBE:
+	case GL_INT_SAMPLER_1D_ARRAY:
+	case GL_INT_SAMPLER_2D_ARRAY:
+	case GL_INT_SAMPLER_2D_MULTISAMPLE:
+	case GL_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+	case GL_INT_SAMPLER_CUBE_MAP_ARRAY:
+	case GL_INT_SAMPLER_BUFFER:
+	case GL_INT_SAMPLER_2D_RECT:
+	case GL_UNSIGNED_INT_SAMPLER_1D:
+	case GL_UNSIGNED_INT_SAMPLER_2D:
+	case GL_UNSIGNED_INT_SAMPLER_3D:
+	case GL_UNSIGNED_INT_SAMPLER_CUBE:
+	case GL_UNSIGNED_INT_SAMPLER_1D_ARRAY:
+	case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+	case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE:
+	case GL_UNSIGNED_INT_SAMPLER_2D_MULTISAMPLE_ARRAY:
+	case GL_UNSIGNED_INT_SAMPLER_CUBE_MAP_ARRAY:
+	case GL_UNSIGNED_INT_SAMPLER_BUFFER:
+	case GL_UNSIGNED_INT_SAMPLER_2D_RECT:
+	case GL_IMAGE_1D:
+	case GL_IMAGE_2D:
+	case GL_IMAGE_3D:
+	case GL_IMAGE_2D_RECT:
+	case GL_IMAGE_CUBE:
+	case GL_IMAGE_BUFFER:
+	case GL_IMAGE_1D_ARRAY:
+	case GL_IMAGE_2D_ARRAY:
+	case GL_IMAGE_CUBE_MAP_ARRAY:
+	case GL_IMAGE_2D_MULTISAMPLE:
+	case GL_IMAGE_2D_MULTISAMPLE_ARRAY:
+	case GL_INT_IMAGE_1D:
+	case GL_INT_IMAGE_2D:
+	case GL_INT_IMAGE_3D:
+	case GL_INT_IMAGE_2D_RECT:
+	case GL_INT_IMAGE_CUBE:
+	case GL_INT_IMAGE_BUFFER:
+	case GL_INT_IMAGE_1D_ARRAY:
+	case GL_INT_IMAGE_2D_ARRAY:
+	case GL_INT_IMAGE_CUBE_MAP_ARRAY:
+	case GL_INT_IMAGE_2D_MULTISAMPLE:
+	case GL_INT_IMAGE_2D_MULTISAMPLE_ARRAY:
+	case GL_UNSIGNED_INT_IMAGE_1D:
+	case GL_UNSIGNED_INT_IMAGE_2D:
+	case GL_UNSIGNED_INT_IMAGE_3D:
+	case GL_UNSIGNED_INT_IMAGE_2D_RECT:
+	case GL_UNSIGNED_INT_IMAGE_CUBE:
+	case GL_UNSIGNED_INT_IMAGE_BUFFER:
+	case GL_UNSIGNED_INT_IMAGE_1D_ARRAY:
+	case GL_UNSIGNED_INT_IMAGE_2D_ARRAY:
+	case GL_UNSIGNED_INT_IMAGE_CUBE_MAP_ARRAY:
+	case GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE:
+	case GL_UNSIGNED_INT_IMAGE_2D_MULTISAMPLE_ARRAY:
+		return true;
+	default:
+		return false;
+	}
+}
+
+//Reads every active uniform of one program and writes it to the same name in another
+static void copyUniformValues(GLuint from, GLuint to)
+{
+	GLint numUniforms = 0;
+	glGetProgramiv(from, GL_ACTIVE_UNIFORMS, &numUniforms);
+	GLint maxNameLength = 0;
+	glGetProgramiv(from, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	//Types in the new program, so uniforms whose declaration changed are left at their defaults
+	std::unordered_map<std::string, GLenum> newTypes;
+	GLint numNewUniforms = 0;
+	glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &numNewUniforms);
+	GLint maxNewNameLength = 0;
+	glGetProgramiv(to, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNewNameLength);
+	std::string nameBuffer(std::max(maxNameLength, maxNewNameLength), '\0');
+	for (GLint i = 0; i < numNewUniforms; i++) {
+		GLsizei length = 0;
+		GLint arraySize = 0;
+		GLenum type;
+		glGetActiveUniform(to, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &arraySize, &type, &nameBuffer[0]);
+		newTypes[std::string(nameBuffer.data(), length)] = type;
+	}
+
+	for (GLint i = 0; i < numUniforms; i++) {
+		GLsizei length = 0;
+		GLint arraySize = 0;
+		GLenum type;
+		glGetActiveUniform(from, (GLuint)i, (GLsizei)nameBuffer.size(), &length, &arraySize, &type, &nameBuffer[0]);
+		std::string name(nameBuffer.data(), length);
+		auto newType = newTypes.find(name);
+		if (newType == newTypes.end() || newType->second != type) {
+			continue;
+		}
+
+		const std::string arraySuffix = "[0]";
+		bool isArray = name.size() > arraySuffix.size() && name.compare(name.size() - arraySuffix.size(), arraySuffix.size(), arraySuffix) == 0;
+		std::string baseName = isArray ? name.substr(0, name.size() - arraySuffix.size()) : name;
+		for (GLint element = 0; element < arraySize; element++) {
+			std::string elementName = isArray ? baseName + "[" + std::to_string(element) + "]" : name;
+			GLint fromLocation = glGetUniformLocation(from, elementName.c_str());
+			GLint toLocation = glGetUniformLocation(to, elementName.c_str());
+			//Block members have no location and live in their buffers anyway
+			if (fromLocation < 0 || toLocation < 0) {
+				continue;
+			}
+
+			GLfloat floats[16];
+			GLdouble doubles[16];
+			GLint ints[4];
+			GLuint uints[4];
+			switch (type) {
+			case GL_FLOAT:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniform1fv(to, toLocation, 1, floats);
+				break;
+			case GL_FLOAT_VEC2:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniform2fv(to, toLocation, 1, floats);
+				break;
+			case GL_FLOAT_VEC3:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniform3fv(to, toLocation, 1, floats);
+				break;
+			case GL_FLOAT_VEC4:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniform4fv(to, toLocation, 1, floats);
+				break;
+			case GL_FLOAT_MAT2:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix2fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_FLOAT_MAT2x3:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix2x3fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_FLOAT_MAT2x4:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix2x4fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_FLOAT_MAT3x2:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix3x2fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_FLOAT_MAT3:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix3fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_FLOAT_MAT3x4:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix3x4fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_FLOAT_MAT4x2:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix4x2fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_FLOAT_MAT4x3:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix4x3fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_FLOAT_MAT4:
+				glGetUniformfv(from, fromLocation, floats);
+				glProgramUniformMatrix4fv(to, toLocation, 1, false, floats);
+				break;
+			case GL_DOUBLE:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniform1dv(to, toLocation, 1, doubles);
+				break;
+			case GL_DOUBLE_VEC2:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniform2dv(to, toLocation, 1, doubles);
+				break;
+			case GL_DOUBLE_VEC3:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniform3dv(to, toLocation, 1, doubles);
+				break;
+			case GL_DOUBLE_VEC4:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniform4dv(to, toLocation, 1, doubles);
+				break;
+			case GL_DOUBLE_MAT2:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix2dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_DOUBLE_MAT2x3:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix2x3dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_DOUBLE_MAT2x4:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix2x4dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_DOUBLE_MAT3x2:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix3x2dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_DOUBLE_MAT3:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix3dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_DOUBLE_MAT3x4:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix3x4dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_DOUBLE_MAT4x2:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix4x2dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_DOUBLE_MAT4x3:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix4x3dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_DOUBLE_MAT4:
+				glGetUniformdv(from, fromLocation, doubles);
+				glProgramUniformMatrix4dv(to, toLocation, 1, false, doubles);
+				break;
+			case GL_INT_VEC2:
+			case GL_BOOL_VEC2:
+				glGetUniformiv(from, fromLocation, ints);
+				glProgramUniform2iv(to, toLocation, 1, ints);
+				break;
+			case GL_INT_VEC3:
+			case GL_BOOL_VEC3:
+				glGetUniformiv(from, fromLocation, ints);
+				glProgramUniform3iv(to, toLocation, 1, ints);
+				break;
+			case GL_INT_VEC4:
+			case GL_BOOL_VEC4:
+				glGetUniformiv(from, fromLocation, ints);
+				glProgramUniform4iv(to, toLocation, 1, ints);
+				break;
+			case GL_UNSIGNED_INT:
+				glGetUniformuiv(from, fromLocation, uints);
+				glProgramUniform1uiv(to, toLocation, 1, uints);
+				break;
+			case GL_UNSIGNED_INT_VEC2:
+				glGetUniformuiv(from, fromLocation, uints);
+				glProgramUniform2uiv(to, toLocation, 1, uints);
+				break;
+			case GL_UNSIGNED_INT_VEC3:
+				glGetUniformuiv(from, fromLocation, uints);
+				glProgramUniform3uiv(to, toLocation, 1, uints);
+				break;
+			case GL_UNSIGNED_INT_VEC4:
+				glGetUniformuiv(from, fromLocation, uints);
+				glProgramUniform4uiv(to, toLocation, 1, uints);
+				break;
+			default:
+				//Anything else, eg. atomic counters, is left at its default rather than written as the wrong type
+				if (isSingleIntType(type)) {
+					glGetUniformiv(from, fromLocation, ints);
+					glProgramUniform1iv(to, toLocation, 1, ints);
+				}
+				break;
+			}
+		}
+	}
+}
+
+void Shader::selectVariant(uint32_t featureMask)
 {
-	std::string vertexShaderString = readFile(vertexShaderPath);
-	GLuint vertexShader = compileShader(vertexShaderString.c_str(), GL_VERTEX_SHADER);
+	if (!m_pendingBuilds.empty()) {
+		finishBuilds(false);
+	}
+	m_requestedMask = featureMask;
+	if (featureMask == m_currentMask) {
+		return;
+	}
+	if (m_variants.find(featureMask) != m_variants.end()) {
+		makeCurrent(featureMask);
+		return;
+	}
+	prepareVariant(featureMask);
+	finishBuilds(false);
+}
 
-	std::string fragmentShaderString = readFile(fragmentShaderPath);
-	GLuint fragmentShader = compileShader(fragmentShaderString.c_str(), GL_FRAGMENT_SHADER);
+void Shader::prepareVariant(uint32_t featureMask)
+{
+	if (m_variants.find(featureMask) != m_variants.end()) {
+		return;
+	}
+	for (const PendingBuild& build : m_pendingBuilds) {
+		if (build.featureMask == featureMask) {
+			return;
+		}
+	}
+	startBuild(featureMask);
+}
+
+void Shader::makeCurrent(uint32_t featureMask)
+{
+	m_current = &m_variants[featureMask];
+	m_currentMask = featureMask;
+	m_id = m_current->program;
+}
+
+//Inserts the enabled features as #defines right after the #version line
+std::string Shader::addDefines(const std::string& source, uint32_t featureMask)
+{
+	if (featureMask == 0) {
+		return source;
+	}
+	std::string defines;
+	for (size_t i = 0; i < m_features.size(); i++) {
+		if (featureMask & (1u << i)) {
+			defines += "#define " + m_features[i] + "\n";
+		}
+	}
+
+	size_t versionLine = source.find("#version");
+	if (versionLine == std::string::npos) {
+		return defines + "#line 1\n" + source;
+	}
+	size_t insertAt = source.find('\n', versionLine);
+	if (insertAt == std::string::npos) {
+		return source + "\n" + defines;
+	}
+	//#line keeps compile errors pointing at the right line of the file
+	return source.substr(0, insertAt + 1) + defines + "#line 2\n" + source.substr(insertAt + 1);
+}
+
+//Starts compiling and linking a variant. Returns true if it was loaded from the binary cache instead.
+bool Shader::startBuild(uint32_t featureMask)
+{
+	EW_TRACE_SCOPE_DETAIL("Compile shader", "asset", getName());
+	std::vector<std::string> sources;
+	for (const Stage& stage : m_stages) {
+		sources.push_back(addDefines(stage.source, featureMask));
+	}
 
 	//Create an empty shader program
-	m_id = glCreateProgram();
+	PendingBuild build = { featureMask, glCreateProgram(), {}, getBinaryCachePath(sources) };
+	if (!build.cachePath.empty() && loadProgramBinary(build.program, build.cachePath)) {
+		//Already linked, nothing to compile or save
+		build.cachePath.clear();
+		m_pendingBuilds.push_back(build);
+		return true;
+	}
+
+	//Create and attach our shader objects
+	for (size_t i = 0; i < m_stages.size(); i++) {
+		build.shaders.push_back(createShader(sources[i].c_str(), m_stages[i].type));
+		glAttachShader(build.program, build.shaders.back());
+	}
 
-	//Attach our shader objects
-	glAttachShader(m_id, vertexShader);
-	glAttachShader(m_id, fragmentShader);
+	//Ask the driver to keep the binary around so it can be cached
+	glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 
 	//Link program - will create an executable program with the attached shaders
-	glLinkProgram(m_id);
+	glLinkProgram(build.program);
+	m_pendingBuilds.push_back(build);
+	return false;
+}
+
+//Finishes every pending build the driver is done with, or all of them if wait is set.
+//Returns true if the current program changed.
+bool Shader::finishBuilds(bool wait)
+{
+	bool currentChanged = false;
+	for (size_t i = 0; i < m_pendingBuilds.size();) {
+		PendingBuild& build = m_pendingBuilds[i];
+		if (!wait && !build.shaders.empty() && GLEW_ARB_parallel_shader_compile) {
+			GLint completed = GL_FALSE;
+			glGetProgramiv(build.program, GL_COMPLETION_STATUS_ARB, &completed);
+			if (!completed) {
+				i++;
+				continue;
+			}
+		}
+		PendingBuild finished = build;
+		m_pendingBuilds.erase(m_pendingBuilds.begin() + i);
+		currentChanged = finishBuild(finished) || currentChanged;
+	}
+	return currentChanged;
+}
+
+bool Shader::finishBuild(PendingBuild& build)
+{
+	EW_TRACE_SCOPE_DETAIL("Link shader", "asset", getName());
+	bool linked = true;
+	if (!build.shaders.empty()) {
+		bool compiled = true;
+		for (size_t i = 0; i < build.shaders.size(); i++) {
+			compiled = checkCompileStatus(build.shaders[i], m_stages[i].type) && compiled;
+		}
 
-	//Logging
-	int success;
-	glGetProgramiv(m_id, GL_LINK_STATUS, &success);
+		//Logging
+		GLint success;
+		glGetProgramiv(build.program, GL_LINK_STATUS, &success);
+		linked = success;
+		if (compiled && !linked) {
+			GLchar infoLog[512];
+			glGetProgramInfoLog(build.program, 512, NULL, infoLog);
+			printf("Failed to link shader program: %s", infoLog);
+		}
+
+		for (GLuint shader : build.shaders) {
+			glDetachShader(build.program, shader);
+			glDeleteShader(shader);
+		}
+		build.shaders.clear();
+	}
+
+	auto existing = m_variants.find(build.featureMask);
+	bool isReload = existing != m_variants.end();
+	//A broken edit keeps the last working program running
+	if (!linked && isReload) {
+		printf("Keeping previous %s\n", getName().c_str());
+		ew::GLState::get().forgetProgram(build.program);
+		glDeleteProgram(build.program);
+		return false;
+	}
+	if (linked && !build.cachePath.empty()) {
+		saveProgramBinary(build.program, build.cachePath);
+	}
+
+	//Start from the uniform values of the program being replaced, or of whichever variant is current
+	GLuint previousProgram = isReload ? existing->second.program : (m_current ? m_current->program : 0);
+	if (previousProgram != 0) {
+		copyUniformValues(previousProgram, build.program);
+	}
+
+	Variant& variant = m_variants[build.featureMask];
+	if (variant.program != 0) {
+		ew::GLState::get().forgetProgram(variant.program);
+		glDeleteProgram(variant.program);
+		printf("Reloaded %s\n", getName().c_str());
+	}
+	variant.program = build.program;
+	variant.linked = linked;
+	cacheUniformLocations(variant);
+
+	if (m_current == &variant || m_current == nullptr || build.featureMask == m_requestedMask) {
+		makeCurrent(build.featureMask);
+		return true;
+	}
+	return false;
+}
+
+//Cache files are named by a hash of the exact sources handed to the compiler plus the driver identity,
+//so editing a shader or updating the driver simply misses the cache. Returns "" if caching isn't possible.
+std::string Shader::getName()const
+{
+	std::string name;
+	for (const Stage& stage : m_stages) {
+		name += name.empty() ? stage.path : " + " + stage.path;
+	}
+	return name;
+}
+
+std::string Shader::getBinaryCachePath(const std::vector<std::string>& sources)
+{
+	if (s_binaryCacheDirectory.empty()) {
+		return "";
+	}
+	GLint numFormats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+	if (numFormats <= 0) {
+		return "";
+	}
+
+	//64 bit FNV-1a
+	uint64_t key = 14695981039346656037ull;
+	auto hashString = [&key](const char* str) {
+		if (str == NULL) {
+			str = "";
+		}
+		//The terminator is hashed too, so "ab"+"c" and "a"+"bc" differ
+		do {
+			key ^= (uint8_t)*str;
+			key *= 1099511628211ull;
+		} while (*str++ != '\0');
+	};
+	for (const std::string& source : sources) {
+		hashString(source.c_str());
+	}
+	hashString((const char*)glGetString(GL_VENDOR));
+	hashString((const char*)glGetString(GL_RENDERER));
+	hashString((const char*)glGetString(GL_VERSION));
+
+	char fileName[32];
+	snprintf(fileName, sizeof(fileName), "%016llx.bin", (unsigned long long)key);
+	return s_binaryCacheDirectory + "/" + fileName;
+}
+
+bool Shader::loadProgramBinary(GLuint program, const std::string& cachePath)
+{
+	std::ifstream file(cachePath, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	ProgramBinaryHeader header;
+	if (!file.read((char*)&header, sizeof(header)) || header.magic != PROGRAM_BINARY_MAGIC || header.length <= 0) {
+		return false;
+	}
+	std::vector<char> binary(header.length);
+	if (!file.read(binary.data(), header.length)) {
+		return false;
+	}
+
+	//The driver may still reject a binary it wrote itself, e.g. after a driver update with the same version string
+	glProgramBinary(program, header.format, binary.data(), header.length);
+	GLint success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (!success) {
+		printf("Cached program %s was rejected, recompiling\n", cachePath.c_str());
+	}
+	return success;
+}
 
-		GLchar infoLog[512];
-		glGetProgramInfoLog(m_id, 512, NULL, infoLog);
-		printf("Failed to link shader program: %s", infoLog);
+void Shader::saveProgramBinary(GLuint program, const std::string& cachePath)
+{
+	GLint success;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (!success || length <= 0) {
+		return;
 	}
 
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragmentShader);
+	ProgramBinaryHeader header = { PROGRAM_BINARY_MAGIC, 0, 0 };
+	std::vector<char> binary(length);
+	glGetProgramBinary(program, length, &header.length, &header.format, binary.data());
+
+	std::error_code error;
+	std::filesystem::create_directories(s_binaryCacheDirectory, error);
+	std::ofstream file(cachePath, std::ios::binary);
+	if (!file.is_open()) {
+		printf("Failed to write program binary %s\n", cachePath.c_str());
+		return;
+	}
+	file.write((const char*)&header, sizeof(header));
+	file.write(binary.data(), header.length);
 }
 
 void Shader::use()
 {
-	glUseProgram(m_id);
+	ew::GLState::get().useProgram(m_id);
+}
+
+UniformHandle Shader::getUniform(std::string_view name) const
+{
+	return getUniform(hashUniformName(name));
+}
+
+UniformHandle Shader::getUniform(uint32_t nameHash) const
+{
+	auto it = m_uniformSlots.find(nameHash);
+	if (it == m_uniformSlots.end()) {
+		return UniformHandle{};
+	}
+	return UniformHandle{ it->second };
+}
+
+void Shader::setFloat(std::string_view name, float value)
+{
+	setFloat(getUniform(name), value);
 }
 
-void Shader::setFloat(std::string name, float value)
+void Shader::setInt(std::string_view name, int value)
 {
-	glProgramUniform1f(m_id, glGetUniformLocation(m_id, name.c_str()), value);
+	setInt(getUniform(name), value);
 }
 
-void Shader::setInt(std::string name, int value)
+void Shader::setMat3(std::string_view name, const glm::mat3& value) {
+	setMat3(getUniform(name), value);
+}
+
+void Shader::setMat4(std::string_view name, const glm::mat4& value) {
+	setMat4(getUniform(name), value);
+}
+
+void Shader::setVec3(std::string_view name, const glm::vec3& value)
 {
-	glProgramUniform1i(m_id, glGetUniformLocation(m_id, name.c_str()), value);
+	setVec3(getUniform(name), value);
 }
 
-void Shader::setMat4(std::string name, const glm::mat4& value) { 
-	glProgramUniformMatrix4fv(m_id, glGetUniformLocation(m_id, name.c_str()), 1, false, glm::value_ptr(value));
+void Shader::setVec2(std::string_view name, const glm::vec2& value)
+{
+	setVec2(getUniform(name), value);
 }
 
-void Shader::setVec3(std::string name, const glm::vec3& value)
+void Shader::setUint(std::string_view name, GLuint value)
 {
-	glProgramUniform3f(m_id, glGetUniformLocation(m_id, name.c_str()), value.x, value.y, value.z);
+	setUint(getUniform(name), value);
 }
 
-void Shader::setVec2(std::string name, const glm::vec2& value)
+void Shader::setVec4Array(std::string_view name, const glm::vec4* values, int count)
 {
-	glProgramUniform2f(m_id, glGetUniformLocation(m_id, name.c_str()), value.x, value.y);
+	setVec4Array(getUniform(name), values, count);
 }
 
+void Shader::setFloat(UniformHandle uniform, float value)
+{
+	glProgramUniform1f(m_id, getLocation(uniform), value);
+}
+
+void Shader::setInt(UniformHandle uniform, int value)
+{
+	glProgramUniform1i(m_id, getLocation(uniform), value);
+}
+
+void Shader::setMat3(UniformHandle uniform, const glm::mat3& value) {
+	glProgramUniformMatrix3fv(m_id, getLocation(uniform), 1, false, glm::value_ptr(value));
+}
+
+void Shader::setMat4(UniformHandle uniform, const glm::mat4& value) {
+	glProgramUniformMatrix4fv(m_id, getLocation(uniform), 1, false, glm::value_ptr(value));
+}
+
+void Shader::setVec3(UniformHandle uniform, const glm::vec3& value)
+{
+	glProgramUniform3f(m_id, getLocation(uniform), value.x, value.y, value.z);
+}
+
+void Shader::setVec2(UniformHandle uniform, const glm::vec2& value)
+{
+	glProgramUniform2f(m_id, getLocation(uniform), value.x, value.y);
+}
+
+void Shader::setUint(UniformHandle uniform, GLuint value)
+{
+	glProgramUniform1ui(m_id, getLocation(uniform), value);
+}
+
+//uniform should be the array's bare name or its first element
+void Shader::setVec4Array(UniformHandle uniform, const glm::vec4* values, int count)
+{
+	glProgramUniform4fv(m_id, getLocation(uniform), count, glm::value_ptr(values[0]));
+}
+
+//Builds the name -> location table once so setters never have to ask the driver.
+//Slots are shared by every variant and survive hot reloads, so each program only re-points them at its own locations.
+void Shader::cacheUniformLocations(Variant& variant)
+{
+	std::vector<GLint>& slotLocations = variant.slotLocations;
+	slotLocations.assign(m_uniformSlots.size(), -1);
+	std::vector<bool> assigned(slotLocations.size(), false);
+
+	GLint numUniforms = 0;
+	glGetProgramiv(variant.program, GL_ACTIVE_UNIFORMS, &numUniforms);
+	GLint maxNameLength = 0;
+	glGetProgramiv(variant.program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	auto addUniform = [this, &slotLocations, &assigned](std::string_view name, GLint location) {
+		auto result = m_uniformSlots.emplace(hashUniformName(name), (int)m_uniformSlots.size());
+		int slot = result.first->second;
+		if (result.second) {
+			slotLocations.push_back(-1);
+			assigned.push_back(false);
+		}
+		else if (assigned[slot] && slotLocations[slot] != location) {
+			printf("Uniform name hash collision on %.*s\n", (int)name.size(), name.data());
+		}
+		slotLocations[slot] = location;
+		assigned[slot] = true;
+	};
+
+	std::string nameBuffer(maxNameLength, '\0');
+	for (GLint i = 0; i < numUniforms; i++) {
+		GLsizei length = 0;
+		GLint arraySize = 0;
+		GLenum type;
+		glGetActiveUniform(variant.program, (GLuint)i, maxNameLength, &length, &arraySize, &type, &nameBuffer[0]);
+		std::string_view name(nameBuffer.data(), length);
+
+		//Members of uniform blocks have no location
+		GLint location = glGetUniformLocation(variant.program, nameBuffer.c_str());
+		if (location < 0) {
+			continue;
+		}
+		addUniform(name, location);
+
+		//Arrays of basic types are reported once as "name[0]". Register the bare name and every element.
+		const std::string_view arraySuffix = "[0]";
+		if (name.size() > arraySuffix.size() && name.substr(name.size() - arraySuffix.size()) == arraySuffix) {
+			std::string baseName(name.substr(0, name.size() - arraySuffix.size()));
+			addUniform(baseName, location);
+			for (GLint element = 1; element < arraySize; element++) {
+				std::string elementName = baseName + "[" + std::to_string(element) + "]";
+				addUniform(elementName, glGetUniformLocation(variant.program, elementName.c_str()));
+			}
+		}
+	}
+}
 
 std::string Shader::readFile(const std::string& filePath)
 {
@@ -85,23 +845,76 @@ std::string Shader::readFile(const std::string& filePath)
 	return stringStream.str();
 }
 
-GLuint Shader::compileShader(const char* shaderSource, GLenum shaderType)
+//Starts compiling without waiting on the result
+GLuint Shader::createShader(const char* shaderSource, GLenum shaderType)
 {
 	GLuint shader = glCreateShader(shaderType);
 	//Provides the source code to the object.
 	glShaderSource(shader, 1, &shaderSource, NULL);
 	//Compiles the shader source
 	glCompileShader(shader);
+	return shader;
+}
 
+bool Shader::checkCompileStatus(GLuint shader, GLenum shaderType)
+{
 	//Get result of last compile - either GL_TRUE or GL_FALSE
 	GLint success;
 	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 	if (!success) {
-		const char* shaderName = shaderType == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT";
+		const char* shaderName = shaderType == GL_VERTEX_SHADER ? "VERTEX" : shaderType == GL_FRAGMENT_SHADER ? "FRAGMENT" : "COMPUTE";
 		//Dump logs into a char array - 512 is an arbitrary length
 		GLchar infoLog[512];
 		glGetShaderInfoLog(shader, 512, NULL, infoLog);
 		printf("Failed to compile %s shader: %s", shaderName, infoLog);
 	}
-	return shader;
+	return success;
+}
+
+void Shader::setHotReload(bool enabled)
+{
+	m_hotReload = enabled;
+	if (enabled && !m_stages.empty() && m_stages[0].watchId < 0) {
+		for (Stage& stage : m_stages) {
+			stage.watchId = ew::FileWatcher::get().watch(stage.path);
+		}
+
+		//Let the driver compile on its own threads so reloads don't hitch the frame
+		if (GLEW_ARB_parallel_shader_compile) {
+			glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+		}
+	}
+}
+
+bool Shader::reloadIfChanged()
+{
+	if (!m_hotReload) {
+		return false;
+	}
+	//Consume every flag so a save touching several files only rebuilds once
+	bool changed = false;
+	for (Stage& stage : m_stages) {
+		changed = ew::FileWatcher::get().consumeChange(stage.watchId) || changed;
+	}
+	if (changed) {
+		for (Stage& stage : m_stages) {
+			stage.source = readFile(stage.path);
+		}
+
+		//Only the current variant is rebuilt now, the others are dropped and recompiled when next selected
+		for (auto it = m_variants.begin(); it != m_variants.end();) {
+			if (&it->second == m_current) {
+				++it;
+				continue;
+			}
+			ew::GLState::get().forgetProgram(it->second.program);
+			glDeleteProgram(it->second.program);
+			it = m_variants.erase(it);
+		}
+		startBuild(m_currentMask);
+	}
+	if (m_pendingBuilds.empty()) {
+		return false;
+	}
+	return finishBuilds(false);
 }
@@ -0,0 +1,262 @@
+//Author: Eric Winebrenner
+
+#include "TextureLoader.h"
+#include "GLState.h"
+#include "Trace.h"
+#include "stb_image.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <filesystem>
+
+namespace ew {
+	static GLenum formatFromComponents(int numComponents) {
+		switch (numComponents) {
+		case 1:
+			return GL_RED;
+		case 2:
+			return GL_RG;
+		case 4:
+			return GL_RGBA;
+		default:
+			return GL_RGB;
+		}
+	}
+
+	static GLenum glFormatFromBlockFormat(BlockFormat format) {
+		switch (format) {
+		case BlockFormat::BC3:
+			return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+		case BlockFormat::BC5:
+			return GL_COMPRESSED_RG_RGTC2;
+		default:
+			return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+		}
+	}
+
+	//"Resources/Bamboo/Color.jpg" -> "Resources/Bamboo/Color.dds"
+	static std::string cookedPath(const std::string& filePath) {
+		size_t dot = filePath.find_last_of('.');
+		size_t slash = filePath.find_last_of("/\\");
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+			return filePath + ".dds";
+		}
+		return filePath.substr(0, dot) + ".dds";
+	}
+
+	//A .dds older than its source was cooked from a previous version of the image
+	static bool isCookedUpToDate(const std::string& cookedFilePath, const std::string& filePath) {
+		std::error_code error;
+		std::filesystem::file_time_type cookedTime = std::filesystem::last_write_time(cookedFilePath, error);
+		if (error) {
+			return false;
+		}
+		std::filesystem::file_time_type sourceTime = std::filesystem::last_write_time(filePath, error);
+		//Only the cooked file was shipped
+		if (error) {
+			return true;
+		}
+		if (cookedTime < sourceTime) {
+			printf("%s is older than %s, loading the source image instead. Re-run the cooker to update it.\n", cookedFilePath.c_str(), filePath.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	TextureLoader::TextureLoader(int numThreads)
+	{
+		if (numThreads <= 0) {
+			numThreads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+		}
+		for (int i = 0; i < numThreads; i++) {
+			mWorkers.emplace_back(&TextureLoader::workerLoop, this);
+		}
+		glGenBuffers(1, &mPBO);
+	}
+
+	TextureLoader::~TextureLoader()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mStopping = true;
+		}
+		mJobReady.notify_all();
+		for (std::thread& worker : mWorkers) {
+			worker.join();
+		}
+		for (DecodedImage& image : mDecoded) {
+			stbi_image_free(image.pixels);
+		}
+		glDeleteBuffers(1, &mPBO);
+	}
+
+	GLuint TextureLoader::load(const std::string& filePath, const TextureSettings& settings)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		GLState::get().bindTexture(GL_TEXTURE_2D, texture);
+
+		unsigned char placeholder[4];
+		for (int i = 0; i < 4; i++) {
+			placeholder[i] = (unsigned char)(glm::clamp(settings.placeholderColor[i], 0.0f, 1.0f) * 255.0f);
+		}
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, settings.wrapMode);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, settings.wrapMode);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, settings.magFilter);
+		//No mips yet, so sample the placeholder without them
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mJobs.push_back({ texture, filePath, settings });
+		}
+		mJobReady.notify_one();
+		mNumPending++;
+		return texture;
+	}
+
+	int TextureLoader::update(int maxUploads)
+	{
+		int numUploaded = 0;
+		while (numUploaded < maxUploads) {
+			DecodedImage image;
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				if (mDecoded.empty()) {
+					break;
+				}
+				image = std::move(mDecoded.front());
+				mDecoded.pop_front();
+			}
+			EW_TRACE_SCOPE_DETAIL("Upload texture", "asset", image.job.filePath);
+			if (image.compressed) {
+				uploadCompressed(image);
+			}
+			else {
+				upload(image);
+				stbi_image_free(image.pixels);
+			}
+			mNumPending--;
+			numUploaded++;
+		}
+		return numUploaded;
+	}
+
+	void TextureLoader::finish()
+	{
+		while (mNumPending > 0) {
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mImageReady.wait(lock, [this] { return !mDecoded.empty(); });
+			}
+			update(mNumPending);
+		}
+	}
+
+	void TextureLoader::workerLoop()
+	{
+		TraceRecorder::get().setThreadName("Texture decode");
+		while (true) {
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mMutex);
+				mJobReady.wait(lock, [this] { return mStopping || !mJobs.empty(); });
+				if (mStopping) {
+					return;
+				}
+				job = std::move(mJobs.front());
+				mJobs.pop_front();
+			}
+
+			EW_TRACE_SCOPE_DETAIL("Decode texture", "asset", job.filePath);
+			DecodedImage image;
+			std::string cookedFilePath = cookedPath(job.filePath);
+			image.compressed = isCookedUpToDate(cookedFilePath, job.filePath) && readDDS(cookedFilePath, image.dds);
+			if (!image.compressed) {
+				image.pixels = stbi_load(job.filePath.c_str(), &image.width, &image.height, &image.numComponents, 0);
+				if (image.pixels == NULL) {
+					printf("Failed to load texture %s: %s\n", job.filePath.c_str(), stbi_failure_reason());
+				}
+			}
+			image.job = std::move(job);
+
+			{
+				std::lock_guard<std::mutex> lock(mMutex);
+				mDecoded.push_back(std::move(image));
+			}
+			mImageReady.notify_one();
+		}
+	}
+
+	void TextureLoader::upload(const DecodedImage& image)
+	{
+		//Failed decodes keep their placeholder
+		if (image.pixels == NULL) {
+			return;
+		}
+		GLsizeiptr size = (GLsizeiptr)image.width * image.height * image.numComponents;
+		if (!fillPixelBuffer(image.pixels, size)) {
+			printf("Failed to map pixel buffer for %s\n", image.job.filePath.c_str());
+			return;
+		}
+
+		//Don't disturb whatever the caller has bound on the active unit
+		GLuint previousTexture = GLState::get().getTexture(GL_TEXTURE_2D);
+		GLState::get().bindTexture(GL_TEXTURE_2D, image.job.texture);
+
+		GLenum format = formatFromComponents(image.numComponents);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		//With a PBO bound the data pointer is an offset into it
+		glTexImage2D(GL_TEXTURE_2D, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, (void*)0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.job.settings.minFilter);
+
+		GLState::get().bindTexture(GL_TEXTURE_2D, previousTexture);
+	}
+
+	//Copy into a fresh PBO allocation so the driver can DMA from it while we keep going.
+	//Re-specifying with NULL orphans the previous upload's storage instead of waiting on it.
+	//Leaves the PBO bound to GL_PIXEL_UNPACK_BUFFER on success.
+	bool TextureLoader::fillPixelBuffer(const void* data, GLsizeiptr size)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, mPBO);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+		void* dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+		if (dst == NULL) {
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			return false;
+		}
+		memcpy(dst, data, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		return true;
+	}
+
+	void TextureLoader::uploadCompressed(const DecodedImage& image)
+	{
+		const DDSImage& dds = image.dds;
+		if (!fillPixelBuffer(dds.data.data(), (GLsizeiptr)dds.data.size())) {
+			printf("Failed to map pixel buffer for %s\n", image.job.filePath.c_str());
+			return;
+		}
+
+		GLuint previousTexture = GLState::get().getTexture(GL_TEXTURE_2D);
+		GLState::get().bindTexture(GL_TEXTURE_2D, image.job.texture);
+
+		//Every level was built offline, so there's nothing for glGenerateMipmap to do
+		GLenum format = glFormatFromBlockFormat(dds.format);
+		for (int i = 0; i < (int)dds.mips.size(); i++) {
+			const DDSMip& mip = dds.mips[i];
+			glCompressedTexImage2D(GL_TEXTURE_2D, i, format, mip.width, mip.height, 0, (GLsizei)mip.size, (void*)mip.offset);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)dds.mips.size() - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.job.settings.minFilter);
+
+		GLState::get().bindTexture(GL_TEXTURE_2D, previousTexture);
+	}
+}
@@ -0,0 +1,187 @@
+//Author: Eric Winebrenner
+
+#include "TransformBatch.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define EW_TRANSFORM_BATCH_SSE
+#include <emmintrin.h>
+#endif
+
+namespace ew {
+	int TransformBatch::add(const Transform& transform)
+	{
+		int index = mCount++;
+		size_t paddedSize = (mCount + 3) & ~3;
+		if (mPositionX.size() < paddedSize) {
+			//Padding lanes are identity transforms, which keeps 1/scale finite
+			for (std::vector<float>* array : { &mPositionX, &mPositionY, &mPositionZ, &mRotationX, &mRotationY, &mRotationZ }) {
+				array->resize(paddedSize, 0.0f);
+			}
+			for (std::vector<float>* array : { &mScaleX, &mScaleY, &mScaleZ }) {
+				array->resize(paddedSize, 1.0f);
+			}
+			mModelMatrices.resize(paddedSize, glm::mat4(1));
+			mNormalMatrices.resize(paddedSize, glm::mat3(1));
+		}
+		set(index, transform);
+		return index;
+	}
+
+	void TransformBatch::set(int index, const Transform& transform)
+	{
+		mPositionX[index] = transform.position.x;
+		mPositionY[index] = transform.position.y;
+		mPositionZ[index] = transform.position.z;
+		mRotationX[index] = transform.rotation.x;
+		mRotationY[index] = transform.rotation.y;
+		mRotationZ[index] = transform.rotation.z;
+		mScaleX[index] = transform.scale.x;
+		mScaleY[index] = transform.scale.y;
+		mScaleZ[index] = transform.scale.z;
+	}
+
+	Transform TransformBatch::get(int index) const
+	{
+		Transform transform;
+		transform.position = glm::vec3(mPositionX[index], mPositionY[index], mPositionZ[index]);
+		transform.rotation = glm::vec3(mRotationX[index], mRotationY[index], mRotationZ[index]);
+		transform.scale = glm::vec3(mScaleX[index], mScaleY[index], mScaleZ[index]);
+		return transform;
+	}
+
+	void TransformBatch::clear()
+	{
+		mCount = 0;
+		for (std::vector<float>* array : { &mPositionX, &mPositionY, &mPositionZ, &mRotationX, &mRotationY, &mRotationZ, &mScaleX, &mScaleY, &mScaleZ }) {
+			array->clear();
+		}
+		mModelMatrices.clear();
+		mNormalMatrices.clear();
+	}
+
+	//R = rotateX * rotateY * rotateZ from ewMath.h, multiplied out. Note ewMath's rotateY turns the opposite way to rotateX/Z.
+	//  column 0 = ( cy*cz,  cx*sz - sx*sy*cz,  sx*sz + cx*sy*cz)
+	//  column 1 = (-cy*sz,  cx*cz + sx*sy*sz,  sx*cz - cx*sy*sz)
+	//  column 2 = (-sy,    -sx*cy,             cx*cy)
+	//The model matrix is R with column j scaled by scale[j] plus the translation, the normal matrix is R with column j divided by it.
+
+#ifdef EW_TRANSFORM_BATCH_SSE
+	//sin and cos of 4 angles at once. Reduces by multiples of pi/2 (Cody-Waite, exact for |x| up to a few thousand radians),
+	//then evaluates minimax polynomials on [-pi/4, pi/4] and picks/negates them by quadrant. Max error is a couple of ulp.
+	static inline void sinCos4(__m128 x, __m128& sinOut, __m128& cosOut)
+	{
+		//cvtps rounds to nearest, so r lands in [-pi/4, pi/4]
+		__m128i quadrant = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(0.636619772367581f)));
+		__m128 j = _mm_cvtepi32_ps(quadrant);
+		__m128 r = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(1.5703125f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(4.837512969970703125e-4f)));
+		r = _mm_sub_ps(r, _mm_mul_ps(j, _mm_set1_ps(7.54978995489188216e-8f)));
+		__m128 r2 = _mm_mul_ps(r, r);
+
+		__m128 sinPoly = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(-1.9515295891e-4f)), _mm_set1_ps(8.3321608736e-3f));
+		sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, r2), _mm_set1_ps(-1.6666654611e-1f));
+		sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, r2), r), r);
+
+		__m128 cosPoly = _mm_add_ps(_mm_mul_ps(r2, _mm_set1_ps(2.443315711809948e-5f)), _mm_set1_ps(-1.388731625493765e-3f));
+		cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, r2), _mm_set1_ps(4.166664568298827e-2f));
+		cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, r2), r2);
+		cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(r2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+		//Odd quadrants swap sin and cos. sin is negative in quadrants 2 and 3, cos in 1 and 2.
+		__m128i one = _mm_set1_epi32(1);
+		__m128i two = _mm_set1_epi32(2);
+		__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+		__m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, two), 30));
+		__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, one), two), 30));
+		sinOut = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly)), sinSign);
+		cosOut = _mm_xor_ps(_mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly)), cosSign);
+	}
+
+	void TransformBatch::update()
+	{
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 one = _mm_set1_ps(1.0f);
+		for (int i = 0; i < mCount; i += 4) {
+			__m128 sx, cx, sy, cy, sz, cz;
+			sinCos4(_mm_loadu_ps(&mRotationX[i]), sx, cx);
+			sinCos4(_mm_loadu_ps(&mRotationY[i]), sy, cy);
+			sinCos4(_mm_loadu_ps(&mRotationZ[i]), sz, cz);
+
+			__m128 sxsy = _mm_mul_ps(sx, sy);
+			__m128 cxsy = _mm_mul_ps(cx, sy);
+			__m128 r[9] = {
+				_mm_mul_ps(cy, cz),
+				_mm_sub_ps(_mm_mul_ps(cx, sz), _mm_mul_ps(sxsy, cz)),
+				_mm_add_ps(_mm_mul_ps(sx, sz), _mm_mul_ps(cxsy, cz)),
+				_mm_sub_ps(zero, _mm_mul_ps(cy, sz)),
+				_mm_add_ps(_mm_mul_ps(cx, cz), _mm_mul_ps(sxsy, sz)),
+				_mm_sub_ps(_mm_mul_ps(sx, cz), _mm_mul_ps(cxsy, sz)),
+				_mm_sub_ps(zero, sy),
+				_mm_sub_ps(zero, _mm_mul_ps(sx, cy)),
+				_mm_mul_ps(cx, cy)
+			};
+
+			__m128 scale[3] = { _mm_loadu_ps(&mScaleX[i]), _mm_loadu_ps(&mScaleY[i]), _mm_loadu_ps(&mScaleZ[i]) };
+			__m128 columns[4][4];
+			for (int c = 0; c < 3; c++) {
+				columns[c][0] = _mm_mul_ps(r[c * 3 + 0], scale[c]);
+				columns[c][1] = _mm_mul_ps(r[c * 3 + 1], scale[c]);
+				columns[c][2] = _mm_mul_ps(r[c * 3 + 2], scale[c]);
+				columns[c][3] = zero;
+			}
+			columns[3][0] = _mm_loadu_ps(&mPositionX[i]);
+			columns[3][1] = _mm_loadu_ps(&mPositionY[i]);
+			columns[3][2] = _mm_loadu_ps(&mPositionZ[i]);
+			columns[3][3] = one;
+
+			//Each column is held as x/y/z/w across 4 transforms. Transposing gives one transform's column per register.
+			for (int c = 0; c < 4; c++) {
+				_MM_TRANSPOSE4_PS(columns[c][0], columns[c][1], columns[c][2], columns[c][3]);
+				for (int lane = 0; lane < 4; lane++) {
+					_mm_storeu_ps(&mModelMatrices[i + lane][c][0], columns[c][lane]);
+				}
+			}
+
+			//Normal matrices are 9 floats, so they go through a small buffer rather than a transpose
+			alignas(16) float normal[9][4];
+			for (int c = 0; c < 3; c++) {
+				__m128 inverseScale = _mm_div_ps(one, scale[c]);
+				_mm_store_ps(normal[c * 3 + 0], _mm_mul_ps(r[c * 3 + 0], inverseScale));
+				_mm_store_ps(normal[c * 3 + 1], _mm_mul_ps(r[c * 3 + 1], inverseScale));
+				_mm_store_ps(normal[c * 3 + 2], _mm_mul_ps(r[c * 3 + 2], inverseScale));
+			}
+			for (int lane = 0; lane < 4; lane++) {
+				float* out = &mNormalMatrices[i + lane][0][0];
+				for (int e = 0; e < 9; e++) {
+					out[e] = normal[e][lane];
+				}
+			}
+		}
+	}
+#else
+	void TransformBatch::update()
+	{
+		for (int i = 0; i < mCount; i++) {
+			computeTransformMatrices(get(i), mModelMatrices[i], mNormalMatrices[i]);
+		}
+	}
+#endif
+
+	void computeTransformMatrices(const Transform& transform, glm::mat4& modelMatrix, glm::mat3& normalMatrix)
+	{
+		float sx = sinf(transform.rotation.x), cx = cosf(transform.rotation.x);
+		float sy = sinf(transform.rotation.y), cy = cosf(transform.rotation.y);
+		float sz = sinf(transform.rotation.z), cz = cosf(transform.rotation.z);
+		glm::mat3 r(
+			cy * cz, cx * sz - sx * sy * cz, sx * sz + cx * sy * cz,
+			-cy * sz, cx * cz + sx * sy * sz, sx * cz - cx * sy * sz,
+			-sy, -sx * cy, cx * cy);
+		for (int c = 0; c < 3; c++) {
+			modelMatrix[c] = glm::vec4(r[c] * transform.scale[c], 0.0f);
+			normalMatrix[c] = r[c] / transform.scale[c];
+		}
+		modelMatrix[3] = glm::vec4(transform.position, 1.0f);
+	}
+}
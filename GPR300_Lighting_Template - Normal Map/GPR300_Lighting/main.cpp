@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <iostream>
+#include <vector>
 
 #include <time.h>
 
@@ -22,8 +23,23 @@
 #include "EW/EwMath.h"
 #include "EW/Camera.h"
 #include "EW/Mesh.h"
+#include "EW/GeometryPool.h"
 #include "EW/Transform.h"
+#include "EW/TransformBatch.h"
+#include "EW/SceneGraph.h"
+#include "EW/FrustumCuller.h"
+#include "EW/BVH.h"
+#include "EW/HeadlessBenchmark.h"
+#include "EW/Profiler.h"
+#include "EW/Trace.h"
+#include "EW/GLState.h"
+#include "EW/RenderQueue.h"
+#include "EW/HiZCuller.h"
 #include "EW/ShapeGen.h"
+#include "EW/UniformBuffer.h"
+#include "EW/LightBlock.h"
+#include "EW/TextureLoader.h"
+#include "EW/LightClusters.h"
 
 void processInput(GLFWwindow* window);
 void resizeFrameBufferCallback(GLFWwindow* window, int width, int height);
@@ -31,8 +47,9 @@ void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action,
 void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void mousePosCallback(GLFWwindow* window, double xpos, double ypos);
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-GLuint createTexture(const char* filePath);
-GLuint createFBO();
+GLuint createTexture(ew::TextureLoader& loader, const char* filePath, glm::vec4 placeholderColor = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+GLuint createFBO(GLuint* depthTexture);
+void spawnStressLights(std::vector<ew::PtLightData>& lights, int count, float radius);
 
 float lastFrameTime;
 float deltaTime;
@@ -44,6 +61,15 @@ double prevMouseX;
 double prevMouseY;
 bool firstMouseInput = false;
 
+//Cursor position is tracked even while unlocked, for picking
+double mouseX;
+double mouseY;
+bool pickRequested = false;
+
+//--headless renders --frames N frames offscreen along a fixed camera path, then prints timings as JSON
+bool headless = false;
+int headlessFrames = 300;
+
 /* Button to lock / unlock mouse
 * 1 = right, 2 = middle
 * Mouse will start locked. Unlock it to use UI
@@ -103,20 +129,108 @@ float normalIntensity = 1;
 bool scrolling = false;
 float scrollSpeed = 1;
 
+//Bits of the lit shader's feature mask, in the order of the names passed to its constructor
+enum LitFeature {
+	LIT_SCROLLING = 1 << 0,
+	LIT_INVERSE_NORMAL_MATRIX = 1 << 1
+};
+
+//Passes in the order they're drawn, the top field of each draw's sort key
+enum DrawPass {
+	PASS_OPAQUE
+};
+
+enum DrawShader {
+	SHADER_LIT,
+	SHADER_UNLIT
+};
+
+//Texture sets. Bamboo color and normal stay bound to units 0 and 1 the whole time, so every lit draw shares one.
+enum DrawMaterial {
+	MATERIAL_NONE,
+	MATERIAL_BAMBOO
+};
+
+//What a queued draw needs once its turn comes
+struct DrawCommand {
+	ew::Mesh* mesh = nullptr;
+	DrawShader shader = SHADER_LIT;
+	int node = -1;
+	glm::vec3 color = glm::vec3(0);
+};
+
 const char* wrappingModes[] = { "Clamp To Edge", "Clamp To Border", "Repeat", "Mirrored Repeat" };
 static const char* currentWrap = "Clamp To Edge";
 int currentWrapMode = 2;
 
 const GLuint fboLoc = 10;
+const GLuint hiZLoc = 12;
 
 bool postProcessing = false;
+bool occlusionCulling = true;
+//Waits every frame for the depth just drawn instead of culling against the last pyramid that arrived
+bool hiZWaitForDepth = false;
+
+//Stress test for clustered lighting
+int numStressLights = 0;
+float stressLightRadius = 2.0f;
+float stressLightOrbitSpeed = 0.2f;
+
+int main(int argc, char** argv) {
+	ew::TraceRecorder::get().setThreadName("Main");
+	//Uniform setter benchmark, runs in a hidden window once the shaders are built
+	bool benchUniforms = false;
+	//Vertex throughput benchmark of the normal matrix, runs in a hidden window once the meshes are made
+	bool benchNormals = false;
+	//CPU only benchmark, doesn't need a window
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--bench-transforms") {
+			ew::benchmarkTransformBatch({ 1000, 100000, 1000000 });
+			return 0;
+		}
+		if (std::string(argv[i]) == "--bench-scene") {
+			ew::benchmarkSceneGraph();
+			return 0;
+		}
+		if (std::string(argv[i]) == "--bench-bvh") {
+			ew::benchmarkBVH({ 10000, 100000, 1000000 });
+			return 0;
+		}
+		//Recording from the start catches asset loading, F9 or exit writes trace.json
+		if (std::string(argv[i]) == "--trace") {
+			ew::TraceRecorder::get().setEnabled(true);
+		}
+		if (std::string(argv[i]) == "--headless") {
+			headless = true;
+		}
+		if (std::string(argv[i]) == "--frames" && i + 1 < argc) {
+			headlessFrames = atoi(argv[++i]);
+		}
+		if (std::string(argv[i]) == "--bench-uniforms") {
+			benchUniforms = true;
+		}
+		if (std::string(argv[i]) == "--bench-normals") {
+			benchNormals = true;
+		}
+		//For comparing --headless timings with and without Hi-Z, and with it waiting on the GPU
+		if (std::string(argv[i]) == "--no-occlusion") {
+			occlusionCulling = false;
+		}
+		if (std::string(argv[i]) == "--hiz-wait") {
+			hiZWaitForDepth = true;
+		}
+	}
 
-int main() {
 	if (!glfwInit()) {
 		printf("glfw failed to init");
 		return 1;
 	}
 
+	//GLEW loads GL through the platform's own context API, so even headless runs need a window, just never shown.
+	//On machines without a GPU that context comes from Mesa's llvmpipe.
+	if (benchUniforms || benchNormals || headless) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
 	GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Lighting", 0, 0);
 	glfwMakeContextCurrent(window);
 
@@ -124,6 +238,8 @@ int main() {
 		printf("glew failed to init");
 		return 1;
 	}
+	//State changes go through the cache, which drops the ones that change nothing
+	ew::GLState& glState = ew::GLState::get();
 
 	glfwSetFramebufferSizeCallback(window, resizeFrameBufferCallback);
 	glfwSetKeyCallback(window, keyboardCallback);
@@ -144,15 +260,56 @@ int main() {
 	ImGui::StyleColorsDark();
 
 	//Used to draw shapes. This is the shader you will be completing.
-	Shader litShader("shaders/defaultLit.vert", "shaders/defaultLit.frag");
+	//Scrolling is compiled in as a #define rather than branched on per vertex
+	Shader litShader("shaders/defaultLit.vert", "shaders/defaultLit.frag", { "SCROLLING", "INVERSE_NORMAL_MATRIX" });
 
 	//Used to draw light sphere
 	Shader unlitShader("shaders/defaultLit.vert", "shaders/unlit.frag");
 
+	//Uniforms set once per draw are resolved up front
+	UniformHandle litModelUniform = litShader.getUniform("_Model");
+	UniformHandle litNormalMatrixUniform = litShader.getUniform("_NormalMatrix");
+	UniformHandle unlitModelUniform = unlitShader.getUniform("_Model");
+	UniformHandle unlitColorUniform = unlitShader.getUniform("_Color");
+
+	//Light and material blocks are shared by every program that declares them
+	ew::UniformBuffer lightUBO(sizeof(ew::LightBlock), ew::LIGHT_BLOCK_BINDING);
+	ew::UniformBuffer materialUBO(sizeof(ew::MaterialBlock), ew::MATERIAL_BLOCK_BINDING);
+	ew::LightBlock lightBlock;
+	ew::MaterialBlock materialBlock;
+
+	//Point and spot lights are binned into view-space clusters every frame
+	ew::LightClusters lightClusters;
+	std::vector<ew::PtLightData> ptLightData;
+	std::vector<ew::SpLightData> spLightData;
+	std::vector<ew::PtLightData> stressLights;
+	int spawnedStressLights = -1;
+	float spawnedStressRadius = 0.0f;
+
 	//Post Processing Shader
 	Shader postProcShader("postprocessingshaders/postProc.vert", "postprocessingshaders/postProc.frag");
 	Shader noPostProcShader("postprocessingshaders/postProc.vert", "postprocessingshaders/noPostProc.frag");
 
+	//Every program, for startup timing and hot reloading
+	Shader* shaders[] = { &litShader, &unlitShader, &postProcShader, &noPostProcShader };
+
+	//Cold starts compile every program, warm starts load them from the binary cache
+	float totalBuildTime = 0.0f;
+	int numFromCache = 0;
+	for (Shader* shader : shaders) {
+		totalBuildTime += shader->getBuildTime();
+		numFromCache += shader->isFromBinaryCache() ? 1 : 0;
+		//Saving a shader file rebuilds it in place while the app keeps running
+		shader->setHotReload(true);
+	}
+	printf("Built %d shader programs in %.2f ms (%d from binary cache)\n", IM_ARRAYSIZE(shaders), totalBuildTime, numFromCache);
+
+	if (benchUniforms) {
+		ew::benchmarkUniformSetters(litShader, { "_Model", "_View", "_Projection" }, 100000);
+		glfwTerminate();
+		return 0;
+	}
+
 	ew::MeshData cubeMeshData;
 	ew::createCube(1.0f, 1.0f, 1.0f, cubeMeshData);
 	ew::MeshData sphereMeshData;
@@ -165,12 +322,21 @@ int main() {
 	ew::MeshData quadMeshData;
 	ew::createQuad(2.0f, 2.0f, quadMeshData);
 
-	ew::Mesh cubeMesh(&cubeMeshData);
-	ew::Mesh sphereMesh(&sphereMeshData);
-	ew::Mesh planeMesh(&planeMeshData);
-	ew::Mesh cylinderMesh(&cylinderMeshData);
+	//All meshes share one vertex and index buffer, so every draw uses the same VAO
+	ew::GeometryPool geometryPool;
+	//Vertices are only needed until they're uploaded, after that just the bounds are kept
+	ew::Mesh cubeMesh(&cubeMeshData, &geometryPool, true);
+	ew::Mesh sphereMesh(&sphereMeshData, &geometryPool, true);
+	ew::Mesh planeMesh(&planeMeshData, &geometryPool, true);
+	ew::Mesh cylinderMesh(&cylinderMeshData, &geometryPool, true);
+
+	if (benchNormals) {
+		ew::benchmarkNormalMatrix(litShader, LIT_INVERSE_NORMAL_MATRIX, litModelUniform, litNormalMatrixUniform, { &sphereMesh, &cylinderMesh }, 500);
+		glfwTerminate();
+		return 0;
+	}
 
-	ew::Mesh quadMesh(&quadMeshData);
+	ew::Mesh quadMesh(&quadMeshData, &geometryPool, true);
 
 	material.ambientK = 0.25;
 	material.diffuseK = 0.5;
@@ -188,16 +354,16 @@ int main() {
 	//spLight.direction = glm::vec3(-1, -1, 0);
 
 	//Enable back face culling
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	glState.enable(GL_CULL_FACE);
+	glState.cullFace(GL_BACK);
 
 	//Enable blending
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glState.enable(GL_BLEND);
+	glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	//Enable depth testing
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	glState.enable(GL_DEPTH_TEST);
+	glState.depthFunc(GL_LESS);
 
 	//Initialize shape transforms
 	ew::Transform cubeTransform;
@@ -221,114 +387,295 @@ int main() {
 	//lightTransform2.scale = glm::vec3(0.5f);
 	//lightTransform2.position = glm::vec3(-1.0f, 5.0f, -1.0f);
 
-	glActiveTexture(GL_TEXTURE0);
-	GLuint bambooTecture = createTexture("../../Resources/Bamboo/Bamboo001A_4K_Color.jpg");
+	//Objects are scene graph nodes, so only the ones that move get their matrices rebuilt
+	ew::SceneGraph scene;
+	int cubeNode = scene.addNode(cubeTransform);
+	int sphereNode = scene.addNode(sphereTransform);
+	int cylinderNode = scene.addNode(cylinderTransform);
+	int planeNode = scene.addNode(planeTransform);
+	int lightNode1 = scene.addNode(lightTransform1);
+
+	//Objects outside the camera's frustum are skipped when drawing
+	scene.update();
+	ew::FrustumCuller frustumCuller;
+	int cubeObject = frustumCuller.add(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode));
+	int sphereObject = frustumCuller.add(sphereMesh.getBounds(), scene.getWorldMatrix(sphereNode));
+	int cylinderObject = frustumCuller.add(cylinderMesh.getBounds(), scene.getWorldMatrix(cylinderNode));
+	int planeObject = frustumCuller.add(planeMesh.getBounds(), scene.getWorldMatrix(planeNode));
+	int lightObject1 = frustumCuller.add(sphereMesh.getBounds(), scene.getWorldMatrix(lightNode1));
+
+	//Same objects in the same order as the frustum culler, so they share indices
+	ew::BVH sceneBVH;
+	sceneBVH.build({
+		ew::transformBounds(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode)),
+		ew::transformBounds(sphereMesh.getBounds(), scene.getWorldMatrix(sphereNode)),
+		ew::transformBounds(cylinderMesh.getBounds(), scene.getWorldMatrix(cylinderNode)),
+		ew::transformBounds(planeMesh.getBounds(), scene.getWorldMatrix(planeNode)),
+		ew::transformBounds(sphereMesh.getBounds(), scene.getWorldMatrix(lightNode1)),
+	});
+	const char* objectNames[] = { "Cube", "Sphere", "Cylinder", "Plane", "Light" };
+	int pickedObject = -1;
+	float pickedDistance = 0.0f;
+	std::vector<int> litObjects;
+
+	//Decodes on worker threads so the first frame doesn't wait on 4K JPEGs
+	ew::TextureLoader textureLoader;
+
+	glState.activeTexture(GL_TEXTURE0);
+	GLuint bambooTecture = createTexture(textureLoader, "../../Resources/Bamboo/Bamboo001A_4K_Color.jpg");
 	
-	glActiveTexture(GL_TEXTURE1);
-	GLuint bambooNormal = createTexture("../../Resources/Bamboo/Bamboo001A_4K_NormalGL.jpg");
-
-	GLuint fbo = createFBO();
+	glState.activeTexture(GL_TEXTURE1);
+	GLuint bambooNormal = createTexture(textureLoader, "../../Resources/Bamboo/Bamboo001A_4K_NormalGL.jpg", glm::vec4(0.5f, 0.5f, 1.0f, 1.0f));
+
+	GLuint fboDepth;
+	GLuint fbo = createFBO(&fboDepth);
+
+	//Objects hidden behind the rest of the scene are skipped too
+	ew::HiZCuller hiZCuller(hiZLoc);
+	//Objects that passed the occlusion test last frame, drawn before the test this frame
+	std::vector<bool> objectVisible(frustumCuller.getNumObjects(), false);
+	std::vector<bool> objectDrawn(frustumCuller.getNumObjects());
+	int numOccluded = 0;
+
+	//Draws are queued each frame and run in sort key order, nearest first within each program so early-Z rejects more
+	ew::RenderQueue renderQueue;
+	std::vector<DrawCommand> drawCommands;
+
+	//Headless frames are drawn offscreen, a hidden window's own framebuffer may not have any pixels
+	ew::OffscreenTarget offscreenTarget;
+	if (headless) {
+		offscreenTarget.create(SCREEN_WIDTH, SCREEN_HEIGHT);
+	}
+	//Where each frame ends up, 0 for the window
+	GLuint screenFramebuffer = offscreenTarget.getFramebuffer();
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+	ew::Profiler& profiler = ew::Profiler::get();
+	ew::FrameRecorder frameRecorder;
+	if (headless) {
+		frameRecorder.attach(profiler, ew::HEADLESS_WARMUP_FRAMES);
+	}
+	int frameIndex = 0;
 
-	while (!glfwWindowShouldClose(window)) {
+	while (headless ? frameIndex < ew::HEADLESS_WARMUP_FRAMES + headlessFrames : !glfwWindowShouldClose(window)) {
+		profiler.beginFrame();
 
-		processInput(window);
+		if (!headless) {
+			processInput(window);
+		}
 		glClearColor(bgColor.r,bgColor.g,bgColor.b, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		textureLoader.update();
+		for (Shader* shader : shaders) {
+			shader->reloadIfChanged();
+		}
+
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 
-		float time = (float)glfwGetTime();
+		float time = headless ? frameIndex * ew::HEADLESS_TIMESTEP : (float)glfwGetTime();
+		if (headless) {
+			ew::followBenchmarkPath(camera, time);
+		}
 		deltaTime = time - lastFrameTime;
 		lastFrameTime = time;
 
 		//UPDATE
 		cubeTransform.rotation.x += deltaTime;
+		scene.setLocalTransform(cubeNode, cubeTransform);
+		if (lightTransform1.position != scene.getLocalTransform(lightNode1).position) {
+			scene.setLocalTransform(lightNode1, lightTransform1);
+		}
+		scene.update();
+		frustumCuller.setModelMatrix(cubeObject, scene.getWorldMatrix(cubeNode));
+		frustumCuller.setModelMatrix(lightObject1, scene.getWorldMatrix(lightNode1));
+		frustumCuller.cull(camera.getFrustum());
+		sceneBVH.setObjectBounds(cubeObject, ew::transformBounds(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode)));
+		sceneBVH.setObjectBounds(lightObject1, ew::transformBounds(sphereMesh.getBounds(), scene.getWorldMatrix(lightNode1)));
+		sceneBVH.refit();
+		if (pickRequested) {
+			glm::vec2 ndc = glm::vec2(0.0f);
+			if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED) {
+				int windowWidth, windowHeight;
+				glfwGetWindowSize(window, &windowWidth, &windowHeight);
+				ndc = glm::vec2((float)mouseX / windowWidth * 2.0f - 1.0f, 1.0f - (float)mouseY / windowHeight * 2.0f);
+			}
+			pickedObject = sceneBVH.raycast(camera.getPosition(), camera.getRayDirection(ndc), &pickedDistance);
+			pickRequested = false;
+		}
+		//Objects within light 1's reach, which ends at its linear attenuation distance
+		litObjects.clear();
+		sceneBVH.querySphere(lightTransform1.position, ptLight1.linearAtt, litObjects);
+
+		//Occlusion culling draws last frame's visible objects first, the rest wait for a test against their depth
+		for (int object = 0; object < frustumCuller.getNumObjects(); object++) {
+			objectDrawn[object] = frustumCuller.isVisible(object) && (!occlusionCulling || objectVisible[object]);
+		}
 
 		//Bind FBO
+		profiler.beginScope("Scene");
 		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+		glState.viewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
 
 		//Draw
-		litShader.use();
+		litShader.selectVariant(scrolling ? LIT_SCROLLING : 0);
 		litShader.setMat4("_Projection", camera.getProjectionMatrix());
 		litShader.setMat4("_View", camera.getViewMatrix());
 
 		//Set some lighting uniforms
 		 
-		//litShader.setVec3("_DirLight[0].color", dirLight.color);
-		//litShader.setVec3("_DirLight[0].direction", normalize(dirLight.direction));
-		//litShader.setFloat("_DirLight[0].intensity", dirLight.intensity);
-
-		litShader.setVec3("_PtLight[0].position", lightTransform1.position);
-		litShader.setVec3("_PtLight[0].color", ptLight1.color);
-		litShader.setFloat("_PtLight[0].intensity", ptLight1.intensity);
-		litShader.setFloat("_PtLight[0].linearAtt", ptLight1.linearAtt);
-
-		//litShader.setVec3("_PtLight[1].position", lightTransform2.position);
-		//litShader.setVec3("_PtLight[1].color", ptLight2.color);
-		//litShader.setFloat("_PtLight[1].intensity", ptLight2.intensity);
-		//litShader.setFloat("_PtLight[1].linearAtt", ptLight2.linearAtt);
-
-		//litShader.setVec3("_SpLight[0].color", spLight.color);
-		//litShader.setVec3("_SpLight[0].position", spLight.position);
-		//litShader.setVec3("_SpLight[0].direction", normalize(spLight.direction));
-		//litShader.setFloat("_SpLight[0].intensity", spLight.intensity);
-		//litShader.setFloat("_SpLight[0].linearAtt", spLight.linearAtt);
-		//litShader.setFloat("_SpLight[0].minAngle", cos(spLight.minAngle / 180 * 3.14159));
-		//litShader.setFloat("_SpLight[0].maxAngle", cos(spLight.maxAngle / 180 * 3.14159));
-		//litShader.setFloat("_SpLight[0].falloffCurve", spLight.falloffCurve);
-
-		//litShader.setInt("numDirLights", 1);
-		litShader.setInt("numPtLights", 1);
-		//litShader.setInt("numSpLights", 1);
+		//lightBlock.dirLights[0].color = dirLight.color;
+		//lightBlock.dirLights[0].direction = normalize(dirLight.direction);
+		//lightBlock.dirLights[0].intensity = dirLight.intensity;
+
+		ptLightData.clear();
+		spLightData.clear();
+
+		ew::PtLightData ptLightData1;
+		ptLightData1.position = lightTransform1.position;
+		ptLightData1.color = ptLight1.color;
+		ptLightData1.intensity = ptLight1.intensity;
+		ptLightData1.linearAtt = ptLight1.linearAtt;
+		ptLightData.push_back(ptLightData1);
+
+		//ew::PtLightData ptLightData2;
+		//ptLightData2.position = lightTransform2.position;
+		//ptLightData2.color = ptLight2.color;
+		//ptLightData2.intensity = ptLight2.intensity;
+		//ptLightData2.linearAtt = ptLight2.linearAtt;
+		//ptLightData.push_back(ptLightData2);
+
+		//ew::SpLightData spLightData1;
+		//spLightData1.color = spLight.color;
+		//spLightData1.position = spLight.position;
+		//spLightData1.direction = normalize(spLight.direction);
+		//spLightData1.intensity = spLight.intensity;
+		//spLightData1.linearAtt = spLight.linearAtt;
+		//spLightData1.minAngle = cos(spLight.minAngle / 180 * 3.14159);
+		//spLightData1.maxAngle = cos(spLight.maxAngle / 180 * 3.14159);
+		//spLightData1.falloffCurve = spLight.falloffCurve;
+		//spLightData.push_back(spLightData1);
+
+		//Stress lights orbit the scene so they get re-binned every frame
+		if (numStressLights != spawnedStressLights || stressLightRadius != spawnedStressRadius) {
+			spawnStressLights(stressLights, numStressLights, stressLightRadius);
+			spawnedStressLights = numStressLights;
+			spawnedStressRadius = stressLightRadius;
+		}
+		float orbitAngle = time * stressLightOrbitSpeed;
+		for (const ew::PtLightData& stressLight : stressLights) {
+			ew::PtLightData orbiting = stressLight;
+			orbiting.position.x = stressLight.position.x * cos(orbitAngle) - stressLight.position.z * sin(orbitAngle);
+			orbiting.position.z = stressLight.position.x * sin(orbitAngle) + stressLight.position.z * cos(orbitAngle);
+			ptLightData.push_back(orbiting);
+		}
+
+		lightClusters.setDepthRange(camera.getNearPlane(), camera.getFarPlane());
+		lightClusters.build(ptLightData, spLightData, camera.getViewMatrix(), camera.getProjectionMatrix(), SCREEN_WIDTH, SCREEN_HEIGHT);
+
+		//lightBlock.numDirLights = 1;
+
+		//One upload for every light, shared by all programs using LightBlock
+		lightUBO.update(lightBlock);
 
 		litShader.setVec3("_CameraPos", camera.getPosition());
 
 		//Set some material uniforms
-		litShader.setVec3("_Material.color", material.color);
+		materialBlock.material.color = material.color;
 		litShader.setFloat("NormalIntensity", normalIntensity);
-		litShader.setInt("Scrolling", scrolling);
-		litShader.setFloat("Time", (float)glfwGetTime() * scrollSpeed);
-		litShader.setFloat("_Material.ambientK", material.ambientK);
-		litShader.setFloat("_Material.diffuseK", material.diffuseK);
-		litShader.setFloat("_Material.specularK", material.specularK);
-		litShader.setFloat("_Material.shininess", material.shininess);
+		litShader.setFloat("Time", time * scrollSpeed);
+		materialBlock.material.ambientK = material.ambientK;
+		materialBlock.material.diffuseK = material.diffuseK;
+		materialBlock.material.specularK = material.specularK;
+		materialBlock.material.shininess = material.shininess;
+		materialUBO.update(materialBlock);
 
 		litShader.setInt("first", 0);
 		litShader.setInt("second", 1);
 
-		//Draw cube
-		litShader.setMat4("_Model", cubeTransform.getModelMatrix());
-		cubeMesh.draw();
-
-		//Draw sphere
-		litShader.setMat4("_Model", sphereTransform.getModelMatrix());
-		sphereMesh.draw();
-
-		//Draw cylinder
-		litShader.setMat4("_Model", cylinderTransform.getModelMatrix());
-		cylinderMesh.draw();
-
-		//Draw plane
-		litShader.setMat4("_Model", planeTransform.getModelMatrix());
-		planeMesh.draw();
-
-		//Draw light as a small sphere using unlit shader, ironically.
-		unlitShader.use();
+		//Uniforms are set on the programs directly, each is bound when its first draw comes up
 		unlitShader.setMat4("_Projection", camera.getProjectionMatrix());
 		unlitShader.setMat4("_View", camera.getViewMatrix());
-		unlitShader.setMat4("_Model", lightTransform1.getModelMatrix());
-		unlitShader.setVec3("_Color", ptLight1.color);
-		sphereMesh.draw();
-		//unlitShader.setMat4("_Model", lightTransform2.getModelMatrix());
-		//unlitShader.setVec3("_Color", ptLight2.color);
-		//sphereMesh.draw();
+
+		//Each object's draw, indexed like the culler
+		std::vector<DrawCommand> objectCommands(frustumCuller.getNumObjects());
+		std::vector<DrawMaterial> objectMaterials(frustumCuller.getNumObjects(), MATERIAL_BAMBOO);
+		objectCommands[cubeObject] = { &cubeMesh, SHADER_LIT, cubeNode };
+		objectCommands[sphereObject] = { &sphereMesh, SHADER_LIT, sphereNode };
+		objectCommands[cylinderObject] = { &cylinderMesh, SHADER_LIT, cylinderNode };
+		objectCommands[planeObject] = { &planeMesh, SHADER_LIT, planeNode };
+		//Draw light as a small sphere using unlit shader, ironically.
+		objectCommands[lightObject1] = { &sphereMesh, SHADER_UNLIT, lightNode1, ptLight1.color };
+		objectMaterials[lightObject1] = MATERIAL_NONE;
+
+		glm::mat4 viewMatrix = camera.getViewMatrix();
+		auto submitDraw = [&](DrawMaterial material, const DrawCommand& command) {
+			//Distance to the object's origin, close enough to order whole objects
+			float viewDepth = -(viewMatrix * scene.getWorldMatrix(command.node)[3]).z;
+			uint32_t depthBucket = ew::RenderQueue::getDepthBucket(viewDepth, camera.getFarPlane());
+			renderQueue.submit(ew::RenderQueue::makeOpaqueKey(PASS_OPAQUE, command.shader, material, depthBucket), (int)drawCommands.size());
+			drawCommands.push_back(command);
+		};
+		auto drawQueue = [&]() {
+			renderQueue.sort();
+			for (const ew::RenderItem& item : renderQueue.getItems()) {
+				const DrawCommand& command = drawCommands[item.command];
+				switch (command.shader) {
+				case SHADER_LIT:
+					litShader.use();
+					litShader.setMat4(litModelUniform, scene.getWorldMatrix(command.node));
+					litShader.setMat3(litNormalMatrixUniform, scene.getWorldNormalMatrix(command.node));
+					break;
+				case SHADER_UNLIT:
+					unlitShader.use();
+					unlitShader.setMat4(unlitModelUniform, scene.getWorldMatrix(command.node));
+					unlitShader.setVec3(unlitColorUniform, command.color);
+					break;
+				}
+				command.mesh->draw();
+			}
+			renderQueue.clear();
+			drawCommands.clear();
+		};
+
+		for (int object = 0; object < frustumCuller.getNumObjects(); object++) {
+			if (objectDrawn[object]) {
+				submitDraw(objectMaterials[object], objectCommands[object]);
+			}
+		}
+		drawQueue();
+		profiler.endScope();
+
+		//Everything else in the frustum is tested against the newest pyramid, normally last frame's, so the CPU never
+		//waits on the GPU. Waiting for the depth just drawn shows objects the camera has uncovered a frame sooner.
+		//Objects tested visible are drawn first next frame.
+		numOccluded = 0;
+		if (occlusionCulling) {
+			hiZCuller.build(fboDepth, camera.getProjectionMatrix() * camera.getViewMatrix());
+			hiZCuller.update(hiZWaitForDepth);
+			profiler.beginScope("SceneDisoccluded");
+			for (int object = 0; object < frustumCuller.getNumObjects(); object++) {
+				objectVisible[object] = frustumCuller.isVisible(object) && !hiZCuller.isOccluded(sceneBVH.getObjectBounds(object));
+				if (!frustumCuller.isVisible(object) || objectDrawn[object]) {
+					continue;
+				}
+				if (objectVisible[object]) {
+					objectDrawn[object] = true;
+					submitDraw(objectMaterials[object], objectCommands[object]);
+				}
+				else {
+					numOccluded++;
+				}
+			}
+			drawQueue();
+			profiler.endScope();
+		}
 
 		//Unbind FBO
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		profiler.beginScope("Post");
+		glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		//Draw Quad with data from GL_FRAMEBUFFER
@@ -341,8 +688,9 @@ int main() {
 			noPostProcShader.use();
 			noPostProcShader.setInt("_FrameBuffer", fboLoc);
 		}
-		glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+		glState.viewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
 		quadMesh.draw();
+		profiler.endScope();
 
 		//Draw UI
 		ImGui::Begin("Material");
@@ -404,12 +752,65 @@ int main() {
 		//ImGui::SliderFloat("Falloff Curve", &spLight.falloffCurve, 0, 1);
 		//ImGui::End();
 
+		ImGui::Begin("Clustered Lights");
+		ImGui::SliderInt("Stress Lights", &numStressLights, 0, 4096);
+		ImGui::SliderFloat("Stress Light Radius", &stressLightRadius, 0.25f, 5.0f);
+		ImGui::SliderFloat("Stress Orbit Speed", &stressLightOrbitSpeed, 0.0f, 2.0f);
+		ImGui::Text("Lights: %d", (int)ptLightData.size() + (int)spLightData.size());
+		ImGui::Text("Clusters: %d", lightClusters.getNumClusters());
+		ImGui::Text("Light indices: %d", lightClusters.getNumIndices());
+		ImGui::Text("Max lights per cluster: %d", lightClusters.getMaxLightsPerCluster());
+		ImGui::Text("Frame time: %.2f ms", deltaTime * 1000.0f);
+		ImGui::End();
+
+		ImGui::Begin("Culling");
+		ImGui::Text("Drawn: %d", frustumCuller.getNumDrawn() - numOccluded);
+		ImGui::Text("Frustum culled: %d", frustumCuller.getNumCulled());
+		ImGui::Checkbox("Occlusion Culling", &occlusionCulling);
+		ImGui::Checkbox("Wait For This Frame's Depth", &hiZWaitForDepth);
+		ImGui::Text("Occlusion culled: %d", numOccluded);
+		ImGui::End();
+
+		ImGui::Begin("Picking");
+		ImGui::Text("Picked: %s", pickedObject >= 0 ? objectNames[pickedObject] : "nothing");
+		if (pickedObject >= 0) {
+			ImGui::Text("Distance: %.2f", pickedDistance);
+		}
+		ImGui::Text("Objects lit by light 1:");
+		for (int object : litObjects) {
+			if (object != lightObject1) {
+				ImGui::BulletText("%s", objectNames[object]);
+			}
+		}
+		ImGui::End();
+
+		profiler.drawUI();
+
 		ImGui::Render();
 
+		profiler.beginScope("UI");
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		profiler.endScope();
+		profiler.setCounter("GL state calls issued", glState.getNumIssued());
+		profiler.setCounter("GL state calls filtered", glState.getNumFiltered());
+		glState.resetCounters();
+		profiler.endFrame();
 		glfwPollEvents();
 
-		glfwSwapBuffers(window);
+		if (!headless) {
+			glfwSwapBuffers(window);
+		}
+		frameIndex++;
+	}
+
+	if (headless) {
+		profiler.flush();
+		frameRecorder.printJson(stdout, "Normal Map", SCREEN_WIDTH, SCREEN_HEIGHT);
+	}
+	if (ew::TraceRecorder::get().isEnabled()) {
+		//Puts the last frames' GPU times on the trace
+		profiler.flush();
+		ew::TraceRecorder::get().writeJson("trace.json");
 	}
 
 	//Delete
@@ -424,7 +825,7 @@ void resizeFrameBufferCallback(GLFWwindow* window, int width, int height)
 	SCREEN_WIDTH = width;
 	SCREEN_HEIGHT = height;
 	camera.setAspectRatio((float)SCREEN_WIDTH / SCREEN_HEIGHT);
-	glViewport(0, 0, width, height);
+	ew::GLState::get().viewport(0, 0, width, height);
 }
 //Author: Eric Winebrenner
 void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action, int mods)
@@ -439,6 +840,9 @@ void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action,
 		camera.setPitch(0.0f);
 		firstMouseInput = false;
 	}
+	if (keycode == GLFW_KEY_F9 && action == GLFW_PRESS) {
+		ew::TraceRecorder::get().writeJson("trace.json");
+	}
 	if (keycode == GLFW_KEY_1 && action == GLFW_PRESS) {
 		wireFrame = !wireFrame;
 		glPolygonMode(GL_FRONT_AND_BACK, wireFrame ? GL_LINE : GL_FILL);
@@ -455,6 +859,8 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 //Author: Eric Winebrenner
 void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
 {
+	mouseX = xpos;
+	mouseY = ypos;
 	if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED) {
 		return;
 	}
@@ -480,6 +886,10 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 		glfwSetInputMode(window, GLFW_CURSOR, inputMode);
 		glfwGetCursorPos(window, &prevMouseX, &prevMouseY);
 	}
+	//Pick under the cursor, or the middle of the screen while it's locked
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse) {
+		pickRequested = true;
+	}
 }
 
 //Author: Eric Winebrenner
@@ -513,70 +923,38 @@ void processInput(GLFWwindow* window) {
 	camera.setPosition(position);
 }
 
-//Create a function that loads a tecture from a file and returns a handle to it.
-GLuint createTexture(const char* filePath) {
+//Queue a texture to load in the background and return a handle to it straight away.
+//It shows placeholderColor until the loader has decoded and uploaded the file.
+GLuint createTexture(ew::TextureLoader& loader, const char* filePath, glm::vec4 placeholderColor) {
+	const GLenum wrapModes[] = { GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BORDER, GL_REPEAT, GL_MIRRORED_REPEAT };
 
-	//Generate a texture name
-	GLuint texture;
-	glGenTextures(1, &texture);
-
-	//Bind our name to GL_TEXTURE_2D to make it a 2D texture.
-	glBindTexture(GL_TEXTURE_2D, texture);
-
-	//Load texture data as file
-	int width, height, numComponents;
-	unsigned char* textureData = stbi_load(filePath, &width, &height, &numComponents, 0);
-	if (textureData == NULL) {
-		printf("Texture data did not work");
-	}
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, textureData);
-
-	//Wrapping
-	switch (currentWrapMode) {
-		case 0:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			break;
-		case 1:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-			break;
-		case 2:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			break;
-		case 3:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-			break;
-	}
+	ew::TextureSettings settings;
+	settings.wrapMode = wrapModes[currentWrapMode];
 
 	//When magnififying, use nearest neighbor sampling
-	glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	settings.magFilter = GL_NEAREST;
 
 	//When minifying, use bilinear sampling
-	glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+	settings.minFilter = GL_NEAREST_MIPMAP_LINEAR;
 
-	glGenerateMipmap(GL_TEXTURE_2D);
-	
-	return texture;
+	settings.placeholderColor = placeholderColor;
+	return loader.load(filePath, settings);
 }
 
-GLuint createFBO() {
+GLuint createFBO(GLuint* depthTexture) {
 	//Create FBO
 	GLuint fbo;
 	glGenFramebuffers(1, &fbo);
 	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
 
-	glActiveTexture(GL_TEXTURE0 + fboLoc);
+	ew::GLState::get().activeTexture(GL_TEXTURE0 + fboLoc);
 
-	glEnable(GL_DEPTH_TEST);
+	ew::GLState::get().enable(GL_DEPTH_TEST);
 
 	//Create Tecture Color Buffer
 	GLuint texture;
 	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
+	ew::GLState::get().bindTexture(GL_TEXTURE_2D, texture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -584,16 +962,18 @@ GLuint createFBO() {
 	//Attach Color Buffer
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, texture, 0);
 
-	//Create Render Buffer Object
-	GLuint rbo;
-	glGenRenderbuffers(1, &rbo);
-	glBindRenderbuffer(GL_RENDERBUFFER, rbo);
+	//Depth is a texture rather than a render buffer so the Hi-Z pyramid can be built from it
+	glGenTextures(1, depthTexture);
+	ew::GLState::get().bindTexture(GL_TEXTURE_2D, *depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, SCREEN_WIDTH, SCREEN_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	//Create storage for depth components
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, SCREEN_WIDTH, SCREEN_HEIGHT);
+	//Attach depth texture to current FBO
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, *depthTexture, 0);
 
-	//Attach RBO to current FBO
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
+	//The color buffer stays bound to fboLoc for the post processing pass
+	ew::GLState::get().bindTexture(GL_TEXTURE_2D, texture);
 
 	//Returns the state of the currently bound FBO
 	GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
@@ -603,3 +983,19 @@ GLuint createFBO() {
 
 	return fbo;
 }
+
+//Scatters point lights around the cube/sphere/cylinder/plane set. Seeded so the same count gives the same layout.
+void spawnStressLights(std::vector<ew::PtLightData>& lights, int count, float radius) {
+	lights.clear();
+	lights.reserve(count);
+	srand(1234);
+	auto random01 = []() { return (float)rand() / (float)RAND_MAX; };
+	for (int i = 0; i < count; i++) {
+		ew::PtLightData light;
+		light.position = glm::vec3(random01() * 10.0f - 5.0f, random01() * 2.5f - 0.9f, random01() * 10.0f - 5.0f);
+		light.color = glm::vec3(random01(), random01(), random01());
+		light.intensity = 0.5f;
+		light.linearAtt = radius;
+		lights.push_back(light);
+	}
+}
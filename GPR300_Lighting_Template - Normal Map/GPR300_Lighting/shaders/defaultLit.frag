@@ -9,47 +9,85 @@ in struct Vertex{
 
 uniform vec3 _CameraPos;
 
+//Member order matches the std140 mirrors in EW/LightBlock.h
 struct DirLight{
     vec3 color;
-    vec3 direction;
     float intensity;
+    vec3 direction;
 };
 
 struct PtLight{
     vec3 color;
-    vec3 position;
     float intensity;
+    vec3 position;
     float linearAtt;
 };
 
 struct SpLight{
     vec3 color;
-    vec3 position;
-    vec3 direction;
     float intensity;
+    vec3 position;
     float linearAtt;
+    vec3 direction;
     float minAngle;
     float maxAngle;
     float falloffCurve;
 };
 
 #define MAX_LIGHTS 8
-uniform DirLight _DirLight[MAX_LIGHTS];
-uniform PtLight _PtLight[MAX_LIGHTS];
-uniform SpLight _SpLight[MAX_LIGHTS];
-uniform int numDirLights, numPtLights, numSpLights;
+layout(std140, binding = 0) uniform LightBlock{
+    DirLight _DirLight[MAX_LIGHTS];
+    PtLight _PtLight[MAX_LIGHTS];
+    SpLight _SpLight[MAX_LIGHTS];
+    int numDirLights, numPtLights, numSpLights;
+};
+
+//Clustered point and spot lights. numPtLights/numSpLights above are unused here,
+//each fragment only visits the lights binned into its cluster by EW/LightClusters.
+layout(std140, binding = 2) uniform ClusterBlock{
+    mat4 _ClusterView;
+    uvec4 _ClusterGridSize;
+    vec4 _ClusterDepthParams;
+    vec2 _ScreenSize;
+};
+
+layout(std430, binding = 6) readonly buffer ClusterPtLights{
+    PtLight _ClusterPtLights[];
+};
+layout(std430, binding = 7) readonly buffer ClusterSpLights{
+    SpLight _ClusterSpLights[];
+};
+//x = offset into _ClusterLightIndices, y = point light count, z = spot light count
+layout(std430, binding = 8) readonly buffer ClusterGrid{
+    uvec4 _ClusterGrid[];
+};
+layout(std430, binding = 9) readonly buffer ClusterIndices{
+    uint _ClusterLightIndices[];
+};
+
+uint getClusterIndex(){
+    float depth = -(_ClusterView * vec4(v_out.WorldPosition, 1)).z;
+    float slice = floor(log(max(depth, 1e-4)) * _ClusterDepthParams.x - _ClusterDepthParams.y);
+    uint z = uint(clamp(slice, 0, float(_ClusterGridSize.z - 1)));
+    uvec2 tile = uvec2(clamp(gl_FragCoord.xy / _ScreenSize * vec2(_ClusterGridSize.xy), vec2(0), vec2(_ClusterGridSize.xy - 1)));
+    return tile.x + _ClusterGridSize.x * (tile.y + _ClusterGridSize.y * z);
+}
 
 vec3 ambient;
 vec3 diffuse;
 vec3 specular;
 
-uniform struct Material{
+struct Material{
     vec3 color;
     float ambientK;
     float diffuseK;
     float specularK; 
     float shininess; 
-}_Material;
+};
+
+layout(std140, binding = 1) uniform MaterialBlock{
+    Material _Material;
+};
 
 uniform sampler2D first, second;
 
@@ -57,8 +95,9 @@ void main(){
     ambient = _Material.ambientK * texture(first, v_out.Uv).rgb;
 
     //normal map stuff
-    vec3 normal = texture(second, v_out.Uv).rgb;
-    normal = normal * 2.0 - 1.0;
+    //Rebuild Z from XY so cooked BC5 normal maps, which only store two channels, work too
+    vec2 normalXY = texture(second, v_out.Uv).rg * 2.0 - 1.0;
+    vec3 normal = vec3(normalXY, sqrt(max(1.0 - dot(normalXY, normalXY), 0.0)));
     normal *= v_out.TBN;
 
     diffuse = vec3(0);
@@ -76,47 +115,52 @@ void main(){
         specular += _Material.specularK * pow(dot(normal, h), _Material.shininess) * (_DirLight[i].intensity * _DirLight[i].color);
     }
 
+    uvec4 cluster = _ClusterGrid[getClusterIndex()];
+
     //Point Lights
-    for(int i = 0; i < numPtLights; i++) {
-        float linearAtt = length(_PtLight[i].position - v_out.WorldPosition) / _PtLight[i].linearAtt;
+    for(uint i = 0; i < cluster.y; i++) {
+        PtLight light = _ClusterPtLights[_ClusterLightIndices[cluster.x + i]];
+
+        float linearAtt = length(light.position - v_out.WorldPosition) / light.linearAtt;
         linearAtt = 1 - pow(linearAtt, 4);
         linearAtt = min(max(linearAtt, 0), 1);
         linearAtt = pow(linearAtt, 2);
 
-        vec3 l = normalize(_PtLight[i].position - v_out.WorldPosition);
+        vec3 l = normalize(light.position - v_out.WorldPosition);
 
-        diffuse += _Material.diffuseK * max(dot(l, normal), 0) * (_PtLight[i].intensity * linearAtt * _PtLight[i].color);
+        diffuse += _Material.diffuseK * max(dot(l, normal), 0) * (light.intensity * linearAtt * light.color);
 
         vec3 v = _CameraPos - v_out.WorldPosition;
         vec3 h = normalize(v + l);
 
-        specular += _Material.specularK * pow(dot(normal, h), _Material.shininess) * (_PtLight[i].intensity * linearAtt * _PtLight[i].color);
+        specular += _Material.specularK * pow(dot(normal, h), _Material.shininess) * (light.intensity * linearAtt * light.color);
     }
 
     //Spot Lights
-    for(int i = 0; i < numSpLights; i++) {
+    for(uint i = 0; i < cluster.z; i++) {
+        SpLight light = _ClusterSpLights[_ClusterLightIndices[cluster.x + cluster.y + i]];
 
-        vec3 dtofrag = normalize(v_out.WorldPosition - _SpLight[i].position);
-        float theta = dot(dtofrag, _SpLight[i].direction);
+        vec3 dtofrag = normalize(v_out.WorldPosition - light.position);
+        float theta = dot(dtofrag, light.direction);
         theta = min(max(theta, 0), 1);
 
-        float angularAtt = (theta - _SpLight[i].maxAngle) / (_SpLight[i].minAngle - _SpLight[i].maxAngle);
+        float angularAtt = (theta - light.maxAngle) / (light.minAngle - light.maxAngle);
         angularAtt = min(max(angularAtt, 0), 1);
-        angularAtt = pow(angularAtt ,_SpLight[i].falloffCurve);
+        angularAtt = pow(angularAtt ,light.falloffCurve);
 
-        float linearAtt = length(_PtLight[i].position - v_out.WorldPosition) / _PtLight[i].linearAtt;
+        float linearAtt = length(light.position - v_out.WorldPosition) / light.linearAtt;
         linearAtt = 1 - pow(linearAtt, 4);
         linearAtt = min(max(linearAtt, 0), 1);
         linearAtt = pow(linearAtt, 2);
 
-        vec3 l = normalize(_SpLight[i].position - v_out.WorldPosition);
+        vec3 l = normalize(light.position - v_out.WorldPosition);
 
-        diffuse += _Material.diffuseK * max(dot(l, normal), 0) * (_SpLight[i].intensity * angularAtt * linearAtt * _SpLight[i].color);
+        diffuse += _Material.diffuseK * max(dot(l, normal), 0) * (light.intensity * angularAtt * linearAtt * light.color);
 
         vec3 v = _CameraPos - v_out.WorldPosition;
         vec3 h = normalize(v + l);
 
-        specular += _Material.specularK * pow(dot(normal, h), _Material.shininess) * (_SpLight[i].intensity * angularAtt * linearAtt * _SpLight[i].color);
+        specular += _Material.specularK * pow(dot(normal, h), _Material.shininess) * (light.intensity * angularAtt * linearAtt * light.color);
     }
 
     vec3 lightCol = ambient + diffuse + specular;
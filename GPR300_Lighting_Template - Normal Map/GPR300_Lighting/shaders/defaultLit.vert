@@ -5,6 +5,14 @@ layout (location = 2) in vec2 uv;
 layout (location = 3) in vec3 vTangent;
 
 uniform mat4 _Model;
+//transpose(inverse(mat3(_Model))), computed on the CPU by ew::Transform::getNormalMatrix()
+uniform mat3 _NormalMatrix;
+#ifdef INVERSE_NORMAL_MATRIX
+//What every vertex used to do before the CPU took over, only compiled for --bench-normals
+#define NORMAL_MATRIX transpose(inverse(mat3(_Model)))
+#else
+#define NORMAL_MATRIX _NormalMatrix
+#endif
 uniform mat4 _View;
 uniform mat4 _Projection;
 
@@ -15,27 +23,26 @@ out struct Vertex{
 }v_out;
 
 uniform float NormalIntensity;
-uniform bool Scrolling;
+//SCROLLING is defined by the Shader variant, see main.cpp
 uniform float Time;
 
 void main(){    
     v_out.WorldPosition = vec3(_Model * vec4(vPos,1));
-    vec3 worldNormal = transpose(inverse(mat3(_Model))) * vNormal;
+    vec3 worldNormal = NORMAL_MATRIX * vNormal;
     worldNormal *= NormalIntensity;
-    vec3 worldTangent = transpose(inverse(mat3(_Model))) * vTangent;
+    vec3 worldTangent = NORMAL_MATRIX * vTangent;
     gl_Position = _Projection * _View * _Model * vec4(vPos,1);
 
     v_out.TBN = mat3(worldTangent, cross(worldTangent, worldNormal), worldNormal);
 
-    if(Scrolling) {
-        vec2 temp = uv;
-        temp.y += mod(Time,1);
-        if(temp.y > 1) {
-            temp.y--;
-        }
-        v_out.Uv = temp;
-    }
-    else {
-        v_out.Uv = uv;
+#ifdef SCROLLING
+    vec2 temp = uv;
+    temp.y += mod(Time,1);
+    if(temp.y > 1) {
+        temp.y--;
     }
+    v_out.Uv = temp;
+#else
+    v_out.Uv = uv;
+#endif
 }
@@ -0,0 +1,30 @@
+#version 450
+out float FragDepth;
+
+//Depth texture for the first level, the pyramid itself after that with its base level set to the level above
+uniform sampler2D _Source;
+
+//Each texel keeps the farthest depth of the texels under it, so a box nearer than it is never wrongly hidden
+void main(){
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+    ivec2 sourceSize = textureSize(_Source, 0);
+    ivec2 sourceTexel = texel * 2;
+    ivec2 lastTexel = sourceSize - 1;
+
+    //Odd sized sources leave a row/column that only the last texel can cover
+    ivec2 extent = ivec2(1);
+    if ((sourceSize.x & 1) != 0 && texel.x == sourceSize.x / 2 - 1) {
+        extent.x = 2;
+    }
+    if ((sourceSize.y & 1) != 0 && texel.y == sourceSize.y / 2 - 1) {
+        extent.y = 2;
+    }
+
+    float depth = 0.0;
+    for (int y = 0; y <= extent.y; y++) {
+        for (int x = 0; x <= extent.x; x++) {
+            depth = max(depth, texelFetch(_Source, min(sourceTexel + ivec2(x, y), lastTexel), 0).r);
+        }
+    }
+    FragDepth = depth;
+}
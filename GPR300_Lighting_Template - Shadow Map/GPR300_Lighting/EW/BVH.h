@@ -0,0 +1,73 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "Mesh.h"
+#include "Frustum.h"
+
+namespace ew {
+	struct AABB {
+		glm::vec3 min = glm::vec3(0);
+		glm::vec3 max = glm::vec3(0);
+	};
+
+	//World space box around a mesh's local bounds once transformed by modelMatrix
+	AABB transformBounds(const Bounds& localBounds, const glm::mat4& modelMatrix);
+
+	enum BoxClassification { BOX_OUTSIDE, BOX_INTERSECTING, BOX_INSIDE };
+
+	//Tests the box corners furthest along and against each plane's normal
+	BoxClassification classifyBox(const Frustum& frustum, const AABB& box);
+	bool sphereTouchesBox(const glm::vec3& center, float radius, const AABB& box);
+	//Slab test. Returns the distance the ray enters the box, or INFINITY if it misses.
+	float rayEnterDistance(const glm::vec3& origin, const glm::vec3& inverseDirection, const AABB& box);
+
+	/// <summary>
+	/// Bounding volume hierarchy over object boxes, for queries that would otherwise test every object:
+	/// frustum culling, ray picking and finding the objects a light reaches.
+	/// build() splits with the surface area heuristic. Moving objects only refits the boxes above them,
+	/// which keeps queries correct but lets the tree get looser, so rebuild after large rearrangements.
+	/// Object indices are the positions of their boxes in the vector passed to build().
+	/// </summary>
+	class BVH {
+	public:
+		void build(const std::vector<AABB>& objectBounds);
+		//Takes effect on the next refit()
+		void setObjectBounds(int object, const AABB& bounds);
+		//Grows and shrinks the boxes above objects moved since the last refit. Returns how many nodes were refit.
+		int refit();
+
+		//Appends objects whose boxes intersect the frustum
+		void queryFrustum(const Frustum& frustum, std::vector<int>& objects)const;
+		//Appends objects whose boxes touch the sphere
+		void querySphere(const glm::vec3& center, float radius, std::vector<int>& objects)const;
+		//Closest object whose box the ray hits, or -1. direction doesn't need to be normalized, distance is in its lengths.
+		int raycast(const glm::vec3& origin, const glm::vec3& direction, float* hitDistance = nullptr)const;
+
+		inline int getNumObjects()const { return (int)mObjectBounds.size(); }
+		inline int getNumNodes()const { return (int)mNodes.size(); }
+		inline const AABB& getObjectBounds(int object)const { return mObjectBounds[object]; }
+	private:
+		//Every node covers a contiguous range of mObjects, children split their parent's range
+		struct Node {
+			AABB bounds;
+			int parent;
+			//Index of the first child, the second follows it. 0 for leaves, the root is never a child.
+			int firstChild;
+			int firstObject;
+			int numObjects;
+			bool dirty;
+		};
+		void split(int node);
+		void markDirty(int node);
+
+		std::vector<Node> mNodes;
+		std::vector<AABB> mObjectBounds;
+		//Object indices in tree order
+		std::vector<int> mObjects;
+		//Leaf holding each object
+		std::vector<int> mObjectLeaves;
+		std::vector<int> mDirtyNodes;
+	};
+}
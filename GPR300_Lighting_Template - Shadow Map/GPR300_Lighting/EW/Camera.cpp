@@ -31,4 +31,11 @@ glm::mat4 Camera::getViewMatrix() {
 	return glm::lookAt(mPosition, mPosition + getForward(), glm::vec3(0,1,0));
 }
 
+ew::Frustum Camera::getFrustum() {
+	return ew::Frustum(getProjectionMatrix() * getViewMatrix());
+}
 
+glm::vec3 Camera::getRayDirection(glm::vec2 ndc) {
+	glm::vec4 farPoint = glm::inverse(getProjectionMatrix() * getViewMatrix()) * glm::vec4(ndc, 1.0f, 1.0f);
+	return glm::normalize(glm::vec3(farPoint) / farPoint.w - mPosition);
+}
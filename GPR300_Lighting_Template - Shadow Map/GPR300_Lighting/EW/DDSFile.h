@@ -0,0 +1,39 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace ew {
+	enum class BlockFormat {
+		BC1,	//RGB, 8 bytes per 4x4 block
+		BC3,	//RGBA, 16 bytes per 4x4 block
+		BC5		//Two channel (normal map XY), 16 bytes per 4x4 block
+	};
+
+	struct DDSMip {
+		int width, height;
+		//Byte range of this level inside DDSImage::data
+		size_t offset, size;
+	};
+
+	/// <summary>
+	/// A block compressed texture with its full mip chain, as stored in a .dds file.
+	/// Levels are packed back to back in data, largest first.
+	/// </summary>
+	struct DDSImage {
+		BlockFormat format = BlockFormat::BC1;
+		int width = 0, height = 0;
+		std::vector<DDSMip> mips;
+		std::vector<uint8_t> data;
+	};
+
+	int bytesPerBlock(BlockFormat format);
+	size_t blockCompressedSize(BlockFormat format, int width, int height);
+
+	//Returns false without printing if the file can't be opened, so callers can probe for a cooked version
+	bool readDDS(const std::string& filePath, DDSImage& image);
+	bool writeDDS(const std::string& filePath, const DDSImage& image);
+}
@@ -0,0 +1,44 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <filesystem>
+
+namespace ew {
+	/// <summary>
+	/// Polls the modification time of registered files on a background thread.
+	/// The render thread only ever reads a flag, so checking for changes every frame costs nothing.
+	/// </summary>
+	class FileWatcher {
+	public:
+		FileWatcher(int pollIntervalMs = 250);
+		~FileWatcher();
+		//Returns an id to pass to consumeChange()
+		int watch(const std::string& filePath);
+		//Stops polling the file. The id may be handed out again by a later watch().
+		void unwatch(int id);
+		//True once per modification of the file
+		bool consumeChange(int id);
+		//Shared watcher used by Shader hot reloading
+		static FileWatcher& get();
+	private:
+		FileWatcher(const FileWatcher& r) = delete;
+		struct WatchedFile {
+			std::string filePath;
+			std::filesystem::file_time_type lastWriteTime;
+			bool changed;
+			bool active;
+		};
+		void pollLoop();
+
+		std::thread mThread;
+		std::mutex mMutex;
+		std::vector<WatchedFile> mFiles;
+		std::atomic<bool> mStopping;
+		int mPollIntervalMs;
+	};
+}
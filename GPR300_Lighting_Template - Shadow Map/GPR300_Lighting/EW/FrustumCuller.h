@@ -0,0 +1,40 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "Mesh.h"
+#include "Frustum.h"
+
+namespace ew {
+	/// <summary>
+	/// Tests a frame's worth of object bounds against a frustum, four objects at a time with SSE.
+	/// Each object keeps the tighter of its world space bounding sphere and box per plane, so long thin objects
+	/// aren't kept alive by their sphere and blobby ones aren't by their box.
+	/// add() each object once, call setModelMatrix() whenever one moves, then cull() each frame and draw getVisible()
+	/// or check isVisible().
+	/// </summary>
+	class FrustumCuller {
+	public:
+		//Returns the object's index, for setModelMatrix() and isVisible()
+		int add(const Bounds& localBounds, const glm::mat4& modelMatrix = glm::mat4(1));
+		void setModelMatrix(int index, const glm::mat4& modelMatrix);
+		void clear();
+		void cull(const Frustum& frustum);
+		inline bool isVisible(int index)const { return mVisible[index] != 0; }
+		//Indices of visible objects in the order they were added
+		inline const std::vector<int>& getVisible()const { return mVisibleIndices; }
+		inline int getNumObjects()const { return mCount; }
+		inline int getNumDrawn()const { return (int)mVisibleIndices.size(); }
+		inline int getNumCulled()const { return mCount - (int)mVisibleIndices.size(); }
+	private:
+		int mCount = 0;
+		std::vector<Bounds> mLocalBounds;
+		//World space bounds as structure-of-arrays, padded to a multiple of 4. Box and sphere share a center.
+		std::vector<float> mCenterX, mCenterY, mCenterZ;
+		std::vector<float> mExtentX, mExtentY, mExtentZ;
+		std::vector<float> mRadius;
+		std::vector<unsigned char> mVisible;
+		std::vector<int> mVisibleIndices;
+	};
+}
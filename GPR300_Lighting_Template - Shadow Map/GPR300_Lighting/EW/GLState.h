@@ -0,0 +1,91 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+
+namespace ew {
+	/// <summary>
+	/// Copy of the GL state that changes most often, so that setting something to what it already is never reaches the driver.
+	/// Each call mirrors the GL function it stands in for. State starts out unknown, so the first call of each kind always goes through.
+	/// Code that changes this state without going through here must call invalidate(), and deleted objects must be forgotten
+	/// since GL gives their names out again. Only the GL thread may use it.
+	/// </summary>
+	class GLState {
+	public:
+		//Texture units whose bindings are cached, higher ones always go to GL
+		static const int MAX_TEXTURE_UNITS = 32;
+		GLState();
+		void useProgram(GLuint program);
+		void bindVertexArray(GLuint vertexArray);
+		void activeTexture(GLenum textureUnit);
+		//Binds to the active unit
+		void bindTexture(GLenum target, GLuint texture);
+		void enable(GLenum capability);
+		void disable(GLenum capability);
+		void depthFunc(GLenum func);
+		void depthMask(GLboolean flag);
+		void stencilFunc(GLenum func, GLint ref, GLuint mask);
+		void stencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass);
+		void stencilMask(GLuint mask);
+		void blendFunc(GLenum sourceFactor, GLenum destinationFactor);
+		void cullFace(GLenum mode);
+		void polygonOffset(GLfloat factor, GLfloat units);
+		void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+		//Current values, read back from GL only if not known yet
+		GLuint getProgram();
+		GLuint getVertexArray();
+		GLenum getActiveTexture();
+		//Bound to the active unit. Only 2D, 2D array, cube map and 3D targets are known, others read as 0.
+		GLuint getTexture(GLenum target);
+		GLboolean isEnabled(GLenum capability);
+		void getViewport(GLint viewport[4]);
+
+		//Call before deleting, so a new object given the same name isn't taken as already bound
+		void forgetProgram(GLuint program);
+		void forgetVertexArray(GLuint vertexArray);
+		void forgetTexture(GLuint texture);
+		//Forgets everything, the next call of each kind goes to GL
+		void invalidate();
+
+		//Calls passed on to GL and calls dropped since the last reset
+		inline int getNumIssued()const { return mNumIssued; }
+		inline int getNumFiltered()const { return mNumFiltered; }
+		inline void resetCounters() { mNumIssued = mNumFiltered = 0; }
+		//Shared state of the one GL context
+		static GLState& get();
+	private:
+		GLState(const GLState& r) = delete;
+		//Marks a value nothing is known about
+		static const GLuint UNKNOWN = 0xFFFFFFFF;
+		static const int NUM_TEXTURE_TARGETS = 4;
+		static const int NUM_CAPABILITIES = 6;
+		//True if the call can be dropped, counting it either way
+		bool filter(bool unchanged);
+		//-1 for targets and capabilities that aren't cached
+		static int textureTargetIndex(GLenum target);
+		static int capabilityIndex(GLenum capability);
+		void setEnabled(GLenum capability, bool enabled);
+
+		GLuint mProgram;
+		GLuint mVertexArray;
+		GLenum mActiveTexture;
+		GLuint mTextures[MAX_TEXTURE_UNITS][NUM_TEXTURE_TARGETS];
+		GLuint mEnabled[NUM_CAPABILITIES];
+		GLenum mDepthFunc;
+		GLuint mDepthMask;
+		GLenum mStencilFunc;
+		GLint mStencilRef;
+		GLuint mStencilFuncMask;
+		GLenum mStencilOp[3];
+		GLuint mStencilMask;
+		GLenum mBlendFunc[2];
+		GLenum mCullFace;
+		bool mPolygonOffsetKnown;
+		GLfloat mPolygonOffset[2];
+		bool mViewportKnown;
+		GLint mViewport[4];
+		int mNumIssued = 0;
+		int mNumFiltered = 0;
+	};
+}
@@ -0,0 +1,66 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <map>
+#include "Mesh.h"
+
+namespace ew {
+	/// <summary>
+	/// Hands out ranges of a linear space by best fit. Freed ranges merge with free neighbours,
+	/// so allocating and freeing in any order doesn't leave the space in ever smaller pieces.
+	/// </summary>
+	class RangeAllocator {
+	public:
+		static const uint32_t INVALID_OFFSET = 0xFFFFFFFF;
+		RangeAllocator(uint32_t capacity = 0);
+		//Returns INVALID_OFFSET if no free range is big enough
+		uint32_t allocate(uint32_t size);
+		void free(uint32_t offset, uint32_t size);
+		//Adds free space at the end
+		void grow(uint32_t newCapacity);
+		inline uint32_t getCapacity()const { return mCapacity; }
+		inline uint32_t getUsed()const { return mUsed; }
+		inline int getNumFreeRanges()const { return (int)mFreeByOffset.size(); }
+	private:
+		void addFreeRange(uint32_t offset, uint32_t size);
+		void removeFreeRange(uint32_t offset, uint32_t size);
+
+		uint32_t mCapacity;
+		uint32_t mUsed = 0;
+		//The same free ranges indexed two ways: by offset to find neighbours, by size to find the best fit
+		std::map<uint32_t, uint32_t> mFreeByOffset;
+		std::multimap<uint32_t, uint32_t> mFreeBySize;
+	};
+
+	/// <summary>
+	/// One vertex buffer and one index buffer shared by many meshes, with a single VAO for the ew::Vertex layout.
+	/// Meshes own ranges of each. Indices stay relative to their mesh's first vertex and are drawn with
+	/// glDrawElementsBaseVertex, so every pooled draw binds the same VAO and uploads never need rewriting.
+	/// Buffers double when full, copying existing geometry across on the GPU.
+	/// </summary>
+	class GeometryPool {
+	public:
+		//Capacities are in vertices and indices
+		GeometryPool(uint32_t vertexCapacity = 1 << 16, uint32_t indexCapacity = 1 << 18);
+		~GeometryPool();
+		GeometryAllocation allocate(const MeshData& meshData);
+		void free(const GeometryAllocation& allocation);
+		void bind();
+		inline GLuint getVAO()const { return mVAO; }
+		inline GLuint getVertexBuffer()const { return mVBO; }
+		inline GLuint getIndexBuffer()const { return mEBO; }
+		inline const RangeAllocator& getVertexRanges()const { return mVertexRanges; }
+		inline const RangeAllocator& getIndexRanges()const { return mIndexRanges; }
+	private:
+		GeometryPool(const GeometryPool& r) = delete;
+		GeometryPool& operator=(const GeometryPool& r) = delete;
+		void growBuffer(GLuint& buffer, RangeAllocator& ranges, uint32_t elementSize, uint32_t minCapacity);
+		void setupVAO();
+
+		GLuint mVAO = 0, mVBO = 0, mEBO = 0;
+		RangeAllocator mVertexRanges;
+		RangeAllocator mIndexRanges;
+	};
+}
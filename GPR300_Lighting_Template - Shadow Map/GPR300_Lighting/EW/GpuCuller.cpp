@@ -0,0 +1,116 @@
+//Author: Eric Winebrenner
+
+#include "GpuCuller.h"
+#include "GLState.h"
+#include "Profiler.h"
+
+namespace ew {
+	//Storage buffer bindings in cullObjects.comp
+	const GLuint IN_COMMAND_BINDING = 0;
+	const GLuint IN_OBJECT_BINDING = 1;
+	const GLuint IN_BOUNDS_BINDING = 2;
+	const GLuint OUT_COMMAND_BINDING = 3;
+	const GLuint OUT_OBJECT_BINDING = 4;
+	const GLuint DRAW_COUNT_BINDING = 5;
+	//local_size_x in cullObjects.comp
+	const int CULL_GROUP_SIZE = 64;
+
+	GpuCuller::GpuCuller(const std::string& computeShaderPath)
+		: mShader(computeShaderPath)
+	{
+		mShader.setHotReload(true);
+		mFrustumPlanesUniform = mShader.getUniform("_FrustumPlanes");
+		mNumObjectsUniform = mShader.getUniform("_NumObjects");
+		glGenBuffers(1, &mCommandBuffer);
+		glGenBuffers(1, &mObjectBuffer);
+		glGenBuffers(1, &mCountBuffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCountBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint), NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	GpuCuller::~GpuCuller()
+	{
+		glDeleteBuffers(1, &mCommandBuffer);
+		glDeleteBuffers(1, &mObjectBuffer);
+		glDeleteBuffers(1, &mCountBuffer);
+	}
+
+	void GpuCuller::cull(const MultiDrawBatch& batch, const Frustum& frustum)
+	{
+		ProfileScope scope("GpuCull");
+		mPool = batch.getPool();
+		mNumObjects = batch.getNumUploaded();
+		mShader.reloadIfChanged();
+		if (!mShader.isLinked() || mNumObjects == 0) {
+			mNumObjects = 0;
+			return;
+		}
+		//Every object could survive, so the outputs need room for all of them
+		if (mNumObjects > mCapacity) {
+			while (mCapacity < mNumObjects) {
+				mCapacity = mCapacity > 0 ? mCapacity * 2 : 64;
+			}
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCommandBuffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, mCapacity * sizeof(DrawElementsIndirectCommand), NULL, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_SHADER_STORAGE_BUFFER, mObjectBuffer);
+			glBufferData(GL_SHADER_STORAGE_BUFFER, mCapacity * sizeof(ObjectData), NULL, GL_DYNAMIC_DRAW);
+		}
+		GLuint zero = 0;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mCountBuffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint), &zero);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IN_COMMAND_BINDING, batch.getCommandBuffer());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IN_OBJECT_BINDING, batch.getObjectBuffer());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, IN_BOUNDS_BINDING, batch.getBoundsBuffer());
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OUT_COMMAND_BINDING, mCommandBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OUT_OBJECT_BINDING, mObjectBuffer);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_COUNT_BINDING, mCountBuffer);
+
+		//The caller's program is put back, it's usually about to draw with it
+		GLState& state = GLState::get();
+		GLuint currentProgram = state.getProgram();
+		mShader.setVec4Array(mFrustumPlanesUniform, frustum.planes, Frustum::NUM_PLANES);
+		mShader.setUint(mNumObjectsUniform, (GLuint)mNumObjects);
+		mShader.use();
+		glDispatchCompute((mNumObjects + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+		state.useProgram(currentProgram);
+
+		//Commands and the count are read by the draw, object data by the vertex shader
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	void GpuCuller::draw()
+	{
+		if (mNumObjects == 0) {
+			return;
+		}
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BUFFER_BINDING, mObjectBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+		mPool->bind();
+		if (GLEW_ARB_indirect_parameters) {
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, mCountBuffer);
+			glMultiDrawElementsIndirectCountARB(GL_TRIANGLES, GL_UNSIGNED_INT, 0, 0, mNumObjects, 0);
+			glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+		}
+		else {
+			int drawCount = readDrawCount();
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, drawCount, 0);
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+
+	int GpuCuller::readDrawCount()
+	{
+		if (mNumObjects == 0) {
+			return 0;
+		}
+		GLuint drawCount = 0;
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_COPY_READ_BUFFER, mCountBuffer);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, sizeof(GLuint), &drawCount);
+		glBindBuffer(GL_COPY_READ_BUFFER, 0);
+		return (int)drawCount;
+	}
+}
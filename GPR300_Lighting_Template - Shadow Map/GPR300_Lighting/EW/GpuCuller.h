@@ -0,0 +1,44 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <string>
+#include "Frustum.h"
+#include "MultiDrawBatch.h"
+#include "Shader.h"
+
+namespace ew {
+	/// <summary>
+	/// Frustum culls a MultiDrawBatch on the GPU. A compute pass tests every object's box and packs the survivors'
+	/// commands and object data into this culler's buffers, counting them with an atomic.
+	/// draw() hands that count straight to glMultiDrawElementsIndirectCount, so culling costs the CPU nothing per object.
+	/// Without ARB_indirect_parameters the count is read back instead, which waits on the cull.
+	/// The compute shader is hot reloaded like the others, picked up on the next cull().
+	/// </summary>
+	class GpuCuller {
+	public:
+		GpuCuller(const std::string& computeShaderPath = "shaders/cullObjects.comp");
+		~GpuCuller();
+		//Culls the batch's last upload. Does nothing while the compute shader fails to build.
+		void cull(const MultiDrawBatch& batch, const Frustum& frustum);
+		//Draws what survived the last cull with whichever MULTI_DRAW program is in use
+		void draw();
+		//Reads the number of survivors back. Waits for the cull, so it's for debugging.
+		int readDrawCount();
+		inline bool isValid()const { return mShader.isLinked(); }
+	private:
+		GpuCuller(const GpuCuller& r) = delete;
+
+		Shader mShader;
+		UniformHandle mFrustumPlanesUniform;
+		UniformHandle mNumObjectsUniform;
+		GLuint mCommandBuffer = 0;
+		GLuint mObjectBuffer = 0;
+		GLuint mCountBuffer = 0;
+		//Objects the output buffers have room for
+		int mCapacity = 0;
+		//Objects in the last cull, the most that can survive
+		int mNumObjects = 0;
+		GeometryPool* mPool = nullptr;
+	};
+}
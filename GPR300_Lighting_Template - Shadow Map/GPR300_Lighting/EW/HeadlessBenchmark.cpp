@@ -0,0 +1,598 @@
+//Author: Eric Winebrenner
+
+#include "HeadlessBenchmark.h"
+#include "GLState.h"
+#include "TransformBatch.h"
+#include "SceneGraph.h"
+#include "BVH.h"
+#include "MultiDrawBatch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+namespace ew {
+	void followBenchmarkPath(Camera& camera, float time)
+	{
+		const float radius = 6.0f;
+		float angle = time * 0.5f;
+		glm::vec3 position = glm::vec3(cosf(angle) * radius, 1.5f + sinf(time * 0.3f) * 1.5f, sinf(angle) * radius);
+		camera.setPosition(position);
+		//Inverse of Camera::getForward()
+		glm::vec3 forward = glm::normalize(-position);
+		camera.setYaw(glm::degrees(atan2f(forward.z, forward.x)));
+		camera.setPitch(glm::degrees(asinf(forward.y)));
+	}
+
+	static float randomRange(float low, float high)
+	{
+		return low + (high - low) * ((float)rand() / RAND_MAX);
+	}
+
+	void benchmarkNormalMatrix(Shader& shader, uint32_t inverseMask, UniformHandle modelUniform, UniformHandle normalMatrixUniform,
+		const std::vector<Mesh*>& meshes, int drawsPerMesh)
+	{
+		const int numFrames = 30;
+		const int targetSize = 64;
+		const char* scopeNames[2] = { "inverse() per vertex", "_NormalMatrix" };
+		uint32_t previousMask = shader.getVariant();
+		uint32_t masks[2] = { inverseMask, previousMask };
+		if (meshes.empty() || drawsPerMesh <= 0) {
+			return;
+		}
+		//The variant may compile in the background, it has to be ready before anything is timed
+		while (shader.getVariant() != inverseMask) {
+			shader.selectVariant(inverseMask);
+		}
+
+		GLint framebuffer;
+		glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+		OffscreenTarget target;
+		target.create(targetSize, targetSize);
+		GLState& state = GLState::get();
+		GLint viewport[4];
+		state.getViewport(viewport);
+		state.viewport(0, 0, targetSize, targetSize);
+
+		//Rotated and squashed, so the inverse has real work to do. Identity view and projection keep them on screen.
+		int numDraws = drawsPerMesh * (int)meshes.size();
+		std::vector<glm::mat4> models(numDraws);
+		std::vector<glm::mat3> normalMatrices(numDraws);
+		for (int i = 0; i < numDraws; i++) {
+			glm::vec3 position = glm::vec3(randomRange(-0.8f, 0.8f), randomRange(-0.8f, 0.8f), randomRange(-0.5f, 0.5f));
+			glm::vec3 axis = glm::normalize(glm::vec3(randomRange(-1.0f, 1.0f), randomRange(-1.0f, 1.0f), 1.0f));
+			glm::vec3 scale = glm::vec3(randomRange(0.05f, 0.2f), randomRange(0.05f, 0.2f), randomRange(0.05f, 0.2f));
+			models[i] = glm::scale(glm::rotate(glm::translate(glm::mat4(1), position), randomRange(0.0f, 6.28f), axis), scale);
+			normalMatrices[i] = glm::transpose(glm::inverse(glm::mat3(models[i])));
+		}
+
+		Profiler& profiler = Profiler::get();
+		for (int frame = 0; frame < numFrames; frame++) {
+			profiler.beginFrame();
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			for (int run = 0; run < 2; run++) {
+				shader.selectVariant(masks[run]);
+				shader.use();
+				shader.setMat4("_View", glm::mat4(1));
+				shader.setMat4("_Projection", glm::mat4(1));
+				ProfileScope scope(scopeNames[run]);
+				for (int i = 0; i < numDraws; i++) {
+					shader.setMat4(modelUniform, models[i]);
+					shader.setMat3(normalMatrixUniform, normalMatrices[i]);
+					meshes[i % meshes.size()]->draw();
+				}
+			}
+			profiler.endFrame();
+		}
+		profiler.flush();
+
+		long long verticesPerFrame = 0;
+		for (Mesh* mesh : meshes) {
+			verticesPerFrame += (long long)mesh->getNumVertices() * drawsPerMesh;
+		}
+		double runMs[2] = { 0.0, 0.0 };
+		for (int node = 0; node < profiler.getNumNodes(); node++) {
+			for (int run = 0; run < 2; run++) {
+				if (profiler.getNodeParent(node) == -1 && profiler.getNodeName(node) == scopeNames[run]) {
+					runMs[run] = profiler.getGpuStats(node).p50;
+				}
+			}
+		}
+		printf("%d draws, %lld vertices per run\n", numDraws, verticesPerFrame);
+		printf("%-24s %12s %16s\n", "normal matrix", "GPU ms", "Mvertices/s");
+		for (int run = 0; run < 2; run++) {
+			printf("%-24s %12.3f %16.1f\n", scopeNames[run], runMs[run], runMs[run] > 0.0 ? verticesPerFrame / (runMs[run] * 1000.0) : 0.0);
+		}
+		if (runMs[1] > 0.0) {
+			printf("speedup %.2fx\n", runMs[0] / runMs[1]);
+		}
+
+		shader.selectVariant(previousMask);
+		state.viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+		glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	}
+
+	void benchmarkTransformBatch(const std::vector<int>& counts)
+	{
+		using Clock = std::chrono::steady_clock;
+		printf("%10s %14s %14s %9s %11s\n", "transforms", "per object ms", "batch ms", "speedup", "max error");
+		for (int count : counts) {
+			std::vector<Transform> transforms(count);
+			TransformBatch batch;
+			for (Transform& transform : transforms) {
+				transform.position = glm::vec3(randomRange(-100, 100), randomRange(-100, 100), randomRange(-100, 100));
+				transform.rotation = glm::vec3(randomRange(-6.28f, 6.28f), randomRange(-6.28f, 6.28f), randomRange(-6.28f, 6.28f));
+				transform.scale = glm::vec3(randomRange(0.1f, 4.0f), randomRange(0.1f, 4.0f), randomRange(0.1f, 4.0f));
+				batch.add(transform);
+			}
+
+			//Enough repetitions for about 10M transforms per path
+			int repetitions = std::max(10000000 / count, 3);
+			std::vector<glm::mat4> modelMatrices(count);
+			std::vector<glm::mat3> normalMatrices(count);
+
+			auto startTime = Clock::now();
+			for (int rep = 0; rep < repetitions; rep++) {
+				for (int i = 0; i < count; i++) {
+					modelMatrices[i] = transforms[i].getModelMatrix();
+					normalMatrices[i] = transforms[i].getNormalMatrix();
+				}
+			}
+			double perObjectMs = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count() / repetitions;
+
+			startTime = Clock::now();
+			for (int rep = 0; rep < repetitions; rep++) {
+				batch.update();
+			}
+			double batchMs = std::chrono::duration<double, std::milli>(Clock::now() - startTime).count() / repetitions;
+
+			//Relative to the largest element, since translation dwarfs the rotation terms
+			float maxError = 0.0f;
+			for (int i = 0; i < count; i++) {
+				const glm::mat4& expected = modelMatrices[i];
+				const glm::mat4& actual = batch.getModelMatrix(i);
+				float magnitude = 1.0f;
+				float error = 0.0f;
+				for (int c = 0; c < 4; c++) {
+					for (int r = 0; r < 4; r++) {
+						magnitude = std::max(magnitude, fabsf(expected[c][r]));
+						error = std::max(error, fabsf(expected[c][r] - actual[c][r]));
+					}
+				}
+				maxError = std::max(maxError, error / magnitude);
+				for (int c = 0; c < 3; c++) {
+					for (int r = 0; r < 3; r++) {
+						float normalMagnitude = std::max(1.0f, fabsf(normalMatrices[i][c][r]));
+						maxError = std::max(maxError, fabsf(normalMatrices[i][c][r] - batch.getNormalMatrix(i)[c][r]) / normalMagnitude);
+					}
+				}
+			}
+			printf("%10d %14.3f %14.3f %8.1fx %11.2e\n", count, perObjectMs, batchMs, perObjectMs / batchMs, maxError);
+		}
+	}
+
+	void benchmarkSceneGraph()
+	{
+		using Clock = std::chrono::steady_clock;
+		const int numChains = 100;
+		const int chainDepth = 1000;
+
+		//Chains are the worst case for depth: changing a node near the top moves everything below it
+		SceneGraph scene;
+		std::vector<int> chainNodes;
+		Transform link;
+		link.position = glm::vec3(0.0f, 0.1f, 0.0f);
+		link.rotation = glm::vec3(0.01f, 0.02f, 0.0f);
+		for (int chain = 0; chain < numChains; chain++) {
+			int parent = -1;
+			for (int depth = 0; depth < chainDepth; depth++) {
+				parent = scene.addNode(link, parent);
+				chainNodes.push_back(parent);
+			}
+		}
+		scene.update();
+
+		struct Case {
+			const char* name;
+			int depth;
+			int numChains;
+		};
+		const Case cases[] = {
+			{ "nothing changed", 0, 0 },
+			{ "1 leaf", chainDepth - 1, 1 },
+			{ "100 leaves", chainDepth - 1, numChains },
+			{ "1 root", 0, 1 },
+			{ "100 mid-chain nodes", chainDepth / 2, numChains },
+			{ "every root", 0, numChains },
+		};
+
+		printf("%d nodes, %d chains %d deep\n", scene.getNumNodes(), numChains, chainDepth);
+		printf("%22s %10s %12s %14s\n", "changed", "updated", "update ms", "ns per update");
+		const int repetitions = 200;
+		for (const Case& benchmark : cases) {
+			int numUpdated = 0;
+			double totalMs = 0.0;
+			for (int rep = 0; rep < repetitions; rep++) {
+				for (int chain = 0; chain < benchmark.numChains; chain++) {
+					int node = chainNodes[chain * chainDepth + benchmark.depth];
+					Transform local = scene.getLocalTransform(node);
+					local.rotation.z += 0.001f;
+					scene.setLocalTransform(node, local);
+				}
+				auto startTime = Clock::now();
+				numUpdated = scene.update();
+				totalMs += std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+			}
+			double averageMs = totalMs / repetitions;
+			printf("%22s %10d %12.4f %14.1f\n", benchmark.name, numUpdated, averageMs, numUpdated > 0 ? averageMs * 1e6 / numUpdated : 0.0);
+		}
+	}
+
+	void benchmarkBVH(const std::vector<int>& objectCounts)
+	{
+		using Clock = std::chrono::steady_clock;
+		auto millisecondsSince = [](Clock::time_point startTime) {
+			return std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+		};
+		const int numRays = 256;
+		const int numSpheres = 256;
+
+		for (int count : objectCounts) {
+			//The world grows with the object count so density, and how much each query touches, stays the same
+			float worldSize = 4.0f * cbrtf((float)count);
+			std::vector<AABB> boxes(count);
+			for (AABB& box : boxes) {
+				glm::vec3 center = glm::vec3(randomRange(-worldSize, worldSize), randomRange(-worldSize, worldSize), randomRange(-worldSize, worldSize));
+				glm::vec3 extents = glm::vec3(randomRange(0.25f, 1.0f), randomRange(0.25f, 1.0f), randomRange(0.25f, 1.0f));
+				box = { center - extents, center + extents };
+			}
+
+			BVH bvh;
+			auto startTime = Clock::now();
+			bvh.build(boxes);
+			double buildMs = millisecondsSince(startTime);
+
+			//Moving 1% of objects a little, like a frame of animation
+			int numMoved = std::max(count / 100, 1);
+			startTime = Clock::now();
+			for (int i = 0; i < numMoved; i++) {
+				int object = std::min((int)randomRange(0.0f, (float)count), count - 1);
+				glm::vec3 offset = glm::vec3(randomRange(-0.5f, 0.5f), randomRange(-0.5f, 0.5f), randomRange(-0.5f, 0.5f));
+				boxes[object].min += offset;
+				boxes[object].max += offset;
+				bvh.setObjectBounds(object, boxes[object]);
+			}
+			int numRefit = bvh.refit();
+			double refitMs = millisecondsSince(startTime);
+
+			printf("%d objects: %d nodes, build %.2f ms, moving %d objects refit %d nodes in %.3f ms\n",
+				count, bvh.getNumNodes(), buildMs, numMoved, numRefit, refitMs);
+			printf("%24s %10s %12s %12s %9s %8s\n", "query", "results", "bvh ms", "brute ms", "speedup", "match");
+
+			//Frustum from the middle of the world looking down -Z
+			glm::mat4 projection = glm::perspective(glm::radians(60.0f), 16.0f / 9.0f, 0.1f, worldSize);
+			Frustum frustum(projection * glm::lookAt(glm::vec3(0), glm::vec3(0, 0, -1), glm::vec3(0, 1, 0)));
+			std::vector<int> bvhResults, bruteResults;
+			startTime = Clock::now();
+			bvh.queryFrustum(frustum, bvhResults);
+			double bvhMs = millisecondsSince(startTime);
+			startTime = Clock::now();
+			for (int object = 0; object < count; object++) {
+				if (classifyBox(frustum, boxes[object]) != BOX_OUTSIDE) {
+					bruteResults.push_back(object);
+				}
+			}
+			double bruteMs = millisecondsSince(startTime);
+			std::sort(bvhResults.begin(), bvhResults.end());
+			printf("%24s %10d %12.3f %12.3f %8.1fx %8s\n", "frustum", (int)bvhResults.size(), bvhMs, bruteMs, bruteMs / bvhMs, bvhResults == bruteResults ? "yes" : "NO");
+
+			std::vector<glm::vec3> origins(numRays), directions(numRays);
+			for (int i = 0; i < numRays; i++) {
+				origins[i] = glm::vec3(randomRange(-worldSize, worldSize), randomRange(-worldSize, worldSize), randomRange(-worldSize, worldSize));
+				directions[i] = glm::normalize(glm::vec3(randomRange(-1, 1), randomRange(-1, 1), randomRange(-1, 1)) + glm::vec3(0.0f, 0.0f, 1e-3f));
+			}
+			std::vector<float> bvhDistances(numRays), bruteDistances(numRays, INFINITY);
+			int numHits = 0;
+			startTime = Clock::now();
+			for (int i = 0; i < numRays; i++) {
+				numHits += bvh.raycast(origins[i], directions[i], &bvhDistances[i]) >= 0;
+			}
+			bvhMs = millisecondsSince(startTime);
+			startTime = Clock::now();
+			for (int i = 0; i < numRays; i++) {
+				glm::vec3 inverseDirection = 1.0f / directions[i];
+				for (int object = 0; object < count; object++) {
+					bruteDistances[i] = std::min(bruteDistances[i], rayEnterDistance(origins[i], inverseDirection, boxes[object]));
+				}
+			}
+			bruteMs = millisecondsSince(startTime);
+			char label[64];
+			snprintf(label, sizeof(label), "%d rays", numRays);
+			printf("%24s %10d %12.3f %12.3f %8.1fx %8s\n", label, numHits, bvhMs, bruteMs, bruteMs / bvhMs, bvhDistances == bruteDistances ? "yes" : "NO");
+
+			//Spheres the size of a light's reach
+			int numBvhOverlaps = 0, numBruteOverlaps = 0;
+			std::vector<int> overlaps;
+			startTime = Clock::now();
+			for (int i = 0; i < numSpheres; i++) {
+				overlaps.clear();
+				bvh.querySphere(origins[i], 5.0f, overlaps);
+				numBvhOverlaps += (int)overlaps.size();
+			}
+			bvhMs = millisecondsSince(startTime);
+			startTime = Clock::now();
+			for (int i = 0; i < numSpheres; i++) {
+				for (int object = 0; object < count; object++) {
+					numBruteOverlaps += sphereTouchesBox(origins[i], 5.0f, boxes[object]);
+				}
+			}
+			bruteMs = millisecondsSince(startTime);
+			snprintf(label, sizeof(label), "%d light spheres", numSpheres);
+			printf("%24s %10d %12.3f %12.3f %8.1fx %8s\n\n", label, numBvhOverlaps, bvhMs, bruteMs, bruteMs / bvhMs, numBvhOverlaps == numBruteOverlaps ? "yes" : "NO");
+		}
+	}
+
+	void benchmarkMultiDraw(Shader& shader, uint32_t multiDrawMask, UniformHandle modelUniform, const std::vector<Mesh*>& meshes, const std::vector<int>& objectCounts)
+	{
+		using Clock = std::chrono::steady_clock;
+		auto millisecondsSince = [](Clock::time_point startTime) {
+			return std::chrono::duration<double, std::milli>(Clock::now() - startTime).count();
+		};
+		const int numFrames = 20;
+		if (meshes.empty()) {
+			return;
+		}
+		uint32_t previousMask = shader.getVariant();
+		//The variant may compile in the background, it has to be ready before anything is timed
+		while (shader.getVariant() != multiDrawMask) {
+			shader.selectVariant(multiDrawMask);
+		}
+		shader.selectVariant(previousMask);
+		//Tiny viewport, the GPU's share of the work isn't what's being measured
+		GLint viewport[4];
+		GLState::get().getViewport(viewport);
+		GLState::get().viewport(0, 0, 64, 64);
+
+		MultiDrawBatch batch(meshes[0]->getPool());
+		printf("%10s %18s %18s %9s\n", "objects", "per object ms", "multi-draw ms", "speedup");
+		for (int count : objectCounts) {
+			//Random small shapes in front of the camera, a different mesh for each neighbour
+			std::vector<glm::mat4> models(count);
+			std::vector<Mesh*> objectMeshes(count);
+			for (int i = 0; i < count; i++) {
+				glm::vec3 position = glm::vec3(randomRange(-1.0f, 1.0f), randomRange(-1.0f, 1.0f), randomRange(-1.0f, 1.0f));
+				models[i] = glm::scale(glm::translate(glm::mat4(1), position), glm::vec3(0.01f));
+				objectMeshes[i] = meshes[i % meshes.size()];
+			}
+
+			//Frames are finished outside the timed part, only submission counts
+			double perObjectMs = 0.0;
+			shader.selectVariant(previousMask);
+			shader.use();
+			for (int frame = 0; frame < numFrames; frame++) {
+				auto startTime = Clock::now();
+				for (int i = 0; i < count; i++) {
+					shader.setMat4(modelUniform, models[i]);
+					objectMeshes[i]->draw();
+				}
+				perObjectMs += millisecondsSince(startTime);
+				glFinish();
+			}
+
+			//Building the batch is part of the submission cost, the matrices would change every frame
+			double multiDrawMs = 0.0;
+			shader.selectVariant(multiDrawMask);
+			shader.use();
+			for (int frame = 0; frame < numFrames; frame++) {
+				auto startTime = Clock::now();
+				batch.clear();
+				for (int i = 0; i < count; i++) {
+					//Uniform scale, so the model's rotation is a good enough normal matrix
+					batch.add(*objectMeshes[i], models[i], glm::mat3(models[i]));
+				}
+				batch.upload();
+				batch.draw();
+				multiDrawMs += millisecondsSince(startTime);
+				glFinish();
+			}
+			perObjectMs /= numFrames;
+			multiDrawMs /= numFrames;
+			printf("%10d %18.3f %18.3f %8.1fx\n", count, perObjectMs, multiDrawMs, perObjectMs / multiDrawMs);
+		}
+
+		shader.selectVariant(previousMask);
+		GLState::get().viewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	}
+
+	//What every setter did before locations were cached: copy the name, look it up, then set it on the bound program
+	static void setMat4ByLookup(GLuint program, std::string name, const glm::mat4& value)
+	{
+		glUniformMatrix4fv(glGetUniformLocation(program, name.c_str()), 1, false, glm::value_ptr(value));
+	}
+
+	void benchmarkUniformSetters(Shader& shader, const std::vector<std::string>& mat4Names, int numIterations)
+	{
+		using Clock = std::chrono::steady_clock;
+		auto nanosecondsPerCall = [&](Clock::time_point startTime) {
+			double totalNs = std::chrono::duration<double, std::nano>(Clock::now() - startTime).count();
+			return totalNs / ((double)numIterations * mat4Names.size());
+		};
+		if (mat4Names.empty() || numIterations <= 0) {
+			return;
+		}
+		std::vector<UniformHandle> handles;
+		for (const std::string& name : mat4Names) {
+			handles.push_back(shader.getUniform(name));
+		}
+		shader.use();
+		GLuint program = GLState::get().getProgram();
+		glm::mat4 value = glm::mat4(1);
+		//Settles anything the driver does on first use before timing starts
+		for (const std::string& name : mat4Names) {
+			setMat4ByLookup(program, name, value);
+		}
+		glFinish();
+
+		//Value changes each call so no driver can skip a repeat
+		auto startTime = Clock::now();
+		for (int i = 0; i < numIterations; i++) {
+			value[3][0] = (float)i;
+			for (const std::string& name : mat4Names) {
+				setMat4ByLookup(program, name, value);
+			}
+		}
+		double lookupNs = nanosecondsPerCall(startTime);
+		glFinish();
+
+		startTime = Clock::now();
+		for (int i = 0; i < numIterations; i++) {
+			value[3][0] = (float)i;
+			for (const std::string& name : mat4Names) {
+				shader.setMat4(std::string_view(name), value);
+			}
+		}
+		double nameNs = nanosecondsPerCall(startTime);
+		glFinish();
+
+		startTime = Clock::now();
+		for (int i = 0; i < numIterations; i++) {
+			value[3][0] = (float)i;
+			for (UniformHandle handle : handles) {
+				shader.setMat4(handle, value);
+			}
+		}
+		double handleNs = nanosecondsPerCall(startTime);
+		glFinish();
+
+		printf("%-32s %12s %9s\n", "setter", "ns per call", "speedup");
+		printf("%-32s %12.1f %8.1fx\n", "glGetUniformLocation each call", lookupNs, 1.0);
+		printf("%-32s %12.1f %8.1fx\n", "string_view, cached location", nameNs, lookupNs / nameNs);
+		printf("%-32s %12.1f %8.1fx\n", "UniformHandle", handleNs, lookupNs / handleNs);
+	}
+
+	OffscreenTarget::~OffscreenTarget()
+	{
+		glDeleteFramebuffers(1, &mFBO);
+		glDeleteRenderbuffers(1, &mColor);
+		glDeleteRenderbuffers(1, &mDepth);
+	}
+
+	void OffscreenTarget::create(int width, int height)
+	{
+		glGenFramebuffers(1, &mFBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+		glGenRenderbuffers(1, &mColor);
+		glBindRenderbuffer(GL_RENDERBUFFER, mColor);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColor);
+		glGenRenderbuffers(1, &mDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, mDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, mDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+		GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (fboStatus != GL_FRAMEBUFFER_COMPLETE) {
+			printf("Offscreen framebuffer incomplete: 0x%x\n", fboStatus);
+		}
+	}
+
+	FrameRecorder::~FrameRecorder()
+	{
+		if (mProfiler != nullptr) {
+			mProfiler->setFrameCallback(nullptr);
+		}
+	}
+
+	void FrameRecorder::attach(Profiler& profiler, int warmupFrames)
+	{
+		mProfiler = &profiler;
+		mFirstFrame = profiler.getFrameNumber() + warmupFrames;
+		profiler.setFrameCallback([this](const ProfileFrame& frame) { record(frame); });
+	}
+
+	int FrameRecorder::findPass(const std::string& name)
+	{
+		for (int i = 0; i < (int)mPassNames.size(); i++) {
+			if (mPassNames[i] == name) {
+				return i;
+			}
+		}
+		mPassNames.push_back(name);
+		mPassGpuMs.push_back({});
+		return (int)mPassNames.size() - 1;
+	}
+
+	void FrameRecorder::record(const ProfileFrame& frame)
+	{
+		if (frame.frameNumber < mFirstFrame) {
+			return;
+		}
+		mCpuFrameMs.push_back(frame.cpuMs);
+		mGpuFrameMs.push_back(frame.gpuMs);
+		//One sample per pass per frame, summed if the scope ran more than once
+		std::vector<double> passMs(mPassNames.size(), -1.0);
+		for (const ProfileSample& sample : frame.samples) {
+			std::string name = mProfiler->getNodeName(sample.node);
+			for (int parent = mProfiler->getNodeParent(sample.node); parent >= 0; parent = mProfiler->getNodeParent(parent)) {
+				name = mProfiler->getNodeName(parent) + "/" + name;
+			}
+			int pass = findPass(name);
+			passMs.resize(mPassNames.size(), -1.0);
+			passMs[pass] = std::max(passMs[pass], 0.0) + sample.gpuMs;
+		}
+		for (int i = 0; i < (int)passMs.size(); i++) {
+			if (passMs[i] >= 0.0) {
+				mPassGpuMs[i].push_back(passMs[i]);
+			}
+		}
+	}
+
+	static void printStatsJson(FILE* file, const std::vector<double>& samples)
+	{
+		if (samples.empty()) {
+			fprintf(file, "null");
+			return;
+		}
+		ProfileStats stats = computeStats(samples);
+		fprintf(file, "{ \"mean\": %.4f, \"min\": %.4f, \"p50\": %.4f, \"p90\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }",
+			stats.mean, stats.min, stats.p50, stats.p90, stats.p95, stats.p99, stats.max);
+	}
+
+	//Driver strings go in as JSON strings, so quotes and backslashes are escaped
+	static void printStringJson(FILE* file, const char* text)
+	{
+		fputc('"', file);
+		for (const char* c = text != NULL ? text : ""; *c != '\0'; c++) {
+			if (*c == '"' || *c == '\\') {
+				fputc('\\', file);
+			}
+			fputc(*c, file);
+		}
+		fputc('"', file);
+	}
+
+	void FrameRecorder::printJson(FILE* file, const char* benchmarkName, int width, int height)const
+	{
+		fprintf(file, "{\n  \"benchmark\": ");
+		printStringJson(file, benchmarkName);
+		fprintf(file, ",\n  \"renderer\": ");
+		printStringJson(file, (const char*)glGetString(GL_RENDERER));
+		fprintf(file, ",\n  \"version\": ");
+		printStringJson(file, (const char*)glGetString(GL_VERSION));
+		fprintf(file, ",\n  \"frames\": %d,\n  \"width\": %d,\n  \"height\": %d,\n", (int)mCpuFrameMs.size(), width, height);
+		fprintf(file, "  \"cpu_frame_ms\": ");
+		printStatsJson(file, mCpuFrameMs);
+		fprintf(file, ",\n  \"gpu_frame_ms\": ");
+		printStatsJson(file, mGpuFrameMs);
+		fprintf(file, ",\n  \"gpu_pass_ms\": {");
+		for (int i = 0; i < (int)mPassNames.size(); i++) {
+			fprintf(file, "%s\n    ", i > 0 ? "," : "");
+			printStringJson(file, mPassNames[i].c_str());
+			fprintf(file, ": ");
+			printStatsJson(file, mPassGpuMs[i]);
+		}
+		fprintf(file, "\n  }\n}\n");
+	}
+}
@@ -0,0 +1,105 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <glm/glm.hpp>
+#include <cstddef>
+
+namespace ew {
+	//Binding points shared by every program that declares these blocks
+	const unsigned int LIGHT_BLOCK_BINDING = 0;
+	const unsigned int MATERIAL_BLOCK_BINDING = 1;
+	const int MAX_LIGHTS = 8;
+
+	/// <summary>
+	/// std140 mirrors of the structs in defaultLit.frag.
+	/// vec3s are padded to 16 bytes, so each is followed by a float to fill the gap.
+	/// </summary>
+	struct DirLightData {
+		glm::vec3 color = glm::vec3(1);
+		float intensity = 0;
+		glm::vec3 direction = glm::vec3(0, -1, 0);
+		float _pad0 = 0;
+	};
+	static_assert(offsetof(DirLightData, color) == 0, "std140 mismatch");
+	static_assert(offsetof(DirLightData, intensity) == 12, "std140 mismatch");
+	static_assert(offsetof(DirLightData, direction) == 16, "std140 mismatch");
+	static_assert(sizeof(DirLightData) == 32, "std140 mismatch");
+
+	struct PtLightData {
+		glm::vec3 color = glm::vec3(1);
+		float intensity = 0;
+		glm::vec3 position = glm::vec3(0);
+		float linearAtt = 10;
+	};
+	static_assert(offsetof(PtLightData, color) == 0, "std140 mismatch");
+	static_assert(offsetof(PtLightData, intensity) == 12, "std140 mismatch");
+	static_assert(offsetof(PtLightData, position) == 16, "std140 mismatch");
+	static_assert(offsetof(PtLightData, linearAtt) == 28, "std140 mismatch");
+	static_assert(sizeof(PtLightData) == 32, "std140 mismatch");
+
+	struct SpLightData {
+		glm::vec3 color = glm::vec3(1);
+		float intensity = 0;
+		glm::vec3 position = glm::vec3(0);
+		float linearAtt = 10;
+		glm::vec3 direction = glm::vec3(0, -1, 0);
+		//Cosines of the cone angles, not degrees
+		float minAngle = 0;
+		float maxAngle = 0;
+		float falloffCurve = 1;
+		float _pad0 = 0;
+		float _pad1 = 0;
+	};
+	static_assert(offsetof(SpLightData, color) == 0, "std140 mismatch");
+	static_assert(offsetof(SpLightData, intensity) == 12, "std140 mismatch");
+	static_assert(offsetof(SpLightData, position) == 16, "std140 mismatch");
+	static_assert(offsetof(SpLightData, linearAtt) == 28, "std140 mismatch");
+	static_assert(offsetof(SpLightData, direction) == 32, "std140 mismatch");
+	static_assert(offsetof(SpLightData, minAngle) == 44, "std140 mismatch");
+	static_assert(offsetof(SpLightData, maxAngle) == 48, "std140 mismatch");
+	static_assert(offsetof(SpLightData, falloffCurve) == 52, "std140 mismatch");
+	static_assert(sizeof(SpLightData) == 64, "std140 mismatch");
+
+	struct MaterialData {
+		glm::vec3 color = glm::vec3(1);
+		float ambientK = 0;
+		float diffuseK = 0;
+		float specularK = 0;
+		float shininess = 1;
+		float _pad0 = 0;
+	};
+	static_assert(offsetof(MaterialData, color) == 0, "std140 mismatch");
+	static_assert(offsetof(MaterialData, ambientK) == 12, "std140 mismatch");
+	static_assert(offsetof(MaterialData, diffuseK) == 16, "std140 mismatch");
+	static_assert(offsetof(MaterialData, specularK) == 20, "std140 mismatch");
+	static_assert(offsetof(MaterialData, shininess) == 24, "std140 mismatch");
+	static_assert(sizeof(MaterialData) == 32, "std140 mismatch");
+
+	/// <summary>
+	/// Matches "uniform LightBlock" in defaultLit.frag. Uploaded once per frame.
+	/// </summary>
+	struct LightBlock {
+		DirLightData dirLights[MAX_LIGHTS];
+		PtLightData ptLights[MAX_LIGHTS];
+		SpLightData spLights[MAX_LIGHTS];
+		int numDirLights = 0;
+		int numPtLights = 0;
+		int numSpLights = 0;
+		int _pad0 = 0;
+	};
+	static_assert(offsetof(LightBlock, dirLights) == 0, "std140 mismatch");
+	static_assert(offsetof(LightBlock, ptLights) == 256, "std140 mismatch");
+	static_assert(offsetof(LightBlock, spLights) == 512, "std140 mismatch");
+	static_assert(offsetof(LightBlock, numDirLights) == 1024, "std140 mismatch");
+	static_assert(offsetof(LightBlock, numPtLights) == 1028, "std140 mismatch");
+	static_assert(offsetof(LightBlock, numSpLights) == 1032, "std140 mismatch");
+	static_assert(sizeof(LightBlock) == 1040, "std140 mismatch");
+
+	/// <summary>
+	/// Matches "uniform MaterialBlock" in defaultLit.frag.
+	/// </summary>
+	struct MaterialBlock {
+		MaterialData material;
+	};
+	static_assert(sizeof(MaterialBlock) == 32, "std140 mismatch");
+}
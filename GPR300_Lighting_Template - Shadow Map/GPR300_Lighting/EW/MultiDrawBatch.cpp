@@ -0,0 +1,82 @@
+//Author: Eric Winebrenner
+
+#include "MultiDrawBatch.h"
+#include "GLState.h"
+#include "Profiler.h"
+#include <cstdio>
+
+namespace ew {
+	MultiDrawBatch::MultiDrawBatch(GeometryPool* pool)
+		: mPool(pool)
+	{
+		glGenBuffers(1, &mCommandBuffer);
+		glGenBuffers(1, &mObjectBuffer);
+		glGenBuffers(1, &mBoundsBuffer);
+	}
+
+	MultiDrawBatch::~MultiDrawBatch()
+	{
+		glDeleteBuffers(1, &mCommandBuffer);
+		glDeleteBuffers(1, &mObjectBuffer);
+		glDeleteBuffers(1, &mBoundsBuffer);
+	}
+
+	void MultiDrawBatch::clear()
+	{
+		mCommands.clear();
+		mObjects.clear();
+		mBounds.clear();
+	}
+
+	void MultiDrawBatch::add(const Mesh& mesh, const glm::mat4& model, const glm::mat3& normalMatrix, uint32_t materialIndex)
+	{
+		if (mesh.getPool() != mPool) {
+			printf("MultiDrawBatch: mesh isn't in this batch's geometry pool\n");
+			return;
+		}
+		const GeometryAllocation& allocation = mesh.getAllocation();
+		mCommands.push_back({ allocation.numIndices, 1, allocation.firstIndex, (GLint)allocation.firstVertex, 0 });
+
+		ObjectData object;
+		object.model = model;
+		for (int i = 0; i < 3; i++) {
+			object.normalMatrix[i] = glm::vec4(normalMatrix[i], 0.0f);
+		}
+		object.materialIndex = materialIndex;
+		mObjects.push_back(object);
+
+		const Bounds& bounds = mesh.getBounds();
+		mBounds.push_back({ glm::vec4(bounds.getCenter(), 0.0f), glm::vec4(bounds.getExtents(), 0.0f) });
+	}
+
+	//The buffers are respecified every upload, so the driver can hand out fresh storage
+	//instead of waiting for draws still reading the last frame's
+	void MultiDrawBatch::upload()
+	{
+		ProfileScope scope("BatchUpload");
+		mNumUploaded = (GLsizei)mCommands.size();
+		if (mNumUploaded == 0) {
+			return;
+		}
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+		glBufferData(GL_DRAW_INDIRECT_BUFFER, mCommands.size() * sizeof(DrawElementsIndirectCommand), mCommands.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mObjectBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, mObjects.size() * sizeof(ObjectData), mObjects.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mBoundsBuffer);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, mBounds.size() * sizeof(ObjectBounds), mBounds.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	}
+
+	void MultiDrawBatch::draw()
+	{
+		if (mNumUploaded == 0) {
+			return;
+		}
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, OBJECT_BUFFER_BINDING, mObjectBuffer);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBuffer);
+		mPool->bind();
+		glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0, mNumUploaded, 0);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+	}
+}
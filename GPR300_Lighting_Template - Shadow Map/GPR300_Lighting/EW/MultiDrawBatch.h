@@ -0,0 +1,90 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "Mesh.h"
+#include "GeometryPool.h"
+#include "Shader.h"
+
+namespace ew {
+	//Storage buffer binding of ObjectBlock in the MULTI_DRAW shader variants
+	const unsigned int OBJECT_BUFFER_BINDING = 0;
+
+	/// <summary>
+	/// Layout glMultiDrawElementsIndirect reads its commands in, fixed by the GL spec
+	/// </summary>
+	struct DrawElementsIndirectCommand {
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+	static_assert(sizeof(DrawElementsIndirectCommand) == 20, "indirect command mismatch");
+
+	/// <summary>
+	/// std430 mirror of ObjectData in defaultLit.vert and depthOnly.vert, read with gl_DrawID.
+	/// A mat3 is three vec4 columns in std430, so the normal matrix is stored padded.
+	/// </summary>
+	struct ObjectData {
+		glm::mat4 model;
+		glm::vec4 normalMatrix[3];
+		//For shaders that index a material array. The demos have a single material, so it's always 0 there.
+		uint32_t materialIndex;
+		uint32_t _pad0 = 0;
+		uint32_t _pad1 = 0;
+		uint32_t _pad2 = 0;
+	};
+	static_assert(offsetof(ObjectData, model) == 0, "std430 mismatch");
+	static_assert(offsetof(ObjectData, normalMatrix) == 64, "std430 mismatch");
+	static_assert(offsetof(ObjectData, materialIndex) == 112, "std430 mismatch");
+	static_assert(sizeof(ObjectData) == 128, "std430 mismatch");
+
+	/// <summary>
+	/// std430 mirror of ObjectBounds in cullObjects.comp. The mesh's box in its own space, w unused.
+	/// </summary>
+	struct ObjectBounds {
+		glm::vec4 center;
+		glm::vec4 extents;
+	};
+	static_assert(sizeof(ObjectBounds) == 32, "std430 mismatch");
+
+	/// <summary>
+	/// A pass's worth of draws submitted with one glMultiDrawElementsIndirect.
+	/// Each add() appends an indirect command for a pooled mesh and that object's data. Draw i reads ObjectData i,
+	/// so the shader finds its model matrix through gl_DrawID instead of a uniform set between draws.
+	/// Every mesh must come from the batch's GeometryPool, since one draw can only use one VAO.
+	/// </summary>
+	class MultiDrawBatch {
+	public:
+		MultiDrawBatch(GeometryPool* pool);
+		~MultiDrawBatch();
+		void clear();
+		void add(const Mesh& mesh, const glm::mat4& model, const glm::mat3& normalMatrix, uint32_t materialIndex = 0);
+		//Sends the commands and object data to the GPU. Call once after adding, then draw() as many times as needed.
+		void upload();
+		void draw();
+		inline int getNumDraws()const { return (int)mCommands.size(); }
+		//Buffers as of the last upload(), for GpuCuller
+		inline int getNumUploaded()const { return mNumUploaded; }
+		inline GLuint getCommandBuffer()const { return mCommandBuffer; }
+		inline GLuint getObjectBuffer()const { return mObjectBuffer; }
+		inline GLuint getBoundsBuffer()const { return mBoundsBuffer; }
+		inline GeometryPool* getPool()const { return mPool; }
+	private:
+		MultiDrawBatch(const MultiDrawBatch& r) = delete;
+		GeometryPool* mPool;
+		std::vector<DrawElementsIndirectCommand> mCommands;
+		std::vector<ObjectData> mObjects;
+		std::vector<ObjectBounds> mBounds;
+		GLuint mCommandBuffer = 0;
+		GLuint mObjectBuffer = 0;
+		GLuint mBoundsBuffer = 0;
+		//Draws in the buffers as of the last upload()
+		GLsizei mNumUploaded = 0;
+	};
+}
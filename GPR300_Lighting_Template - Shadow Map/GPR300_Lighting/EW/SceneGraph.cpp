@@ -0,0 +1,130 @@
+//Author: Eric Winebrenner
+
+#include "SceneGraph.h"
+#include "TransformBatch.h"
+#include "Profiler.h"
+#include <algorithm>
+
+namespace ew {
+	int SceneGraph::addNode(const Transform& localTransform, int parent)
+	{
+		int id = (int)mNodes.size();
+		int parentSlot = parent >= 0 ? mSlots[parent] : -1;
+		mNodes.push_back({ id, parent, parentSlot, id + 1, true, localTransform, glm::mat4(1), glm::mat3(1) });
+		mWorldMatrices.push_back(glm::mat4(1));
+		mWorldNormalMatrices.push_back(glm::mat3(1));
+		mSlots.push_back(id);
+		mDirtyNodes.push_back(id);
+		//A root appended at the end is still in depth first order, a child generally isn't
+		if (parent >= 0) {
+			mOrderDirty = true;
+		}
+		return id;
+	}
+
+	void SceneGraph::setLocalTransform(int node, const Transform& localTransform)
+	{
+		Node& data = mNodes[mSlots[node]];
+		data.local = localTransform;
+		if (!data.localDirty) {
+			data.localDirty = true;
+			mDirtyNodes.push_back(node);
+		}
+	}
+
+	//Rebuilds the depth first order. Matrices move with their nodes, so nothing needs recomputing afterwards.
+	void SceneGraph::sortNodes()
+	{
+		int numNodes = (int)mNodes.size();
+		std::vector<std::vector<int>> children(numNodes);
+		std::vector<int> stack;
+		for (int id = numNodes - 1; id >= 0; id--) {
+			int parent = mNodes[mSlots[id]].parent;
+			if (parent >= 0) {
+				children[parent].push_back(id);
+			}
+			else {
+				stack.push_back(id);
+			}
+		}
+
+		std::vector<Node> nodes;
+		std::vector<glm::mat4> worldMatrices;
+		std::vector<glm::mat3> worldNormalMatrices;
+		nodes.reserve(numNodes);
+		worldMatrices.reserve(numNodes);
+		worldNormalMatrices.reserve(numNodes);
+		std::vector<int> slots(numNodes);
+		while (!stack.empty()) {
+			int id = stack.back();
+			stack.pop_back();
+			int oldSlot = mSlots[id];
+			slots[id] = (int)nodes.size();
+			nodes.push_back(mNodes[oldSlot]);
+			worldMatrices.push_back(mWorldMatrices[oldSlot]);
+			worldNormalMatrices.push_back(mWorldNormalMatrices[oldSlot]);
+			//Children were added in reverse so they come back off the stack in id order
+			stack.insert(stack.end(), children[id].begin(), children[id].end());
+		}
+
+		//Parents come before children, so subtree sizes accumulate in one backwards pass
+		std::vector<int> subtreeSizes(numNodes, 1);
+		for (int slot = numNodes - 1; slot >= 0; slot--) {
+			Node& node = nodes[slot];
+			node.parentSlot = node.parent >= 0 ? slots[node.parent] : -1;
+			node.subtreeEnd = slot + subtreeSizes[slot];
+			if (node.parentSlot >= 0) {
+				subtreeSizes[node.parentSlot] += subtreeSizes[slot];
+			}
+		}
+
+		mNodes.swap(nodes);
+		mWorldMatrices.swap(worldMatrices);
+		mWorldNormalMatrices.swap(worldNormalMatrices);
+		mSlots.swap(slots);
+		mOrderDirty = false;
+	}
+
+	int SceneGraph::update()
+	{
+		ProfileScope scope("SceneGraph");
+		if (mOrderDirty) {
+			sortNodes();
+		}
+
+		//In slot order a dirty node's ancestors are visited first, so nested dirty nodes fall inside a range already done
+		for (int& node : mDirtyNodes) {
+			node = mSlots[node];
+		}
+		std::sort(mDirtyNodes.begin(), mDirtyNodes.end());
+
+		int numUpdated = 0;
+		int doneUntil = 0;
+		for (int dirtySlot : mDirtyNodes) {
+			if (dirtySlot < doneUntil) {
+				continue;
+			}
+			int end = mNodes[dirtySlot].subtreeEnd;
+			for (int slot = dirtySlot; slot < end; slot++) {
+				Node& node = mNodes[slot];
+				if (node.localDirty) {
+					computeTransformMatrices(node.local, node.localMatrix, node.localNormalMatrix);
+					node.localDirty = false;
+				}
+				//The normal matrix of a product is the product of the normal matrices
+				if (node.parentSlot < 0) {
+					mWorldMatrices[slot] = node.localMatrix;
+					mWorldNormalMatrices[slot] = node.localNormalMatrix;
+				}
+				else {
+					mWorldMatrices[slot] = mWorldMatrices[node.parentSlot] * node.localMatrix;
+					mWorldNormalMatrices[slot] = mWorldNormalMatrices[node.parentSlot] * node.localNormalMatrix;
+				}
+			}
+			numUpdated += end - dirtySlot;
+			doneUntil = end;
+		}
+		mDirtyNodes.clear();
+		return numUpdated;
+	}
+}
@@ -0,0 +1,169 @@
+//Author: Eric Winebrenner
+
+#include "ShadowCascades.h"
+#include "GLState.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <stdio.h>
+
+namespace ew {
+	ShadowCascades::ShadowCascades(const ShadowSettings& settings)
+		: mShadowUBO(sizeof(ShadowBlock), SHADOW_BLOCK_BINDING)
+	{
+		for (int i = 0; i < MAX_SHADOW_CASCADES; i++) {
+			mShadowBlock.viewProjections[i] = glm::mat4(1);
+		}
+		glGenFramebuffers(1, &mFBO);
+		setSettings(settings);
+	}
+
+	ShadowCascades::~ShadowCascades()
+	{
+		deleteDepthArray();
+		glDeleteFramebuffers(1, &mFBO);
+	}
+
+	void ShadowCascades::setSettings(const ShadowSettings& settings)
+	{
+		mSettings = settings;
+		mSettings.numCascades = glm::clamp(mSettings.numCascades, 1, MAX_SHADOW_CASCADES);
+		if (mSettings.numCascades != mAllocatedCascades || mSettings.resolution != mAllocatedResolution) {
+			deleteDepthArray();
+			createDepthArray();
+		}
+	}
+
+	void ShadowCascades::createDepthArray()
+	{
+		glGenTextures(1, &mDepthArray);
+		GLState::get().bindTexture(GL_TEXTURE_2D_ARRAY, mDepthArray);
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, mSettings.resolution, mSettings.resolution, mSettings.numCascades);
+
+		//Linear filtering + compare mode = 2x2 hardware PCF per tap
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+		//Anything outside the map is lit
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+		float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+		glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+
+		glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mDepthArray, 0, 0);
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+		GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+		if (fboStatus != GL_FRAMEBUFFER_COMPLETE) {
+			printf("Shadow cascade framebuffer incomplete: 0x%x\n", fboStatus);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+		mAllocatedCascades = mSettings.numCascades;
+		mAllocatedResolution = mSettings.resolution;
+	}
+
+	void ShadowCascades::deleteDepthArray()
+	{
+		if (mDepthArray != 0) {
+			GLState::get().forgetTexture(mDepthArray);
+			glDeleteTextures(1, &mDepthArray);
+			mDepthArray = 0;
+		}
+	}
+
+	void ShadowCascades::update(Camera& camera, const glm::vec3& lightDirection)
+	{
+		int numCascades = mSettings.numCascades;
+		float nearPlane = camera.getNearPlane();
+		float farPlane = std::min(camera.getFarPlane(), mSettings.maxDistance);
+
+		//Practical split scheme: blend logarithmic and uniform splits
+		float splits[MAX_SHADOW_CASCADES + 1];
+		splits[0] = nearPlane;
+		for (int i = 1; i <= numCascades; i++) {
+			float p = (float)i / numCascades;
+			float logSplit = nearPlane * powf(farPlane / nearPlane, p);
+			float uniformSplit = nearPlane + (farPlane - nearPlane) * p;
+			splits[i] = mSettings.splitLambda * logSplit + (1.0f - mSettings.splitLambda) * uniformSplit;
+		}
+
+		//View-space half extents per unit depth (perspective) or constant (ortho)
+		float tanHalfY = tanf(glm::radians(camera.getFov()) * 0.5f);
+		float tanHalfX = tanHalfY * camera.getAspectRatio();
+		float orthoHalfY = camera.getOrthoSize() * 0.5f;
+		float orthoHalfX = orthoHalfY * camera.getAspectRatio();
+		glm::mat4 inverseView = glm::inverse(camera.getViewMatrix());
+
+		glm::vec3 lightDir = glm::normalize(lightDirection);
+		glm::vec3 up = fabsf(lightDir.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+
+		for (int c = 0; c < numCascades; c++) {
+			//World-space corners of this slice of the frustum
+			glm::vec3 corners[8];
+			for (int i = 0; i < 8; i++) {
+				float depth = (i < 4) ? splits[c] : splits[c + 1];
+				float halfX = camera.isOrtho() ? orthoHalfX : depth * tanHalfX;
+				float halfY = camera.isOrtho() ? orthoHalfY : depth * tanHalfY;
+				glm::vec4 viewCorner = glm::vec4((i & 1) ? halfX : -halfX, (i & 2) ? halfY : -halfY, -depth, 1);
+				corners[i] = glm::vec3(inverseView * viewCorner);
+			}
+
+			//Bounding sphere keeps the projection size constant as the camera rotates
+			glm::vec3 center = glm::vec3(0);
+			for (int i = 0; i < 8; i++) {
+				center += corners[i];
+			}
+			center /= 8.0f;
+			float radius = 0.0f;
+			for (int i = 0; i < 8; i++) {
+				radius = std::max(radius, glm::length(corners[i] - center));
+			}
+			radius = ceilf(radius * 16.0f) / 16.0f;
+
+			glm::vec3 eye = center - lightDir * (radius + mSettings.casterMargin);
+			glm::mat4 lightView = glm::lookAt(eye, center, up);
+			glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, 2.0f * radius + mSettings.casterMargin);
+
+			//Snap the origin to whole shadow map texels so edges don't shimmer when the camera moves
+			glm::mat4 shadowMatrix = lightProjection * lightView;
+			float halfResolution = mSettings.resolution * 0.5f;
+			glm::vec4 origin = shadowMatrix * glm::vec4(0, 0, 0, 1) * halfResolution;
+			glm::vec4 roundedOrigin = glm::round(origin);
+			glm::vec4 offset = (roundedOrigin - origin) / halfResolution;
+			lightProjection[3][0] += offset.x;
+			lightProjection[3][1] += offset.y;
+
+			mShadowBlock.viewProjections[c] = lightProjection * lightView;
+			mShadowBlock.splitDepths[c] = splits[c + 1];
+		}
+
+		mShadowBlock.numCascades = numCascades;
+		mShadowBlock.bias = mSettings.bias;
+		mShadowBlock.showCascades = mSettings.showCascades ? 1 : 0;
+		mShadowBlock.texelSize = 1.0f / mSettings.resolution;
+		mShadowUBO.update(mShadowBlock);
+	}
+
+	void ShadowCascades::beginCascade(int cascade)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, mFBO);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, mDepthArray, 0, cascade);
+		GLState::get().viewport(0, 0, mSettings.resolution, mSettings.resolution);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+
+	void ShadowCascades::endCascades(int screenWidth, int screenHeight, GLuint screenFramebuffer)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+		GLState::get().viewport(0, 0, screenWidth, screenHeight);
+	}
+
+	void ShadowCascades::bind(GLuint textureUnit)
+	{
+		GLState::get().activeTexture(GL_TEXTURE0 + textureUnit);
+		GLState::get().bindTexture(GL_TEXTURE_2D_ARRAY, mDepthArray);
+	}
+}
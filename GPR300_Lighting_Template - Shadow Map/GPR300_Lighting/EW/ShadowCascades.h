@@ -0,0 +1,80 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "Camera.h"
+#include "UniformBuffer.h"
+
+namespace ew {
+	const int MAX_SHADOW_CASCADES = 4;
+	//Uniform block binding, after LIGHT_BLOCK_BINDING and MATERIAL_BLOCK_BINDING
+	const unsigned int SHADOW_BLOCK_BINDING = 3;
+
+	/// <summary>
+	/// Matches "uniform ShadowBlock" in defaultLit.frag.
+	/// splitDepths holds the far view depth of each cascade.
+	/// </summary>
+	struct ShadowBlock {
+		glm::mat4 viewProjections[MAX_SHADOW_CASCADES];
+		glm::vec4 splitDepths = glm::vec4(0);
+		int numCascades = 0;
+		float bias = 0;
+		int showCascades = 0;
+		float texelSize = 0;
+	};
+	static_assert(offsetof(ShadowBlock, viewProjections) == 0, "std140 mismatch");
+	static_assert(offsetof(ShadowBlock, splitDepths) == 256, "std140 mismatch");
+	static_assert(offsetof(ShadowBlock, numCascades) == 272, "std140 mismatch");
+	static_assert(offsetof(ShadowBlock, bias) == 276, "std140 mismatch");
+	static_assert(offsetof(ShadowBlock, showCascades) == 280, "std140 mismatch");
+	static_assert(offsetof(ShadowBlock, texelSize) == 284, "std140 mismatch");
+	static_assert(sizeof(ShadowBlock) == 288, "std140 mismatch");
+
+	struct ShadowSettings {
+		int numCascades = 3;
+		int resolution = 2048;
+		//Shadows stop at this view depth, independent of the camera far plane
+		float maxDistance = 30.0f;
+		//0 = uniform splits, 1 = logarithmic splits
+		float splitLambda = 0.75f;
+		float bias = 0.002f;
+		//Extra depth behind each cascade so off-screen casters still land in the map
+		float casterMargin = 20.0f;
+		bool showCascades = false;
+	};
+
+	/// <summary>
+	/// Directional light cascaded shadow maps stored in one depth texture array.
+	/// Compare mode is enabled so sampler2DArrayShadow lookups get hardware PCF.
+	/// </summary>
+	class ShadowCascades {
+	public:
+		ShadowCascades(const ShadowSettings& settings);
+		~ShadowCascades();
+		//Reallocates the depth array only when cascade count or resolution changed
+		void setSettings(const ShadowSettings& settings);
+		inline const ShadowSettings& getSettings()const { return mSettings; }
+		//Fits every cascade to its slice of the camera frustum and uploads the shadow block
+		void update(Camera& camera, const glm::vec3& lightDirection);
+		//Binds the FBO to one cascade layer, sets the viewport and clears depth
+		void beginCascade(int cascade);
+		//Goes back to drawing into screenFramebuffer, the window's by default
+		void endCascades(int screenWidth, int screenHeight, GLuint screenFramebuffer = 0);
+		void bind(GLuint textureUnit);
+		inline const glm::mat4& getViewProjection(int cascade)const { return mShadowBlock.viewProjections[cascade]; }
+		inline float getSplitDepth(int cascade)const { return mShadowBlock.splitDepths[cascade]; }
+	private:
+		ShadowCascades(const ShadowCascades& r) = delete;
+		void createDepthArray();
+		void deleteDepthArray();
+		ShadowSettings mSettings;
+		ShadowBlock mShadowBlock;
+		UniformBuffer mShadowUBO;
+		GLuint mFBO = 0;
+		GLuint mDepthArray = 0;
+		int mAllocatedCascades = 0;
+		int mAllocatedResolution = 0;
+	};
+}
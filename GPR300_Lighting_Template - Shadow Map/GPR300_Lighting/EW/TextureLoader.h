@@ -0,0 +1,75 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "DDSFile.h"
+
+namespace ew {
+	struct TextureSettings {
+		GLenum wrapMode = GL_REPEAT;
+		GLenum magFilter = GL_NEAREST;
+		GLenum minFilter = GL_NEAREST_MIPMAP_LINEAR;
+		//Shown until the real image has been decoded and uploaded
+		glm::vec4 placeholderColor = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f);
+	};
+
+	/// <summary>
+	/// Decodes image files on a pool of worker threads and uploads them through a pixel buffer object on the GL thread.
+	/// load() returns a texture name straight away holding a 1x1 placeholder; the same name receives the real image later,
+	/// so anything already bound to it picks up the new contents without rebinding.
+	/// If a cooked .dds sits next to the source image (see GPR300_TextureCooker) its compressed mips are uploaded as-is instead,
+	/// unless the source image has been modified since it was cooked.
+	/// Call update() once per frame on the GL thread.
+	/// </summary>
+	class TextureLoader {
+	public:
+		//numThreads <= 0 picks one less than the number of hardware threads
+		TextureLoader(int numThreads = 0);
+		~TextureLoader();
+		//Creates the texture and binds it to GL_TEXTURE_2D on the active texture unit, like glGenTextures + glBindTexture
+		GLuint load(const std::string& filePath, const TextureSettings& settings = TextureSettings());
+		//Uploads up to maxUploads finished decodes. Returns how many textures were uploaded.
+		int update(int maxUploads = 1);
+		//Blocks until every queued texture has been uploaded
+		void finish();
+		inline int getNumPending()const { return mNumPending; }
+	private:
+		TextureLoader(const TextureLoader& r) = delete;
+		struct Job {
+			GLuint texture;
+			std::string filePath;
+			TextureSettings settings;
+		};
+		struct DecodedImage {
+			Job job;
+			//Uncompressed source, from stbi
+			unsigned char* pixels = nullptr;
+			int width = 0, height = 0, numComponents = 0;
+			//Cooked block compressed mip chain, used instead of pixels when present
+			bool compressed = false;
+			DDSImage dds;
+		};
+		void workerLoop();
+		bool fillPixelBuffer(const void* data, GLsizeiptr size);
+		void upload(const DecodedImage& image);
+		void uploadCompressed(const DecodedImage& image);
+
+		std::vector<std::thread> mWorkers;
+		std::mutex mMutex;
+		std::condition_variable mJobReady;
+		std::condition_variable mImageReady;
+		std::deque<Job> mJobs;
+		std::deque<DecodedImage> mDecoded;
+		bool mStopping = false;
+		//Only touched on the GL thread
+		int mNumPending = 0;
+		GLuint mPBO = 0;
+	};
+}
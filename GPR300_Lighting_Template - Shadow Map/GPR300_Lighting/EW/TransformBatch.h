@@ -0,0 +1,41 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include "Transform.h"
+
+namespace ew {
+	/// <summary>
+	/// Stores many transforms as structure-of-arrays and builds all of their model and normal matrices in one pass,
+	/// four transforms at a time with SSE. Each rotation angle needs one vectorized sincos, and T * Rx * Ry * Rz * S is
+	/// written out in closed form instead of multiplying five matrices.
+	/// Produces the same matrices as Transform::getModelMatrix() and Transform::getNormalMatrix().
+	/// </summary>
+	class TransformBatch {
+	public:
+		//Returns the index of the new transform
+		int add(const Transform& transform = Transform());
+		void set(int index, const Transform& transform);
+		Transform get(int index)const;
+		void clear();
+		inline int size()const { return mCount; }
+		//Rebuilds every matrix
+		void update();
+		inline const glm::mat4& getModelMatrix(int index)const { return mModelMatrices[index]; }
+		inline const glm::mat3& getNormalMatrix(int index)const { return mNormalMatrices[index]; }
+		//size() matrices back to back, e.g. for an instance buffer
+		inline const glm::mat4* getModelMatrices()const { return mModelMatrices.data(); }
+	private:
+		int mCount = 0;
+		//Every array is padded to a multiple of 4 so the SIMD loop has no scalar tail
+		std::vector<float> mPositionX, mPositionY, mPositionZ;
+		std::vector<float> mRotationX, mRotationY, mRotationZ;
+		std::vector<float> mScaleX, mScaleY, mScaleZ;
+		std::vector<glm::mat4> mModelMatrices;
+		std::vector<glm::mat3> mNormalMatrices;
+	};
+
+	//Scalar version of the same closed form, for transforms that change one at a time
+	void computeTransformMatrices(const Transform& transform, glm::mat4& modelMatrix, glm::mat3& normalMatrix);
+}
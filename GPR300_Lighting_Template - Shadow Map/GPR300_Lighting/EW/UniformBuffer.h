@@ -0,0 +1,25 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+
+namespace ew {
+	/// <summary>
+	/// Owns a uniform buffer bound to a fixed binding point.
+	/// Any program declaring a block with the same binding reads from it.
+	/// </summary>
+	class UniformBuffer {
+	public:
+		UniformBuffer(GLsizeiptr size, GLuint bindingPoint);
+		~UniformBuffer();
+		void update(const void* data, GLsizeiptr size, GLintptr offset = 0);
+		template<typename T>
+		void update(const T& data) { update(&data, sizeof(T)); }
+		inline GLuint getBindingPoint()const { return mBindingPoint; }
+	private:
+		UniformBuffer(const UniformBuffer& r) = delete;
+		GLuint mUBO;
+		GLsizeiptr mSize;
+		GLuint mBindingPoint;
+	};
+}
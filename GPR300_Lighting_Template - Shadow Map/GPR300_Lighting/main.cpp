@@ -8,6 +8,7 @@
 
 #include <stdio.h>
 #include <iostream>
+#include <vector>
 
 #include <time.h>
 
@@ -22,8 +23,24 @@
 #include "EW/EwMath.h"
 #include "EW/Camera.h"
 #include "EW/Mesh.h"
+#include "EW/GeometryPool.h"
 #include "EW/Transform.h"
+#include "EW/TransformBatch.h"
+#include "EW/SceneGraph.h"
+#include "EW/FrustumCuller.h"
+#include "EW/BVH.h"
+#include "EW/HeadlessBenchmark.h"
+#include "EW/Profiler.h"
+#include "EW/Trace.h"
+#include "EW/GLState.h"
 #include "EW/ShapeGen.h"
+#include "EW/UniformBuffer.h"
+#include "EW/LightBlock.h"
+#include "EW/LightClusters.h"
+#include "EW/TextureLoader.h"
+#include "EW/ShadowCascades.h"
+#include "EW/MultiDrawBatch.h"
+#include "EW/GpuCuller.h"
 
 void processInput(GLFWwindow* window);
 void resizeFrameBufferCallback(GLFWwindow* window, int width, int height);
@@ -31,8 +48,8 @@ void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action,
 void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void mousePosCallback(GLFWwindow* window, double xpos, double ypos);
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-GLuint createTexture(const char* filePath);
-GLuint createFBO();
+GLuint createTexture(ew::TextureLoader& loader, const char* filePath, glm::vec4 placeholderColor = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+void spawnStressLights(std::vector<ew::PtLightData>& lights, int count, float radius);
 
 float lastFrameTime;
 float deltaTime;
@@ -44,6 +61,15 @@ double prevMouseX;
 double prevMouseY;
 bool firstMouseInput = false;
 
+//Cursor position is tracked even while unlocked, for picking
+double mouseX;
+double mouseY;
+bool pickRequested = false;
+
+//--headless renders --frames N frames offscreen along a fixed camera path, then prints timings as JSON
+bool headless = false;
+int headlessFrames = 300;
+
 /* Button to lock / unlock mouse
 * 1 = right, 2 = middle
 * Mouse will start locked. Unlock it to use UI
@@ -103,20 +129,95 @@ float normalIntensity = 0;
 bool scrolling = false;
 float scrollSpeed = 1;
 
+//Bits of the lit shader's feature mask, in the order of the names passed to its constructor
+enum LitFeature {
+	LIT_SCROLLING = 1 << 0,
+	LIT_MULTI_DRAW = 1 << 1,
+	LIT_INVERSE_NORMAL_MATRIX = 1 << 2
+};
+
+enum DepthFeature {
+	DEPTH_MULTI_DRAW = 1 << 0
+};
+
+//Each pass is one glMultiDrawElementsIndirect instead of a uniform and draw call per object
+bool multiDrawIndirect = true;
+//The lit pass is frustum culled by a compute shader instead of the CPU culler's results
+bool gpuCulling = true;
+
 const char* wrappingModes[] = { "Clamp To Edge", "Clamp To Border", "Repeat", "Mirrored Repeat" };
 static const char* currentWrap = "Clamp To Edge";
 int currentWrapMode = 2;
 
 const GLuint fboLoc = 10;
+const GLuint shadowMapLoc = 11;
+
+//Cascaded shadow map settings, editable at runtime
+ew::ShadowSettings shadowSettings;
+const int shadowResolutions[] = { 512, 1024, 2048, 4096 };
+const char* shadowResolutionNames[] = { "512", "1024", "2048", "4096" };
+int currentShadowResolution = 2;
 
 bool postProcessing = false;
 
-int main() {
+//Stress test for clustered lighting
+int numStressLights = 0;
+float stressLightRadius = 2.0f;
+float stressLightOrbitSpeed = 0.2f;
+
+int main(int argc, char** argv) {
+	ew::TraceRecorder::get().setThreadName("Main");
+	//Draw submission benchmark, runs in a hidden window once the meshes are made
+	bool benchDraws = false;
+	//Uniform setter benchmark, runs in a hidden window once the shaders are built
+	bool benchUniforms = false;
+	//Vertex throughput benchmark of the normal matrix, runs in a hidden window once the meshes are made
+	bool benchNormals = false;
+	//CPU only benchmark, doesn't need a window
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--bench-transforms") {
+			ew::benchmarkTransformBatch({ 1000, 100000, 1000000 });
+			return 0;
+		}
+		if (std::string(argv[i]) == "--bench-scene") {
+			ew::benchmarkSceneGraph();
+			return 0;
+		}
+		if (std::string(argv[i]) == "--bench-bvh") {
+			ew::benchmarkBVH({ 10000, 100000, 1000000 });
+			return 0;
+		}
+		//Recording from the start catches asset loading, F9 or exit writes trace.json
+		if (std::string(argv[i]) == "--trace") {
+			ew::TraceRecorder::get().setEnabled(true);
+		}
+		if (std::string(argv[i]) == "--headless") {
+			headless = true;
+		}
+		if (std::string(argv[i]) == "--frames" && i + 1 < argc) {
+			headlessFrames = atoi(argv[++i]);
+		}
+		if (std::string(argv[i]) == "--bench-draws") {
+			benchDraws = true;
+		}
+		if (std::string(argv[i]) == "--bench-uniforms") {
+			benchUniforms = true;
+		}
+		if (std::string(argv[i]) == "--bench-normals") {
+			benchNormals = true;
+		}
+	}
+
 	if (!glfwInit()) {
 		printf("glfw failed to init");
 		return 1;
 	}
 
+	//GLEW loads GL through the platform's own context API, so even headless runs need a window, just never shown.
+	//On machines without a GPU that context comes from Mesa's llvmpipe.
+	if (benchDraws || benchUniforms || benchNormals || headless) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
 	GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Lighting", 0, 0);
 	glfwMakeContextCurrent(window);
 
@@ -124,6 +225,8 @@ int main() {
 		printf("glew failed to init");
 		return 1;
 	}
+	//State changes go through the cache, which drops the ones that change nothing
+	ew::GLState& glState = ew::GLState::get();
 
 	glfwSetFramebufferSizeCallback(window, resizeFrameBufferCallback);
 	glfwSetKeyCallback(window, keyboardCallback);
@@ -144,15 +247,59 @@ int main() {
 	ImGui::StyleColorsDark();
 
 	//Used to draw shapes. This is the shader you will be completing.
-	Shader litShader("shaders/defaultLit.vert", "shaders/defaultLit.frag");
+	//Scrolling is compiled in as a #define rather than branched on per vertex
+	Shader litShader("shaders/defaultLit.vert", "shaders/defaultLit.frag", { "SCROLLING", "MULTI_DRAW", "INVERSE_NORMAL_MATRIX" });
 
 	//Used to draw light sphere
 	Shader unlitShader("shaders/defaultLit.vert", "shaders/unlit.frag");
 
+	//Uniforms set once per draw are resolved up front
+	UniformHandle litModelUniform = litShader.getUniform("_Model");
+	UniformHandle litNormalMatrixUniform = litShader.getUniform("_NormalMatrix");
+
+	//Light and material blocks are shared by every program that declares them
+	ew::UniformBuffer lightUBO(sizeof(ew::LightBlock), ew::LIGHT_BLOCK_BINDING);
+	ew::UniformBuffer materialUBO(sizeof(ew::MaterialBlock), ew::MATERIAL_BLOCK_BINDING);
+	ew::LightBlock lightBlock;
+	ew::MaterialBlock materialBlock;
+
+	//Point and spot lights are binned into view-space clusters every frame
+	ew::LightClusters lightClusters;
+	std::vector<ew::PtLightData> ptLightData;
+	std::vector<ew::SpLightData> spLightData;
+	std::vector<ew::PtLightData> stressLights;
+	int spawnedStressLights = -1;
+	float spawnedStressRadius = 0.0f;
+
+	//Depth only pass for the shadow cascades
+	Shader depthOnlyShader("shaders/depthOnly.vert", "shaders/depthOnly.frag", { "MULTI_DRAW" });
+	UniformHandle depthModelUniform = depthOnlyShader.getUniform("_Model");
+	UniformHandle depthLightViewProjUniform = depthOnlyShader.getUniform("_LightViewProj");
+
 	//Post Processing Shader
 	Shader postProcShader("postprocessingshaders/postProc.vert", "postprocessingshaders/postProc.frag");
 	Shader noPostProcShader("postprocessingshaders/postProc.vert", "postprocessingshaders/noPostProc.frag");
 
+	//Every program, for startup timing and hot reloading
+	Shader* shaders[] = { &litShader, &unlitShader, &depthOnlyShader, &postProcShader, &noPostProcShader };
+
+	//Cold starts compile every program, warm starts load them from the binary cache
+	float totalBuildTime = 0.0f;
+	int numFromCache = 0;
+	for (Shader* shader : shaders) {
+		totalBuildTime += shader->getBuildTime();
+		numFromCache += shader->isFromBinaryCache() ? 1 : 0;
+		//Saving a shader file rebuilds it in place while the app keeps running
+		shader->setHotReload(true);
+	}
+	printf("Built %d shader programs in %.2f ms (%d from binary cache)\n", IM_ARRAYSIZE(shaders), totalBuildTime, numFromCache);
+
+	if (benchUniforms) {
+		ew::benchmarkUniformSetters(litShader, { "_Model", "_View", "_Projection" }, 100000);
+		glfwTerminate();
+		return 0;
+	}
+
 	ew::MeshData cubeMeshData;
 	ew::createCube(1.0f, 1.0f, 1.0f, cubeMeshData);
 	ew::MeshData sphereMeshData;
@@ -165,12 +312,33 @@ int main() {
 	ew::MeshData quadMeshData;
 	ew::createQuad(2.0f, 2.0f, quadMeshData);
 
-	ew::Mesh cubeMesh(&cubeMeshData);
-	ew::Mesh sphereMesh(&sphereMeshData);
-	ew::Mesh planeMesh(&planeMeshData);
-	ew::Mesh cylinderMesh(&cylinderMeshData);
+	//All meshes share one vertex and index buffer, so every draw uses the same VAO
+	ew::GeometryPool geometryPool;
+	//Vertices are only needed until they're uploaded, after that just the bounds are kept
+	ew::Mesh cubeMesh(&cubeMeshData, &geometryPool, true);
+	ew::Mesh sphereMesh(&sphereMeshData, &geometryPool, true);
+	ew::Mesh planeMesh(&planeMeshData, &geometryPool, true);
+	ew::Mesh cylinderMesh(&cylinderMeshData, &geometryPool, true);
+
+	ew::Mesh quadMesh(&quadMeshData, &geometryPool, true);
 
-	ew::Mesh quadMesh(&quadMeshData);
+	if (benchNormals) {
+		ew::benchmarkNormalMatrix(litShader, LIT_INVERSE_NORMAL_MATRIX, litModelUniform, litNormalMatrixUniform, { &sphereMesh, &cylinderMesh }, 500);
+		glfwTerminate();
+		return 0;
+	}
+
+	if (benchDraws) {
+		ew::benchmarkMultiDraw(depthOnlyShader, DEPTH_MULTI_DRAW, depthModelUniform, { &cubeMesh, &sphereMesh, &cylinderMesh, &planeMesh }, { 1000, 5000, 20000 });
+		glfwTerminate();
+		return 0;
+	}
+
+	//Every shadow caster, which is also everything the GPU culler picks the lit pass's draws from
+	ew::MultiDrawBatch shadowBatch(&geometryPool);
+	//What's left after CPU camera culling
+	ew::MultiDrawBatch litBatch(&geometryPool);
+	ew::GpuCuller gpuCuller;
 
 	material.ambientK = 0.25;
 	material.diffuseK = 0.5;
@@ -188,16 +356,16 @@ int main() {
 	//spLight.direction = glm::vec3(-1, -1, 0);
 
 	//Enable back face culling
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	glState.enable(GL_CULL_FACE);
+	glState.cullFace(GL_BACK);
 
 	//Enable blending
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glState.enable(GL_BLEND);
+	glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	//Enable depth testing
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	glState.enable(GL_DEPTH_TEST);
+	glState.depthFunc(GL_LESS);
 
 	//Initialize shape transforms
 	ew::Transform cubeTransform;
@@ -221,109 +389,289 @@ int main() {
 	//lightTransform2.scale = glm::vec3(0.5f);
 	//lightTransform2.position = glm::vec3(-1.0f, 5.0f, -1.0f);
 
-	glActiveTexture(GL_TEXTURE0);
-	GLuint bambooTecture = createTexture("../../Resources/Bamboo/Bamboo001A_4K_Color.jpg");
+	//Objects are scene graph nodes, so only the ones that move get their matrices rebuilt
+	ew::SceneGraph scene;
+	int cubeNode = scene.addNode(cubeTransform);
+	int sphereNode = scene.addNode(sphereTransform);
+	int cylinderNode = scene.addNode(cylinderTransform);
+	int planeNode = scene.addNode(planeTransform);
+
+	//Objects outside the camera's frustum are skipped in the lit pass
+	scene.update();
+	ew::FrustumCuller frustumCuller;
+	int cubeObject = frustumCuller.add(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode));
+	int sphereObject = frustumCuller.add(sphereMesh.getBounds(), scene.getWorldMatrix(sphereNode));
+	int cylinderObject = frustumCuller.add(cylinderMesh.getBounds(), scene.getWorldMatrix(cylinderNode));
+	int planeObject = frustumCuller.add(planeMesh.getBounds(), scene.getWorldMatrix(planeNode));
+
+	//Same objects in the same order as the frustum culler, so they share indices
+	ew::BVH sceneBVH;
+	sceneBVH.build({
+		ew::transformBounds(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode)),
+		ew::transformBounds(sphereMesh.getBounds(), scene.getWorldMatrix(sphereNode)),
+		ew::transformBounds(cylinderMesh.getBounds(), scene.getWorldMatrix(cylinderNode)),
+		ew::transformBounds(planeMesh.getBounds(), scene.getWorldMatrix(planeNode)),
+	});
+	const char* objectNames[] = { "Cube", "Sphere", "Cylinder", "Plane" };
+	int pickedObject = -1;
+	float pickedDistance = 0.0f;
+
+	//Decodes on worker threads so the first frame doesn't wait on 4K JPEGs
+	ew::TextureLoader textureLoader;
+
+	glState.activeTexture(GL_TEXTURE0);
+	GLuint bambooTecture = createTexture(textureLoader, "../../Resources/Bamboo/Bamboo001A_4K_Color.jpg");
 	
-	glActiveTexture(GL_TEXTURE1);
-	GLuint bambooNormal = createTexture("../../Resources/Bamboo/Bamboo001A_4K_NormalGL.jpg");
+	glState.activeTexture(GL_TEXTURE1);
+	GLuint bambooNormal = createTexture(textureLoader, "../../Resources/Bamboo/Bamboo001A_4K_NormalGL.jpg", glm::vec4(0.5f, 0.5f, 1.0f, 1.0f));
+
+	ew::ShadowCascades shadowCascades(shadowSettings);
+
+	//Every object that casts and receives shadows
+	//Depth-only passes leave normalMatrixUniform invalid and skip the normal matrix entirely
+	//Shadow passes don't camera cull, objects behind the camera can still cast shadows into view
+	auto drawScene = [&](Shader& shader, UniformHandle modelUniform, UniformHandle normalMatrixUniform, bool cameraCulled) {
+		//Draw cube
+		if (!cameraCulled || frustumCuller.isVisible(cubeObject)) {
+			shader.setMat4(modelUniform, scene.getWorldMatrix(cubeNode));
+			if (normalMatrixUniform.isValid()) {
+				shader.setMat3(normalMatrixUniform, scene.getWorldNormalMatrix(cubeNode));
+			}
+			cubeMesh.draw();
+		}
+
+		//Draw sphere
+		if (!cameraCulled || frustumCuller.isVisible(sphereObject)) {
+			shader.setMat4(modelUniform, scene.getWorldMatrix(sphereNode));
+			if (normalMatrixUniform.isValid()) {
+				shader.setMat3(normalMatrixUniform, scene.getWorldNormalMatrix(sphereNode));
+			}
+			sphereMesh.draw();
+		}
+
+		//Draw cylinder
+		if (!cameraCulled || frustumCuller.isVisible(cylinderObject)) {
+			shader.setMat4(modelUniform, scene.getWorldMatrix(cylinderNode));
+			if (normalMatrixUniform.isValid()) {
+				shader.setMat3(normalMatrixUniform, scene.getWorldNormalMatrix(cylinderNode));
+			}
+			cylinderMesh.draw();
+		}
+
+		//Draw plane
+		if (!cameraCulled || frustumCuller.isVisible(planeObject)) {
+			shader.setMat4(modelUniform, scene.getWorldMatrix(planeNode));
+			if (normalMatrixUniform.isValid()) {
+				shader.setMat3(normalMatrixUniform, scene.getWorldNormalMatrix(planeNode));
+			}
+			planeMesh.draw();
+		}
+	};
+
+	//The same objects as drawScene, gathered into a batch for a single multi-draw
+	auto batchScene = [&](ew::MultiDrawBatch& batch, bool cameraCulled) {
+		batch.clear();
+		if (!cameraCulled || frustumCuller.isVisible(cubeObject)) {
+			batch.add(cubeMesh, scene.getWorldMatrix(cubeNode), scene.getWorldNormalMatrix(cubeNode));
+		}
+		if (!cameraCulled || frustumCuller.isVisible(sphereObject)) {
+			batch.add(sphereMesh, scene.getWorldMatrix(sphereNode), scene.getWorldNormalMatrix(sphereNode));
+		}
+		if (!cameraCulled || frustumCuller.isVisible(cylinderObject)) {
+			batch.add(cylinderMesh, scene.getWorldMatrix(cylinderNode), scene.getWorldNormalMatrix(cylinderNode));
+		}
+		if (!cameraCulled || frustumCuller.isVisible(planeObject)) {
+			batch.add(planeMesh, scene.getWorldMatrix(planeNode), scene.getWorldNormalMatrix(planeNode));
+		}
+		batch.upload();
+	};
 
-	GLuint fbo = createFBO();
+	//Headless frames are drawn offscreen, a hidden window's own framebuffer may not have any pixels
+	ew::OffscreenTarget offscreenTarget;
+	if (headless) {
+		offscreenTarget.create(SCREEN_WIDTH, SCREEN_HEIGHT);
+	}
+	//Where each frame ends up, 0 for the window
+	GLuint screenFramebuffer = offscreenTarget.getFramebuffer();
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+	ew::Profiler& profiler = ew::Profiler::get();
+	ew::FrameRecorder frameRecorder;
+	if (headless) {
+		frameRecorder.attach(profiler, ew::HEADLESS_WARMUP_FRAMES);
+	}
+	int frameIndex = 0;
 
-	while (!glfwWindowShouldClose(window)) {
+	while (headless ? frameIndex < ew::HEADLESS_WARMUP_FRAMES + headlessFrames : !glfwWindowShouldClose(window)) {
+		profiler.beginFrame();
 
-		processInput(window);
+		if (!headless) {
+			processInput(window);
+		}
 		glClearColor(bgColor.r,bgColor.g,bgColor.b, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+		textureLoader.update();
+		for (Shader* shader : shaders) {
+			shader->reloadIfChanged();
+		}
+
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 
-		float time = (float)glfwGetTime();
+		float time = headless ? frameIndex * ew::HEADLESS_TIMESTEP : (float)glfwGetTime();
+		if (headless) {
+			ew::followBenchmarkPath(camera, time);
+		}
 		deltaTime = time - lastFrameTime;
 		lastFrameTime = time;
 
 		//UPDATE
 		cubeTransform.rotation.x += deltaTime;
+		scene.setLocalTransform(cubeNode, cubeTransform);
+		scene.update();
+		frustumCuller.setModelMatrix(cubeObject, scene.getWorldMatrix(cubeNode));
+		frustumCuller.cull(camera.getFrustum());
+		sceneBVH.setObjectBounds(cubeObject, ew::transformBounds(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode)));
+		sceneBVH.refit();
+		if (pickRequested) {
+			glm::vec2 ndc = glm::vec2(0.0f);
+			if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED) {
+				int windowWidth, windowHeight;
+				glfwGetWindowSize(window, &windowWidth, &windowHeight);
+				ndc = glm::vec2((float)mouseX / windowWidth * 2.0f - 1.0f, 1.0f - (float)mouseY / windowHeight * 2.0f);
+			}
+			pickedObject = sceneBVH.raycast(camera.getPosition(), camera.getRayDirection(ndc), &pickedDistance);
+			pickRequested = false;
+		}
 
-		//Bind FBO
-		//glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-		//glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		//glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+		//Shadow pass, one depth-only render per cascade
+		shadowCascades.setSettings(shadowSettings);
+		shadowCascades.update(camera, dirLight.direction);
+		//Both passes' variants are picked up front, the shadow batch is built for either of them
+		depthOnlyShader.selectVariant(multiDrawIndirect ? DEPTH_MULTI_DRAW : 0);
+		litShader.selectVariant((scrolling ? LIT_SCROLLING : 0) | (multiDrawIndirect ? LIT_MULTI_DRAW : 0));
+		depthOnlyShader.use();
+		//Follows the variant actually current, which may still be compiling after the toggle
+		bool depthMultiDraw = (depthOnlyShader.getVariant() & DEPTH_MULTI_DRAW) != 0;
+		bool litGpuCulled = gpuCulling && gpuCuller.isValid() && (litShader.getVariant() & LIT_MULTI_DRAW) != 0;
+		if (depthMultiDraw || litGpuCulled) {
+			//Uploaded once, drawn into every cascade
+			batchScene(shadowBatch, false);
+		}
+		profiler.beginScope("Shadow");
+		glState.enable(GL_POLYGON_OFFSET_FILL);
+		glState.polygonOffset(2.0f, 4.0f);
+		for (int i = 0; i < shadowCascades.getSettings().numCascades; i++) {
+			shadowCascades.beginCascade(i);
+			depthOnlyShader.setMat4(depthLightViewProjUniform, shadowCascades.getViewProjection(i));
+			if (depthMultiDraw) {
+				shadowBatch.draw();
+			}
+			else {
+				drawScene(depthOnlyShader, depthModelUniform, UniformHandle(), false);
+			}
+		}
+		glState.disable(GL_POLYGON_OFFSET_FILL);
+		shadowCascades.endCascades(SCREEN_WIDTH, SCREEN_HEIGHT, screenFramebuffer);
+		profiler.endScope();
+		shadowCascades.bind(shadowMapLoc);
 
 		//Draw
+		profiler.beginScope("Lit");
 		litShader.use();
 		litShader.setMat4("_Projection", camera.getProjectionMatrix());
 		litShader.setMat4("_View", camera.getViewMatrix());
 
 		//Set some lighting uniforms
 		 
-		litShader.setVec3("_DirLight[0].color", dirLight.color);
-		litShader.setVec3("_DirLight[0].direction", normalize(dirLight.direction));
-		litShader.setFloat("_DirLight[0].intensity", dirLight.intensity);
-
-		//litShader.setVec3("_PtLight[0].position", lightTransform1.position);
-		//litShader.setVec3("_PtLight[0].color", ptLight1.color);
-		//litShader.setFloat("_PtLight[0].intensity", ptLight1.intensity);
-		//litShader.setFloat("_PtLight[0].linearAtt", ptLight1.linearAtt);
-
-		//litShader.setVec3("_PtLight[1].position", lightTransform2.position);
-		//litShader.setVec3("_PtLight[1].color", ptLight2.color);
-		//litShader.setFloat("_PtLight[1].intensity", ptLight2.intensity);
-		//litShader.setFloat("_PtLight[1].linearAtt", ptLight2.linearAtt);
-
-		//litShader.setVec3("_SpLight[0].color", spLight.color);
-		//litShader.setVec3("_SpLight[0].position", spLight.position);
-		//litShader.setVec3("_SpLight[0].direction", normalize(spLight.direction));
-		//litShader.setFloat("_SpLight[0].intensity", spLight.intensity);
-		//litShader.setFloat("_SpLight[0].linearAtt", spLight.linearAtt);
-		//litShader.setFloat("_SpLight[0].minAngle", cos(spLight.minAngle / 180 * 3.14159));
-		//litShader.setFloat("_SpLight[0].maxAngle", cos(spLight.maxAngle / 180 * 3.14159));
-		//litShader.setFloat("_SpLight[0].falloffCurve", spLight.falloffCurve);
-
-		litShader.setInt("numDirLights", 1);
-		//litShader.setInt("numPtLights", 1);
-		//litShader.setInt("numSpLights", 1);
+		lightBlock.dirLights[0].color = dirLight.color;
+		lightBlock.dirLights[0].direction = normalize(dirLight.direction);
+		lightBlock.dirLights[0].intensity = dirLight.intensity;
+
+		//lightBlock.ptLights[0].position = lightTransform1.position;
+		//lightBlock.ptLights[0].color = ptLight1.color;
+		//lightBlock.ptLights[0].intensity = ptLight1.intensity;
+		//lightBlock.ptLights[0].linearAtt = ptLight1.linearAtt;
+
+		//lightBlock.ptLights[1].position = lightTransform2.position;
+		//lightBlock.ptLights[1].color = ptLight2.color;
+		//lightBlock.ptLights[1].intensity = ptLight2.intensity;
+		//lightBlock.ptLights[1].linearAtt = ptLight2.linearAtt;
+
+		//lightBlock.spLights[0].color = spLight.color;
+		//lightBlock.spLights[0].position = spLight.position;
+		//lightBlock.spLights[0].direction = normalize(spLight.direction);
+		//lightBlock.spLights[0].intensity = spLight.intensity;
+		//lightBlock.spLights[0].linearAtt = spLight.linearAtt;
+		//lightBlock.spLights[0].minAngle = cos(spLight.minAngle / 180 * 3.14159);
+		//lightBlock.spLights[0].maxAngle = cos(spLight.maxAngle / 180 * 3.14159);
+		//lightBlock.spLights[0].falloffCurve = spLight.falloffCurve;
+
+		//Point and spot lights go through the clusters rather than LightBlock.
+		//This scene has none of its own, only the stress lights.
+		ptLightData.clear();
+		spLightData.clear();
+
+		//Stress lights orbit the scene so they get re-binned every frame
+		if (numStressLights != spawnedStressLights || stressLightRadius != spawnedStressRadius) {
+			spawnStressLights(stressLights, numStressLights, stressLightRadius);
+			spawnedStressLights = numStressLights;
+			spawnedStressRadius = stressLightRadius;
+		}
+		float orbitAngle = time * stressLightOrbitSpeed;
+		for (const ew::PtLightData& stressLight : stressLights) {
+			ew::PtLightData orbiting = stressLight;
+			orbiting.position.x = stressLight.position.x * cos(orbitAngle) - stressLight.position.z * sin(orbitAngle);
+			orbiting.position.z = stressLight.position.x * sin(orbitAngle) + stressLight.position.z * cos(orbitAngle);
+			ptLightData.push_back(orbiting);
+		}
+
+		lightClusters.setDepthRange(camera.getNearPlane(), camera.getFarPlane());
+		lightClusters.build(ptLightData, spLightData, camera.getViewMatrix(), camera.getProjectionMatrix(), SCREEN_WIDTH, SCREEN_HEIGHT);
+
+		lightBlock.numDirLights = 1;
+
+		//One upload for every light, shared by all programs using LightBlock
+		lightUBO.update(lightBlock);
 
 		litShader.setVec3("_CameraPos", camera.getPosition());
 
 		//Set some material uniforms
-		litShader.setVec3("_Material.color", material.color);
+		materialBlock.material.color = material.color;
 		litShader.setFloat("NormalIntensity", normalIntensity);
-		litShader.setInt("Scrolling", scrolling);
-		litShader.setFloat("Time", (float)glfwGetTime() * scrollSpeed);
-		litShader.setFloat("_Material.ambientK", material.ambientK);
-		litShader.setFloat("_Material.diffuseK", material.diffuseK);
-		litShader.setFloat("_Material.specularK", material.specularK);
-		litShader.setFloat("_Material.shininess", material.shininess);
+		litShader.setFloat("Time", time * scrollSpeed);
+		materialBlock.material.ambientK = material.ambientK;
+		materialBlock.material.diffuseK = material.diffuseK;
+		materialBlock.material.specularK = material.specularK;
+		materialBlock.material.shininess = material.shininess;
+		materialUBO.update(materialBlock);
 
 		litShader.setInt("first", 0);
 		litShader.setInt("second", 1);
+		litShader.setInt("_ShadowMap", shadowMapLoc);
 
-		//Draw cube
-		litShader.setMat4("_Model", cubeTransform.getModelMatrix());
-		cubeMesh.draw();
-
-		//Draw sphere
-		litShader.setMat4("_Model", sphereTransform.getModelMatrix());
-		sphereMesh.draw();
-
-		//Draw cylinder
-		litShader.setMat4("_Model", cylinderTransform.getModelMatrix());
-		cylinderMesh.draw();
-
-		//Draw plane
-		litShader.setMat4("_Model", planeTransform.getModelMatrix());
-		planeMesh.draw();
+		if (litGpuCulled) {
+			gpuCuller.cull(shadowBatch, camera.getFrustum());
+			gpuCuller.draw();
+		}
+		else if (litShader.getVariant() & LIT_MULTI_DRAW) {
+			batchScene(litBatch, true);
+			litBatch.draw();
+		}
+		else {
+			drawScene(litShader, litModelUniform, litNormalMatrixUniform, true);
+		}
+		profiler.endScope();
 
 		//Draw light as a small sphere using unlit shader, ironically.
 		//unlitShader.use();
 		//unlitShader.setMat4("_Projection", camera.getProjectionMatrix());
 		//unlitShader.setMat4("_View", camera.getViewMatrix());
-		//unlitShader.setMat4("_Model", lightTransform1.getModelMatrix());
+		//unlitShader.setMat4(unlitModelUniform, lightTransform1.getModelMatrix());
 		//unlitShader.setVec3("_Color", ptLight1.color);
 		//sphereMesh.draw();
-		//unlitShader.setMat4("_Model", lightTransform2.getModelMatrix());
+		//unlitShader.setMat4(unlitModelUniform, lightTransform2.getModelMatrix());
 		//unlitShader.setVec3("_Color", ptLight2.color);
 		//sphereMesh.draw();
 
@@ -340,7 +688,7 @@ int main() {
 			noPostProcShader.use();
 			noPostProcShader.setInt("_FrameBuffer", fboLoc);
 		}
-		glViewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+		glState.viewport(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
 		quadMesh.draw();*/
 
 		//Draw UI
@@ -381,6 +729,30 @@ int main() {
 		ImGui::SliderFloat("Intensity", &dirLight.intensity, 0, 1);
 		ImGui::End();
 
+		ImGui::Begin("Shadows");
+		ImGui::SliderInt("Cascades", &shadowSettings.numCascades, 1, ew::MAX_SHADOW_CASCADES);
+		ImGui::Combo("Resolution", &currentShadowResolution, shadowResolutionNames, IM_ARRAYSIZE(shadowResolutionNames));
+		shadowSettings.resolution = shadowResolutions[currentShadowResolution];
+		ImGui::SliderFloat("Shadow Distance", &shadowSettings.maxDistance, 5.0f, 200.0f);
+		ImGui::SliderFloat("Split Lambda", &shadowSettings.splitLambda, 0.0f, 1.0f);
+		ImGui::SliderFloat("Depth Bias", &shadowSettings.bias, 0.0f, 0.01f, "%.4f");
+		ImGui::Checkbox("Show Cascades", &shadowSettings.showCascades);
+		ImGui::End();
+
+		ImGui::Begin("Culling");
+		ImGui::Text("Drawn: %d", frustumCuller.getNumDrawn());
+		ImGui::Text("Frustum culled: %d", frustumCuller.getNumCulled());
+		ImGui::Checkbox("Multi-draw indirect", &multiDrawIndirect);
+		ImGui::Checkbox("GPU culling", &gpuCulling);
+		ImGui::End();
+
+		ImGui::Begin("Picking");
+		ImGui::Text("Picked: %s", pickedObject >= 0 ? objectNames[pickedObject] : "nothing");
+		if (pickedObject >= 0) {
+			ImGui::Text("Distance: %.2f", pickedDistance);
+		}
+		ImGui::End();
+
 		//ImGui::Begin("Point Lights");
 		//ImGui::ColorEdit3("Color 1", &ptLight1.color.r);
 		//ImGui::DragFloat3("Position 1", &lightTransform1.position.r, 1, -1, 1);
@@ -403,16 +775,45 @@ int main() {
 		//ImGui::SliderFloat("Falloff Curve", &spLight.falloffCurve, 0, 1);
 		//ImGui::End();
 
+		ImGui::Begin("Clustered Lights");
+		ImGui::SliderInt("Stress Lights", &numStressLights, 0, 4096);
+		ImGui::SliderFloat("Stress Light Radius", &stressLightRadius, 0.25f, 5.0f);
+		ImGui::SliderFloat("Stress Orbit Speed", &stressLightOrbitSpeed, 0.0f, 2.0f);
+		ImGui::Text("Lights: %d", (int)ptLightData.size() + (int)spLightData.size());
+		ImGui::Text("Clusters: %d", lightClusters.getNumClusters());
+		ImGui::Text("Light indices: %d", lightClusters.getNumIndices());
+		ImGui::Text("Max lights per cluster: %d", lightClusters.getMaxLightsPerCluster());
+		ImGui::Text("Frame time: %.2f ms", deltaTime * 1000.0f);
+		ImGui::End();
+
+		profiler.drawUI();
+
 		ImGui::Render();
 
+		profiler.beginScope("UI");
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		profiler.endScope();
+		profiler.setCounter("GL state calls issued", glState.getNumIssued());
+		profiler.setCounter("GL state calls filtered", glState.getNumFiltered());
+		glState.resetCounters();
+		profiler.endFrame();
 		glfwPollEvents();
 
-		glfwSwapBuffers(window);
+		if (!headless) {
+			glfwSwapBuffers(window);
+		}
+		frameIndex++;
 	}
 
-	//Delete
-	//glDeleteFramebuffers(1, &fbo);
+	if (headless) {
+		profiler.flush();
+		frameRecorder.printJson(stdout, "Shadow Map", SCREEN_WIDTH, SCREEN_HEIGHT);
+	}
+	if (ew::TraceRecorder::get().isEnabled()) {
+		//Puts the last frames' GPU times on the trace
+		profiler.flush();
+		ew::TraceRecorder::get().writeJson("trace.json");
+	}
 
 	glfwTerminate();
 	return 0;
@@ -423,7 +824,7 @@ void resizeFrameBufferCallback(GLFWwindow* window, int width, int height)
 	SCREEN_WIDTH = width;
 	SCREEN_HEIGHT = height;
 	camera.setAspectRatio((float)SCREEN_WIDTH / SCREEN_HEIGHT);
-	glViewport(0, 0, width, height);
+	ew::GLState::get().viewport(0, 0, width, height);
 }
 //Author: Eric Winebrenner
 void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action, int mods)
@@ -438,6 +839,9 @@ void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action,
 		camera.setPitch(0.0f);
 		firstMouseInput = false;
 	}
+	if (keycode == GLFW_KEY_F9 && action == GLFW_PRESS) {
+		ew::TraceRecorder::get().writeJson("trace.json");
+	}
 	if (keycode == GLFW_KEY_1 && action == GLFW_PRESS) {
 		wireFrame = !wireFrame;
 		glPolygonMode(GL_FRONT_AND_BACK, wireFrame ? GL_LINE : GL_FILL);
@@ -454,6 +858,8 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 //Author: Eric Winebrenner
 void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
 {
+	mouseX = xpos;
+	mouseY = ypos;
 	if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED) {
 		return;
 	}
@@ -479,6 +885,10 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 		glfwSetInputMode(window, GLFW_CURSOR, inputMode);
 		glfwGetCursorPos(window, &prevMouseX, &prevMouseY);
 	}
+	//Pick under the cursor, or the middle of the screen while it's locked
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse) {
+		pickRequested = true;
+	}
 }
 
 //Author: Eric Winebrenner
@@ -512,99 +922,36 @@ void processInput(GLFWwindow* window) {
 	camera.setPosition(position);
 }
 
-//Create a function that loads a tecture from a file and returns a handle to it.
-GLuint createTexture(const char* filePath) {
-
-	//Generate a texture name
-	GLuint texture;
-	glGenTextures(1, &texture);
+//Queue a texture to load in the background and return a handle to it straight away.
+//It shows placeholderColor until the loader has decoded and uploaded the file.
+GLuint createTexture(ew::TextureLoader& loader, const char* filePath, glm::vec4 placeholderColor) {
+	const GLenum wrapModes[] = { GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BORDER, GL_REPEAT, GL_MIRRORED_REPEAT };
 
-	//Bind our name to GL_TEXTURE_2D to make it a 2D texture.
-	glBindTexture(GL_TEXTURE_2D, texture);
-
-	//Load texture data as file
-	int width, height, numComponents;
-	unsigned char* textureData = stbi_load(filePath, &width, &height, &numComponents, 0);
-	if (textureData == NULL) {
-		printf("Texture data did not work");
-	}
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, textureData);
-
-	//Wrapping
-	switch (currentWrapMode) {
-		case 0:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			break;
-		case 1:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-			break;
-		case 2:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			break;
-		case 3:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-			break;
-	}
+	ew::TextureSettings settings;
+	settings.wrapMode = wrapModes[currentWrapMode];
 
 	//When magnififying, use nearest neighbor sampling
-	glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	settings.magFilter = GL_NEAREST;
 
 	//When minifying, use bilinear sampling
-	glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+	settings.minFilter = GL_NEAREST_MIPMAP_LINEAR;
 
-	glGenerateMipmap(GL_TEXTURE_2D);
-	
-	return texture;
+	settings.placeholderColor = placeholderColor;
+	return loader.load(filePath, settings);
 }
 
-GLuint createFBO() {
-	//Create FBO
-	GLuint fbo;
-	glGenFramebuffers(1, &fbo);
-	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-
-	glActiveTexture(GL_TEXTURE0 + fboLoc);
-
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
-
-	//Create Tecture Color Buffer
-	GLuint texture;
-	glGenTextures(1, &texture);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT32F, 2048, 2048, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	//Attach Color Buffer
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
-	glDrawBuffer(GL_NONE);
-	glReadBuffer(GL_NONE);
-
-	//Create Render Buffer Object
-	//GLuint rbo;
-	//glGenRenderbuffers(1, &rbo);
-	//glBindRenderbuffer(GL_RENDERBUFFER, rbo);
-
-	//Create storage for depth components
-	//glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT32F, SCREEN_WIDTH, SCREEN_HEIGHT);
-
-	//Attach RBO to current FBO
-	//glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rbo);
-
-	//Returns the state of the currently bound FBO
-	GLenum fboStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
-	if (fboStatus == GL_FRAMEBUFFER_COMPLETE) {
-		std::cout << "WE GOOD" << std::endl;
-	}
-	else {
-		std::cout << "WE NOT GOOD" << std::endl;
+//Scatters point lights around the cube/sphere/cylinder/plane set. Seeded so the same count gives the same layout.
+void spawnStressLights(std::vector<ew::PtLightData>& lights, int count, float radius) {
+	lights.clear();
+	lights.reserve(count);
+	srand(1234);
+	auto random01 = []() { return (float)rand() / (float)RAND_MAX; };
+	for (int i = 0; i < count; i++) {
+		ew::PtLightData light;
+		light.position = glm::vec3(random01() * 10.0f - 5.0f, random01() * 2.5f - 0.9f, random01() * 10.0f - 5.0f);
+		light.color = glm::vec3(random01(), random01(), random01());
+		light.intensity = 0.5f;
+		light.linearAtt = radius;
+		lights.push_back(light);
 	}
-
-	return fbo;
 }
@@ -0,0 +1,5 @@
+#version 450                          
+
+//Depth only, nothing to write
+void main(){         
+}
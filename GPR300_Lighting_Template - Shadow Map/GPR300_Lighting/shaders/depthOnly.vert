@@ -0,0 +1,27 @@
+#version 450                          
+#ifdef MULTI_DRAW
+#extension GL_ARB_shader_draw_parameters : require
+#endif
+layout (location = 0) in vec3 vPos;  
+
+//MULTI_DRAW is defined by the Shader variant, see main.cpp. Each draw of the multi-draw reads its own ObjectData.
+#ifdef MULTI_DRAW
+//Mirror of ew::ObjectData
+struct ObjectData{
+    mat4 model;
+    mat3 normalMatrix;
+    uint materialIndex;
+};
+layout(std430, binding = 0) readonly buffer ObjectBlock{
+    ObjectData _Objects[];
+};
+#define MODEL_MATRIX _Objects[gl_DrawIDARB].model
+#else
+uniform mat4 _Model;
+#define MODEL_MATRIX _Model
+#endif
+uniform mat4 _LightViewProj;
+
+void main(){    
+    gl_Position = _LightViewProj * MODEL_MATRIX * vec4(vPos,1);
+}
@@ -0,0 +1,354 @@
+//Author: Eric Winebrenner
+
+#include "BVH.h"
+#include <cmath>
+#include <algorithm>
+
+namespace ew {
+	//Leaves with more objects are always split, ones with fewer may be if the SAH says it's worth it
+	const int MAX_LEAF_OBJECTS = 8;
+	const int SAH_BINS = 16;
+	//Cost of visiting a node relative to testing one object
+	const float TRAVERSAL_COST = 1.0f;
+
+	AABB transformBounds(const Bounds& localBounds, const glm::mat4& modelMatrix)
+	{
+		//Each world extent is the local extents projected onto that axis (Arvo)
+		glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(localBounds.getCenter(), 1.0f));
+		glm::vec3 localExtents = localBounds.getExtents();
+		glm::vec3 extents;
+		for (int axis = 0; axis < 3; axis++) {
+			extents[axis] = fabsf(modelMatrix[0][axis]) * localExtents.x + fabsf(modelMatrix[1][axis]) * localExtents.y + fabsf(modelMatrix[2][axis]) * localExtents.z;
+		}
+		return { center - extents, center + extents };
+	}
+
+	static AABB emptyBox()
+	{
+		return { glm::vec3(INFINITY), glm::vec3(-INFINITY) };
+	}
+
+	static void growBox(AABB& box, const AABB& other)
+	{
+		box.min = glm::min(box.min, other.min);
+		box.max = glm::max(box.max, other.max);
+	}
+
+	static float surfaceArea(const AABB& box)
+	{
+		glm::vec3 size = box.max - box.min;
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	BoxClassification classifyBox(const Frustum& frustum, const AABB& box)
+	{
+		BoxClassification result = BOX_INSIDE;
+		for (const glm::vec4& plane : frustum.planes) {
+			glm::vec3 normal = glm::vec3(plane);
+			glm::vec3 furthest = glm::vec3(normal.x >= 0.0f ? box.max.x : box.min.x, normal.y >= 0.0f ? box.max.y : box.min.y, normal.z >= 0.0f ? box.max.z : box.min.z);
+			glm::vec3 nearest = glm::vec3(normal.x >= 0.0f ? box.min.x : box.max.x, normal.y >= 0.0f ? box.min.y : box.max.y, normal.z >= 0.0f ? box.min.z : box.max.z);
+			if (glm::dot(normal, furthest) + plane.w < 0.0f) {
+				return BOX_OUTSIDE;
+			}
+			if (glm::dot(normal, nearest) + plane.w < 0.0f) {
+				result = BOX_INTERSECTING;
+			}
+		}
+		return result;
+	}
+
+	bool sphereTouchesBox(const glm::vec3& center, float radius, const AABB& box)
+	{
+		glm::vec3 offset = center - glm::clamp(center, box.min, box.max);
+		return glm::dot(offset, offset) <= radius * radius;
+	}
+
+	float rayEnterDistance(const glm::vec3& origin, const glm::vec3& inverseDirection, const AABB& box)
+	{
+		glm::vec3 t0 = (box.min - origin) * inverseDirection;
+		glm::vec3 t1 = (box.max - origin) * inverseDirection;
+		glm::vec3 tNear = glm::min(t0, t1);
+		glm::vec3 tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+		float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+		return enter <= exit ? enter : INFINITY;
+	}
+
+	void BVH::build(const std::vector<AABB>& objectBounds)
+	{
+		int numObjects = (int)objectBounds.size();
+		mObjectBounds = objectBounds;
+		mObjects.resize(numObjects);
+		for (int i = 0; i < numObjects; i++) {
+			mObjects[i] = i;
+		}
+		mObjectLeaves.assign(numObjects, 0);
+		mNodes.clear();
+		mDirtyNodes.clear();
+		if (numObjects == 0) {
+			return;
+		}
+
+		mNodes.reserve(numObjects * 2);
+		mNodes.push_back({ emptyBox(), -1, 0, 0, numObjects, false });
+		//Children are always added after their parent, so refit can go by descending index
+		std::vector<int> stack = { 0 };
+		while (!stack.empty()) {
+			int node = stack.back();
+			stack.pop_back();
+			split(node);
+			if (mNodes[node].firstChild != 0) {
+				stack.push_back(mNodes[node].firstChild);
+				stack.push_back(mNodes[node].firstChild + 1);
+			}
+		}
+	}
+
+	//Bins object centers along each axis and splits at the bin boundary with the lowest SAH cost,
+	//or leaves the node a leaf if no split is cheaper than testing its objects directly
+	void BVH::split(int node)
+	{
+		int first = mNodes[node].firstObject;
+		int count = mNodes[node].numObjects;
+		AABB bounds = emptyBox();
+		AABB centers = emptyBox();
+		for (int i = first; i < first + count; i++) {
+			const AABB& box = mObjectBounds[mObjects[i]];
+			growBox(bounds, box);
+			glm::vec3 center = (box.min + box.max) * 0.5f;
+			growBox(centers, { center, center });
+		}
+		mNodes[node].bounds = bounds;
+
+		int bestAxis = -1;
+		int bestSplit = 0;
+		float bestCost = count > MAX_LEAF_OBJECTS ? INFINITY : (float)count;
+		float parentArea = std::max(surfaceArea(bounds), 1e-12f);
+		for (int axis = 0; axis < 3; axis++) {
+			float extent = centers.max[axis] - centers.min[axis];
+			if (extent <= 0.0f) {
+				continue;
+			}
+			AABB binBounds[SAH_BINS];
+			int binCounts[SAH_BINS] = {};
+			std::fill(binBounds, binBounds + SAH_BINS, emptyBox());
+			float binScale = SAH_BINS / extent;
+			for (int i = first; i < first + count; i++) {
+				const AABB& box = mObjectBounds[mObjects[i]];
+				float center = (box.min[axis] + box.max[axis]) * 0.5f;
+				int bin = std::min((int)((center - centers.min[axis]) * binScale), SAH_BINS - 1);
+				binCounts[bin]++;
+				growBox(binBounds[bin], box);
+			}
+
+			//Sweep from the right to get the cost of everything above each split, then from the left
+			float rightCosts[SAH_BINS];
+			AABB right = emptyBox();
+			int rightCount = 0;
+			for (int bin = SAH_BINS - 1; bin > 0; bin--) {
+				rightCount += binCounts[bin];
+				growBox(right, binBounds[bin]);
+				rightCosts[bin] = rightCount > 0 ? rightCount * surfaceArea(right) : 0.0f;
+			}
+			AABB left = emptyBox();
+			int leftCount = 0;
+			for (int bin = 1; bin < SAH_BINS; bin++) {
+				leftCount += binCounts[bin - 1];
+				growBox(left, binBounds[bin - 1]);
+				if (leftCount == 0 || leftCount == count) {
+					continue;
+				}
+				float cost = TRAVERSAL_COST + (leftCount * surfaceArea(left) + rightCosts[bin]) / parentArea;
+				if (cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = bin;
+				}
+			}
+		}
+
+		int middle = first;
+		if (bestAxis >= 0) {
+			float binScale = SAH_BINS / (centers.max[bestAxis] - centers.min[bestAxis]);
+			float minCenter = centers.min[bestAxis];
+			middle = (int)(std::partition(mObjects.begin() + first, mObjects.begin() + first + count, [&](int object) {
+				const AABB& box = mObjectBounds[object];
+				float center = (box.min[bestAxis] + box.max[bestAxis]) * 0.5f;
+				return std::min((int)((center - minCenter) * binScale), SAH_BINS - 1) < bestSplit;
+			}) - mObjects.begin());
+		}
+		else if (count > MAX_LEAF_OBJECTS) {
+			//Every center is in the same place, so any split is as good as another
+			middle = first + count / 2;
+		}
+
+		if (middle == first || middle == first + count) {
+			for (int i = first; i < first + count; i++) {
+				mObjectLeaves[mObjects[i]] = node;
+			}
+			return;
+		}
+
+		int firstChild = (int)mNodes.size();
+		mNodes[node].firstChild = firstChild;
+		mNodes.push_back({ emptyBox(), node, 0, first, middle - first, false });
+		mNodes.push_back({ emptyBox(), node, 0, middle, first + count - middle, false });
+	}
+
+	void BVH::markDirty(int node)
+	{
+		//Ancestors of a dirty node are already dirty, so the walk stops at the first one
+		while (node >= 0 && !mNodes[node].dirty) {
+			mNodes[node].dirty = true;
+			mDirtyNodes.push_back(node);
+			node = mNodes[node].parent;
+		}
+	}
+
+	void BVH::setObjectBounds(int object, const AABB& bounds)
+	{
+		mObjectBounds[object] = bounds;
+		markDirty(mObjectLeaves[object]);
+	}
+
+	int BVH::refit()
+	{
+		//Children come after parents, so descending order refits every child before its parent
+		std::sort(mDirtyNodes.begin(), mDirtyNodes.end(), std::greater<int>());
+		for (int index : mDirtyNodes) {
+			Node& node = mNodes[index];
+			if (node.firstChild == 0) {
+				node.bounds = emptyBox();
+				for (int i = node.firstObject; i < node.firstObject + node.numObjects; i++) {
+					growBox(node.bounds, mObjectBounds[mObjects[i]]);
+				}
+			}
+			else {
+				node.bounds = mNodes[node.firstChild].bounds;
+				growBox(node.bounds, mNodes[node.firstChild + 1].bounds);
+			}
+			node.dirty = false;
+		}
+		int numRefit = (int)mDirtyNodes.size();
+		mDirtyNodes.clear();
+		return numRefit;
+	}
+
+	void BVH::queryFrustum(const Frustum& frustum, std::vector<int>& objects)const
+	{
+		if (mNodes.empty()) {
+			return;
+		}
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+		while (!stack.empty()) {
+			const Node& node = mNodes[stack.back()];
+			stack.pop_back();
+			BoxClassification classification = classifyBox(frustum, node.bounds);
+			if (classification == BOX_OUTSIDE) {
+				continue;
+			}
+			//Everything under a node fully inside is visible without testing further
+			if (classification == BOX_INSIDE) {
+				objects.insert(objects.end(), mObjects.begin() + node.firstObject, mObjects.begin() + node.firstObject + node.numObjects);
+			}
+			else if (node.firstChild == 0) {
+				for (int i = node.firstObject; i < node.firstObject + node.numObjects; i++) {
+					if (classifyBox(frustum, mObjectBounds[mObjects[i]]) != BOX_OUTSIDE) {
+						objects.push_back(mObjects[i]);
+					}
+				}
+			}
+			else {
+				stack.push_back(node.firstChild);
+				stack.push_back(node.firstChild + 1);
+			}
+		}
+	}
+
+	void BVH::querySphere(const glm::vec3& center, float radius, std::vector<int>& objects)const
+	{
+		if (mNodes.empty()) {
+			return;
+		}
+		std::vector<int> stack;
+		stack.reserve(64);
+		stack.push_back(0);
+		while (!stack.empty()) {
+			const Node& node = mNodes[stack.back()];
+			stack.pop_back();
+			if (!sphereTouchesBox(center, radius, node.bounds)) {
+				continue;
+			}
+			if (node.firstChild == 0) {
+				for (int i = node.firstObject; i < node.firstObject + node.numObjects; i++) {
+					if (sphereTouchesBox(center, radius, mObjectBounds[mObjects[i]])) {
+						objects.push_back(mObjects[i]);
+					}
+				}
+			}
+			else {
+				stack.push_back(node.firstChild);
+				stack.push_back(node.firstChild + 1);
+			}
+		}
+	}
+
+	int BVH::raycast(const glm::vec3& origin, const glm::vec3& direction, float* hitDistance)const
+	{
+		int closestObject = -1;
+		float closestDistance = INFINITY;
+		if (mNodes.empty()) {
+			return closestObject;
+		}
+		glm::vec3 inverseDirection = 1.0f / direction;
+
+		//Nodes are stored with the distance the ray enters them, so ones behind the closest hit are skipped
+		struct Entry {
+			int node;
+			float distance;
+		};
+		std::vector<Entry> stack;
+		stack.reserve(64);
+		float rootDistance = rayEnterDistance(origin, inverseDirection, mNodes[0].bounds);
+		if (rootDistance < INFINITY) {
+			stack.push_back({ 0, rootDistance });
+		}
+		while (!stack.empty()) {
+			Entry entry = stack.back();
+			stack.pop_back();
+			if (entry.distance >= closestDistance) {
+				continue;
+			}
+			const Node& node = mNodes[entry.node];
+			if (node.firstChild == 0) {
+				for (int i = node.firstObject; i < node.firstObject + node.numObjects; i++) {
+					float distance = rayEnterDistance(origin, inverseDirection, mObjectBounds[mObjects[i]]);
+					if (distance < closestDistance) {
+						closestDistance = distance;
+						closestObject = mObjects[i];
+					}
+				}
+				continue;
+			}
+			//Push the nearer child last so it's visited first
+			Entry nearChild = { node.firstChild, rayEnterDistance(origin, inverseDirection, mNodes[node.firstChild].bounds) };
+			Entry farChild = { node.firstChild + 1, rayEnterDistance(origin, inverseDirection, mNodes[node.firstChild + 1].bounds) };
+			if (farChild.distance < nearChild.distance) {
+				std::swap(nearChild, farChild);
+			}
+			if (farChild.distance < closestDistance) {
+				stack.push_back(farChild);
+			}
+			if (nearChild.distance < closestDistance) {
+				stack.push_back(nearChild);
+			}
+		}
+
+		if (hitDistance != nullptr) {
+			*hitDistance = closestDistance;
+		}
+		return closestObject;
+	}
+}
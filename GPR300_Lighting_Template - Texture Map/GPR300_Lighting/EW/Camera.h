@@ -3,6 +3,7 @@
 #include <glm/glm.hpp>
 #include <glm/matrix.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include "Frustum.h"
 
 class Camera {
 public:
@@ -13,9 +14,18 @@ public:
 	inline float getYaw()const { return mYaw; }
 	inline float getPitch()const { return mPitch; }
 	inline float getFov()const { return mFov; }
+	inline float getNearPlane()const { return mNearPlane; }
+	inline float getFarPlane()const { return mFarPlane; }
+	inline float getOrthoSize()const { return mOrthoSize; }
+	inline bool isOrtho()const { return mOrtho; }
+	inline float getAspectRatio()const { return mAspectRatio; }
 	glm::vec3 getForward();
 	glm::mat4 getProjectionMatrix();
 	glm::mat4 getViewMatrix();
+	//Planes of getProjectionMatrix() * getViewMatrix(), for culling
+	ew::Frustum getFrustum();
+	//World space direction through a point on screen, from (-1,-1) bottom left to (1,1) top right. Starts at getPosition().
+	glm::vec3 getRayDirection(glm::vec2 ndc);
 	//SETTERS
 	inline void setPosition(const glm::vec3 position) { mPosition = position; }
 	inline void setYaw(const float yaw) { mYaw = yaw; };
@@ -0,0 +1,35 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <glm/glm.hpp>
+
+namespace ew {
+	/// <summary>
+	/// The 6 planes bounding what a view projection matrix can see, as (normal, distance) with normals pointing inward.
+	/// A point p is inside a plane when dot(normal, p) + distance >= 0.
+	/// </summary>
+	struct Frustum {
+		//Prefixed because windows.h defines NEAR and FAR as macros
+		enum Plane { PLANE_LEFT, PLANE_RIGHT, PLANE_BOTTOM, PLANE_TOP, PLANE_NEAR, PLANE_FAR, NUM_PLANES };
+		glm::vec4 planes[NUM_PLANES];
+
+		Frustum() = default;
+		//Gribb/Hartmann: each plane is the last row of the matrix plus or minus one of the others, in GL's -w..w clip space
+		explicit Frustum(const glm::mat4& viewProjection) {
+			glm::vec4 rows[4];
+			for (int i = 0; i < 4; i++) {
+				rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+			}
+			planes[PLANE_LEFT] = rows[3] + rows[0];
+			planes[PLANE_RIGHT] = rows[3] - rows[0];
+			planes[PLANE_BOTTOM] = rows[3] + rows[1];
+			planes[PLANE_TOP] = rows[3] - rows[1];
+			planes[PLANE_NEAR] = rows[3] + rows[2];
+			planes[PLANE_FAR] = rows[3] - rows[2];
+			//Normalized so plane distances are in world units and can be compared against radii
+			for (glm::vec4& plane : planes) {
+				plane /= glm::length(glm::vec3(plane));
+			}
+		}
+	};
+}
@@ -0,0 +1,115 @@
+//Author: Eric Winebrenner
+
+#include "FrustumCuller.h"
+#include "Profiler.h"
+#include <cmath>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define EW_FRUSTUM_CULLER_SSE
+#include <emmintrin.h>
+#endif
+
+namespace ew {
+	void FrustumCuller::clear()
+	{
+		mCount = 0;
+		mLocalBounds.clear();
+		for (std::vector<float>* array : { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ, &mRadius }) {
+			array->clear();
+		}
+		mVisible.clear();
+		mVisibleIndices.clear();
+	}
+
+	int FrustumCuller::add(const Bounds& localBounds, const glm::mat4& modelMatrix)
+	{
+		int index = mCount++;
+		mLocalBounds.push_back(localBounds);
+		size_t paddedSize = (mCount + 3) & ~3;
+		for (std::vector<float>* array : { &mCenterX, &mCenterY, &mCenterZ, &mExtentX, &mExtentY, &mExtentZ, &mRadius }) {
+			array->resize(paddedSize, 0.0f);
+		}
+		setModelMatrix(index, modelMatrix);
+		return index;
+	}
+
+	void FrustumCuller::setModelMatrix(int index, const glm::mat4& modelMatrix)
+	{
+		const Bounds& localBounds = mLocalBounds[index];
+		glm::vec3 center = glm::vec3(modelMatrix * glm::vec4(localBounds.getCenter(), 1.0f));
+		//Box of the transformed box: each world extent is the local extents projected onto that axis (Arvo)
+		glm::vec3 localExtents = localBounds.getExtents();
+		glm::vec3 extents;
+		for (int axis = 0; axis < 3; axis++) {
+			extents[axis] = fabsf(modelMatrix[0][axis]) * localExtents.x + fabsf(modelMatrix[1][axis]) * localExtents.y + fabsf(modelMatrix[2][axis]) * localExtents.z;
+		}
+		//Non-uniform scale stretches the sphere into an ellipsoid, so use the largest axis
+		float maxScale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+
+		mCenterX[index] = center.x;
+		mCenterY[index] = center.y;
+		mCenterZ[index] = center.z;
+		mExtentX[index] = extents.x;
+		mExtentY[index] = extents.y;
+		mExtentZ[index] = extents.z;
+		mRadius[index] = localBounds.radius * maxScale;
+	}
+
+	//An object is outside a plane when its center is further behind it than the smaller of its radius and
+	//its box's projected half size. It's culled if it's outside any plane.
+	void FrustumCuller::cull(const Frustum& frustum)
+	{
+		ProfileScope scope("FrustumCull");
+		mVisible.assign(mCenterX.size(), 1);
+		mVisibleIndices.clear();
+
+#ifdef EW_FRUSTUM_CULLER_SSE
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		for (int i = 0; i < mCount; i += 4) {
+			__m128 centerX = _mm_loadu_ps(&mCenterX[i]);
+			__m128 centerY = _mm_loadu_ps(&mCenterY[i]);
+			__m128 centerZ = _mm_loadu_ps(&mCenterZ[i]);
+			__m128 extentX = _mm_loadu_ps(&mExtentX[i]);
+			__m128 extentY = _mm_loadu_ps(&mExtentY[i]);
+			__m128 extentZ = _mm_loadu_ps(&mExtentZ[i]);
+			__m128 radius = _mm_loadu_ps(&mRadius[i]);
+
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (const glm::vec4& plane : frustum.planes) {
+				__m128 normalX = _mm_set1_ps(plane.x);
+				__m128 normalY = _mm_set1_ps(plane.y);
+				__m128 normalZ = _mm_set1_ps(plane.z);
+				__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normalX, centerX), _mm_mul_ps(normalY, centerY)),
+					_mm_add_ps(_mm_mul_ps(normalZ, centerZ), _mm_set1_ps(plane.w)));
+				__m128 boxRadius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(normalX, absMask), extentX), _mm_mul_ps(_mm_and_ps(normalY, absMask), extentY)),
+					_mm_mul_ps(_mm_and_ps(normalZ, absMask), extentZ));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, _mm_min_ps(radius, boxRadius)), zero));
+			}
+
+			int mask = _mm_movemask_ps(inside);
+			for (int lane = 0; lane < 4; lane++) {
+				mVisible[i + lane] = (mask >> lane) & 1;
+			}
+		}
+#else
+		for (int i = 0; i < mCount; i++) {
+			for (const glm::vec4& plane : frustum.planes) {
+				float distance = plane.x * mCenterX[i] + plane.y * mCenterY[i] + plane.z * mCenterZ[i] + plane.w;
+				float boxRadius = fabsf(plane.x) * mExtentX[i] + fabsf(plane.y) * mExtentY[i] + fabsf(plane.z) * mExtentZ[i];
+				if (distance + std::min(mRadius[i], boxRadius) < 0.0f) {
+					mVisible[i] = 0;
+					break;
+				}
+			}
+		}
+#endif
+
+		for (int i = 0; i < mCount; i++) {
+			if (mVisible[i]) {
+				mVisibleIndices.push_back(i);
+			}
+		}
+	}
+}
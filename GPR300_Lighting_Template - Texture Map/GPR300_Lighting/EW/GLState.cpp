@@ -0,0 +1,347 @@
+//Author: Eric Winebrenner
+
+#include "GLState.h"
+
+namespace ew {
+	GLState::GLState()
+	{
+		invalidate();
+	}
+
+	GLState& GLState::get()
+	{
+		static GLState state;
+		return state;
+	}
+
+	void GLState::invalidate()
+	{
+		mProgram = UNKNOWN;
+		mVertexArray = UNKNOWN;
+		mActiveTexture = UNKNOWN;
+		for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+			for (int target = 0; target < NUM_TEXTURE_TARGETS; target++) {
+				mTextures[unit][target] = UNKNOWN;
+			}
+		}
+		for (int i = 0; i < NUM_CAPABILITIES; i++) {
+			mEnabled[i] = UNKNOWN;
+		}
+		mDepthFunc = UNKNOWN;
+		mDepthMask = UNKNOWN;
+		mStencilFunc = UNKNOWN;
+		mStencilOp[0] = mStencilOp[1] = mStencilOp[2] = UNKNOWN;
+		mStencilMask = UNKNOWN;
+		mBlendFunc[0] = mBlendFunc[1] = UNKNOWN;
+		mCullFace = UNKNOWN;
+		mPolygonOffsetKnown = false;
+		mViewportKnown = false;
+	}
+
+	bool GLState::filter(bool unchanged)
+	{
+		if (unchanged) {
+			mNumFiltered++;
+		}
+		else {
+			mNumIssued++;
+		}
+		return unchanged;
+	}
+
+	int GLState::textureTargetIndex(GLenum target)
+	{
+		switch (target) {
+		case GL_TEXTURE_2D:
+			return 0;
+		case GL_TEXTURE_2D_ARRAY:
+			return 1;
+		case GL_TEXTURE_CUBE_MAP:
+			return 2;
+		case GL_TEXTURE_3D:
+			return 3;
+		default:
+			return -1;
+		}
+	}
+
+	int GLState::capabilityIndex(GLenum capability)
+	{
+		switch (capability) {
+		case GL_DEPTH_TEST:
+			return 0;
+		case GL_STENCIL_TEST:
+			return 1;
+		case GL_BLEND:
+			return 2;
+		case GL_CULL_FACE:
+			return 3;
+		case GL_POLYGON_OFFSET_FILL:
+			return 4;
+		case GL_SCISSOR_TEST:
+			return 5;
+		default:
+			return -1;
+		}
+	}
+
+	void GLState::useProgram(GLuint program)
+	{
+		if (filter(mProgram == program)) {
+			return;
+		}
+		glUseProgram(program);
+		mProgram = program;
+	}
+
+	void GLState::bindVertexArray(GLuint vertexArray)
+	{
+		if (filter(mVertexArray == vertexArray)) {
+			return;
+		}
+		glBindVertexArray(vertexArray);
+		mVertexArray = vertexArray;
+	}
+
+	void GLState::activeTexture(GLenum textureUnit)
+	{
+		if (filter(mActiveTexture == textureUnit)) {
+			return;
+		}
+		glActiveTexture(textureUnit);
+		mActiveTexture = textureUnit;
+	}
+
+	void GLState::bindTexture(GLenum target, GLuint texture)
+	{
+		//The unit has to be known, or a binding could land on a unit whose cached texture then goes stale
+		int unit = (int)(getActiveTexture() - GL_TEXTURE0);
+		int targetIndex = textureTargetIndex(target);
+		bool cached = unit >= 0 && unit < MAX_TEXTURE_UNITS && targetIndex >= 0;
+		if (filter(cached && mTextures[unit][targetIndex] == texture)) {
+			return;
+		}
+		glBindTexture(target, texture);
+		if (cached) {
+			mTextures[unit][targetIndex] = texture;
+		}
+	}
+
+	void GLState::setEnabled(GLenum capability, bool enabled)
+	{
+		int index = capabilityIndex(capability);
+		if (filter(index >= 0 && mEnabled[index] == (GLuint)enabled)) {
+			return;
+		}
+		if (enabled) {
+			glEnable(capability);
+		}
+		else {
+			glDisable(capability);
+		}
+		if (index >= 0) {
+			mEnabled[index] = enabled;
+		}
+	}
+
+	void GLState::enable(GLenum capability)
+	{
+		setEnabled(capability, true);
+	}
+
+	void GLState::disable(GLenum capability)
+	{
+		setEnabled(capability, false);
+	}
+
+	void GLState::depthFunc(GLenum func)
+	{
+		if (filter(mDepthFunc == func)) {
+			return;
+		}
+		glDepthFunc(func);
+		mDepthFunc = func;
+	}
+
+	void GLState::depthMask(GLboolean flag)
+	{
+		if (filter(mDepthMask == (GLuint)flag)) {
+			return;
+		}
+		glDepthMask(flag);
+		mDepthMask = flag;
+	}
+
+	void GLState::stencilFunc(GLenum func, GLint ref, GLuint mask)
+	{
+		if (filter(mStencilFunc == func && mStencilRef == ref && mStencilFuncMask == mask)) {
+			return;
+		}
+		glStencilFunc(func, ref, mask);
+		mStencilFunc = func;
+		mStencilRef = ref;
+		mStencilFuncMask = mask;
+	}
+
+	void GLState::stencilOp(GLenum stencilFail, GLenum depthFail, GLenum depthPass)
+	{
+		if (filter(mStencilOp[0] == stencilFail && mStencilOp[1] == depthFail && mStencilOp[2] == depthPass)) {
+			return;
+		}
+		glStencilOp(stencilFail, depthFail, depthPass);
+		mStencilOp[0] = stencilFail;
+		mStencilOp[1] = depthFail;
+		mStencilOp[2] = depthPass;
+	}
+
+	//UNKNOWN is also a valid mask, so a mask of all ones is sent the first time it is set either way
+	void GLState::stencilMask(GLuint mask)
+	{
+		if (filter(mStencilMask == mask && mask != UNKNOWN)) {
+			return;
+		}
+		glStencilMask(mask);
+		mStencilMask = mask;
+	}
+
+	void GLState::blendFunc(GLenum sourceFactor, GLenum destinationFactor)
+	{
+		if (filter(mBlendFunc[0] == sourceFactor && mBlendFunc[1] == destinationFactor)) {
+			return;
+		}
+		glBlendFunc(sourceFactor, destinationFactor);
+		mBlendFunc[0] = sourceFactor;
+		mBlendFunc[1] = destinationFactor;
+	}
+
+	void GLState::cullFace(GLenum mode)
+	{
+		if (filter(mCullFace == mode)) {
+			return;
+		}
+		glCullFace(mode);
+		mCullFace = mode;
+	}
+
+	void GLState::polygonOffset(GLfloat factor, GLfloat units)
+	{
+		if (filter(mPolygonOffsetKnown && mPolygonOffset[0] == factor && mPolygonOffset[1] == units)) {
+			return;
+		}
+		glPolygonOffset(factor, units);
+		mPolygonOffset[0] = factor;
+		mPolygonOffset[1] = units;
+		mPolygonOffsetKnown = true;
+	}
+
+	void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		if (filter(mViewportKnown && mViewport[0] == x && mViewport[1] == y && mViewport[2] == width && mViewport[3] == height)) {
+			return;
+		}
+		glViewport(x, y, width, height);
+		mViewport[0] = x;
+		mViewport[1] = y;
+		mViewport[2] = width;
+		mViewport[3] = height;
+		mViewportKnown = true;
+	}
+
+	GLuint GLState::getProgram()
+	{
+		if (mProgram == UNKNOWN) {
+			GLint program;
+			glGetIntegerv(GL_CURRENT_PROGRAM, &program);
+			mProgram = program;
+		}
+		return mProgram;
+	}
+
+	GLuint GLState::getVertexArray()
+	{
+		if (mVertexArray == UNKNOWN) {
+			GLint vertexArray;
+			glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &vertexArray);
+			mVertexArray = vertexArray;
+		}
+		return mVertexArray;
+	}
+
+	GLenum GLState::getActiveTexture()
+	{
+		if (mActiveTexture == UNKNOWN) {
+			GLint activeTexture;
+			glGetIntegerv(GL_ACTIVE_TEXTURE, &activeTexture);
+			mActiveTexture = activeTexture;
+		}
+		return mActiveTexture;
+	}
+
+	GLuint GLState::getTexture(GLenum target)
+	{
+		int unit = (int)(getActiveTexture() - GL_TEXTURE0);
+		int targetIndex = textureTargetIndex(target);
+		bool cached = unit >= 0 && unit < MAX_TEXTURE_UNITS && targetIndex >= 0;
+		if (cached && mTextures[unit][targetIndex] != UNKNOWN) {
+			return mTextures[unit][targetIndex];
+		}
+		const GLenum bindingQueries[NUM_TEXTURE_TARGETS] = { GL_TEXTURE_BINDING_2D, GL_TEXTURE_BINDING_2D_ARRAY, GL_TEXTURE_BINDING_CUBE_MAP, GL_TEXTURE_BINDING_3D };
+		if (targetIndex < 0) {
+			return 0;
+		}
+		GLint texture;
+		glGetIntegerv(bindingQueries[targetIndex], &texture);
+		if (cached) {
+			mTextures[unit][targetIndex] = texture;
+		}
+		return texture;
+	}
+
+	GLboolean GLState::isEnabled(GLenum capability)
+	{
+		int index = capabilityIndex(capability);
+		if (index < 0) {
+			return glIsEnabled(capability);
+		}
+		if (mEnabled[index] == UNKNOWN) {
+			mEnabled[index] = glIsEnabled(capability);
+		}
+		return (GLboolean)mEnabled[index];
+	}
+
+	void GLState::getViewport(GLint viewport[4])
+	{
+		if (!mViewportKnown) {
+			glGetIntegerv(GL_VIEWPORT, mViewport);
+			mViewportKnown = true;
+		}
+		for (int i = 0; i < 4; i++) {
+			viewport[i] = mViewport[i];
+		}
+	}
+
+	void GLState::forgetProgram(GLuint program)
+	{
+		if (mProgram == program) {
+			mProgram = UNKNOWN;
+		}
+	}
+
+	void GLState::forgetVertexArray(GLuint vertexArray)
+	{
+		if (mVertexArray == vertexArray) {
+			mVertexArray = UNKNOWN;
+		}
+	}
+
+	void GLState::forgetTexture(GLuint texture)
+	{
+		for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+			for (int target = 0; target < NUM_TEXTURE_TARGETS; target++) {
+				if (mTextures[unit][target] == texture) {
+					mTextures[unit][target] = UNKNOWN;
+				}
+			}
+		}
+	}
+}
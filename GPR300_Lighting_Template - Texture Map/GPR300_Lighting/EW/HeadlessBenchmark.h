@@ -0,0 +1,86 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "Camera.h"
+#include "Profiler.h"
+#include "Shader.h"
+#include "Mesh.h"
+
+namespace ew {
+	//Headless frames advance by a fixed step, so every run animates exactly the same
+	const float HEADLESS_TIMESTEP = 1.0f / 60.0f;
+	//Frames run before recording starts, while textures stream in and shaders settle
+	const int HEADLESS_WARMUP_FRAMES = 10;
+
+	//Orbits the origin, rising and falling, always looking at the middle of the scene
+	void followBenchmarkPath(Camera& camera, float time);
+
+	//Draws each mesh drawsPerMesh times a frame into a tiny offscreen target, so vertices are nearly all the work,
+	//once with the variant that inverts the model matrix per vertex and once with the current one reading _NormalMatrix.
+	//Prints the median GPU time of each.
+	void benchmarkNormalMatrix(Shader& shader, uint32_t inverseMask, UniformHandle modelUniform, UniformHandle normalMatrixUniform,
+		const std::vector<Mesh*>& meshes, int drawsPerMesh);
+
+	//Times setting mat4 uniforms by looking their location up on every call, as the setters once did,
+	//against the string_view and UniformHandle setters, and prints the cost per call
+	void benchmarkUniformSetters(Shader& shader, const std::vector<std::string>& mat4Names, int numIterations);
+
+	//Times Transform::getModelMatrix() + getNormalMatrix() per object against TransformBatch::update() for each count and prints the results.
+	//Needs no GL context.
+	void benchmarkTransformBatch(const std::vector<int>& counts);
+
+	//Builds deep hierarchies and times update() with different numbers of changed nodes against recomputing every node.
+	//Needs no GL context.
+	void benchmarkSceneGraph();
+
+	//Times build, refit and queries against testing every object, with random boxes at 10k, 100k and 1M objects.
+	//Needs no GL context.
+	void benchmarkBVH(const std::vector<int>& objectCounts);
+
+	/// <summary>
+	/// Color and depth renderbuffers to draw into instead of a window's framebuffer.
+	/// Does nothing until create() is called, and getFramebuffer() is 0 meanwhile, so it can stand in for the window either way.
+	/// </summary>
+	class OffscreenTarget {
+	public:
+		OffscreenTarget() = default;
+		~OffscreenTarget();
+		void create(int width, int height);
+		inline GLuint getFramebuffer()const { return mFBO; }
+	private:
+		OffscreenTarget(const OffscreenTarget& r) = delete;
+		GLuint mFBO = 0;
+		GLuint mColor = 0;
+		GLuint mDepth = 0;
+	};
+
+	/// <summary>
+	/// Keeps every frame a Profiler finishes for a benchmark run, reported as JSON.
+	/// Frame times cover beginFrame() to endFrame() of the profiler, pass times are its scopes, nested ones named parent/child.
+	/// </summary>
+	class FrameRecorder {
+	public:
+		FrameRecorder() = default;
+		~FrameRecorder();
+		//Records the profiler's frames from warmupFrames frames from now, until destroyed
+		void attach(Profiler& profiler, int warmupFrames);
+		//Mean, min, percentiles and max of frame times and each pass
+		void printJson(FILE* file, const char* benchmarkName, int width, int height)const;
+		inline int getNumFrames()const { return (int)mCpuFrameMs.size(); }
+	private:
+		FrameRecorder(const FrameRecorder& r) = delete;
+		void record(const ProfileFrame& frame);
+		int findPass(const std::string& name);
+
+		Profiler* mProfiler = nullptr;
+		uint64_t mFirstFrame = 0;
+		std::vector<std::string> mPassNames;
+		std::vector<std::vector<double>> mPassGpuMs;
+		std::vector<double> mCpuFrameMs;
+		std::vector<double> mGpuFrameMs;
+	};
+}
@@ -0,0 +1,146 @@
+//Author: Eric Winebrenner
+
+#include "LightClusters.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ew {
+	LightClusters::LightClusters(int gridX, int gridY, int gridZ)
+		: mGridX(gridX), mGridY(gridY), mGridZ(gridZ),
+		mClusterUBO(sizeof(ClusterBlock), CLUSTER_BLOCK_BINDING),
+		mPtLightBuffer(CLUSTER_PT_LIGHT_BINDING),
+		mSpLightBuffer(CLUSTER_SP_LIGHT_BINDING),
+		mGridBuffer(CLUSTER_GRID_BINDING),
+		mIndexBuffer(CLUSTER_INDEX_BINDING)
+	{
+	}
+
+	//Exponential slicing: slice = log(depth) * scale - bias. Must match getClusterIndex() in defaultLit.frag.
+	int LightClusters::getDepthSlice(float viewDepth) const
+	{
+		float scale = (float)mGridZ / logf(mFarZ / mNearZ);
+		float bias = (float)mGridZ * logf(mNearZ) / logf(mFarZ / mNearZ);
+		int slice = (int)floorf(logf(std::max(viewDepth, 1e-4f)) * scale - bias);
+		return glm::clamp(slice, 0, mGridZ - 1);
+	}
+
+	//Conservative froxel range of a light's bounding sphere
+	LightClusters::ClusterRange LightClusters::getClusterRange(const glm::vec3& worldPosition, float radius, const glm::mat4& view, const glm::mat4& projection) const
+	{
+		ClusterRange range;
+		glm::vec3 center = glm::vec3(view * glm::vec4(worldPosition, 1));
+		float depth = -center.z;
+		float farDepth = depth + radius;
+		if (farDepth <= 0.0f) {
+			//Entirely behind the camera
+			return range;
+		}
+		float nearDepth = std::max(depth - radius, 1e-3f);
+
+		//Projects a view-space extent into NDC. For perspective the extreme value comes from
+		//the nearest depth when moving away from the axis, and the farthest when moving towards it.
+		bool perspective = projection[2][3] != 0.0f;
+		auto toNdc = [&](float v, float scale, float offset, bool maximum) {
+			if (!perspective) {
+				return v * scale + offset;
+			}
+			bool awayFromAxis = maximum ? v > 0.0f : v < 0.0f;
+			return v * scale / (awayFromAxis ? nearDepth : farDepth);
+		};
+		float minNdcX = toNdc(center.x - radius, projection[0][0], projection[3][0], false);
+		float maxNdcX = toNdc(center.x + radius, projection[0][0], projection[3][0], true);
+		float minNdcY = toNdc(center.y - radius, projection[1][1], projection[3][1], false);
+		float maxNdcY = toNdc(center.y + radius, projection[1][1], projection[3][1], true);
+		if (maxNdcX < -1.0f || minNdcX > 1.0f || maxNdcY < -1.0f || minNdcY > 1.0f) {
+			return range;
+		}
+
+		auto toTile = [](float ndc, int gridSize) {
+			return glm::clamp((int)floorf((ndc * 0.5f + 0.5f) * gridSize), 0, gridSize - 1);
+		};
+		range.minX = toTile(minNdcX, mGridX);
+		range.maxX = toTile(maxNdcX, mGridX);
+		range.minY = toTile(minNdcY, mGridY);
+		range.maxY = toTile(maxNdcY, mGridY);
+		range.minZ = getDepthSlice(depth - radius);
+		range.maxZ = getDepthSlice(farDepth);
+		return range;
+	}
+
+	void LightClusters::build(const std::vector<PtLightData>& ptLights, const std::vector<SpLightData>& spLights,
+		const glm::mat4& view, const glm::mat4& projection, int screenWidth, int screenHeight)
+	{
+		ProfileScope scope("LightClusters");
+		int numClusters = getNumClusters();
+		mGrid.assign(numClusters, glm::uvec4(0));
+
+		//Lights reach zero at linearAtt (windowed falloff), so that is their radius.
+		//Spot lights use the same sphere, which is conservative for the cone.
+		mPtRanges.resize(ptLights.size());
+		for (size_t i = 0; i < ptLights.size(); i++) {
+			mPtRanges[i] = getClusterRange(ptLights[i].position, ptLights[i].linearAtt, view, projection);
+		}
+		mSpRanges.resize(spLights.size());
+		for (size_t i = 0; i < spLights.size(); i++) {
+			mSpRanges[i] = getClusterRange(spLights[i].position, spLights[i].linearAtt, view, projection);
+		}
+
+		auto forEachCluster = [&](const ClusterRange& range, auto&& func) {
+			for (int z = range.minZ; z <= range.maxZ; z++) {
+				for (int y = range.minY; y <= range.maxY; y++) {
+					for (int x = range.minX; x <= range.maxX; x++) {
+						func(x + mGridX * (y + mGridY * z));
+					}
+				}
+			}
+		};
+
+		//Count lights per cluster
+		for (const ClusterRange& range : mPtRanges) {
+			forEachCluster(range, [&](int cluster) { mGrid[cluster].y++; });
+		}
+		for (const ClusterRange& range : mSpRanges) {
+			forEachCluster(range, [&](int cluster) { mGrid[cluster].z++; });
+		}
+
+		//Prefix sum into offsets
+		unsigned int numIndices = 0;
+		mMaxLightsPerCluster = 0;
+		for (glm::uvec4& cluster : mGrid) {
+			cluster.x = numIndices;
+			numIndices += cluster.y + cluster.z;
+			mMaxLightsPerCluster = std::max(mMaxLightsPerCluster, (int)(cluster.y + cluster.z));
+			//Reused below as fill cursors
+			cluster.w = 0;
+		}
+		mIndices.resize(numIndices);
+
+		//Fill index list. Point lights first, then spot lights.
+		for (size_t i = 0; i < mPtRanges.size(); i++) {
+			forEachCluster(mPtRanges[i], [&](int cluster) {
+				glm::uvec4& c = mGrid[cluster];
+				mIndices[c.x + c.w++] = (unsigned int)i;
+			});
+		}
+		for (size_t i = 0; i < mSpRanges.size(); i++) {
+			forEachCluster(mSpRanges[i], [&](int cluster) {
+				glm::uvec4& c = mGrid[cluster];
+				mIndices[c.x + c.w++] = (unsigned int)i;
+			});
+		}
+
+		ClusterBlock clusterBlock;
+		clusterBlock.view = view;
+		clusterBlock.gridSize = glm::uvec4(mGridX, mGridY, mGridZ, 0);
+		clusterBlock.depthParams.x = (float)mGridZ / logf(mFarZ / mNearZ);
+		clusterBlock.depthParams.y = (float)mGridZ * logf(mNearZ) / logf(mFarZ / mNearZ);
+		clusterBlock.screenSize = glm::vec2(screenWidth, screenHeight);
+		mClusterUBO.update(clusterBlock);
+
+		mPtLightBuffer.upload(ptLights);
+		mSpLightBuffer.upload(spLights);
+		mGridBuffer.upload(mGrid);
+		mIndexBuffer.upload(mIndices);
+	}
+}
@@ -1,11 +1,49 @@
 //Author: Eric Winebrenner
 
 #include "Mesh.h"
+#include "GLState.h"
+#include "GeometryPool.h"
+#include "Trace.h"
+#include <algorithm>
 namespace ew {
-	Mesh::Mesh(MeshData* meshData) {
+	Bounds computeBounds(const std::vector<Vertex>& vertices)
+	{
+		Bounds bounds;
+		if (vertices.empty()) {
+			return bounds;
+		}
+		bounds.min = bounds.max = vertices[0].position;
+		for (const Vertex& vertex : vertices) {
+			bounds.min = glm::min(bounds.min, vertex.position);
+			bounds.max = glm::max(bounds.max, vertex.position);
+		}
+		glm::vec3 center = bounds.getCenter();
+		float radiusSquared = 0.0f;
+		for (const Vertex& vertex : vertices) {
+			glm::vec3 offset = vertex.position - center;
+			radiusSquared = std::max(radiusSquared, glm::dot(offset, offset));
+		}
+		bounds.radius = sqrtf(radiusSquared);
+		return bounds;
+	}
+
+	void setVertexAttributes()
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, position)));
+		glEnableVertexAttribArray(0);
+
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, normal)));
+		glEnableVertexAttribArray(1);
+
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, uv)));
+		glEnableVertexAttribArray(2);
+	}
+
+	Mesh::Mesh(MeshData* meshData, bool releaseMeshData) {
+		EW_TRACE_SCOPE("Create mesh", "asset");
 
 		glGenVertexArrays(1, &mVAO);
-		glBindVertexArray(mVAO);
+		GLState::get().bindVertexArray(mVAO);
 
 		glGenBuffers(1, &mVBO);
 		glBindBuffer(GL_ARRAY_BUFFER, mVBO);
@@ -15,29 +53,91 @@ namespace ew {
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mEBO);
 		glBufferData(GL_ELEMENT_ARRAY_BUFFER, meshData->indices.size() * sizeof(unsigned int), &meshData->indices[0], GL_STATIC_DRAW);
 
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, position)));
-		glEnableVertexAttribArray(0);
+		setVertexAttributes();
 
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, normal)));
-		glEnableVertexAttribArray(1);
+		takeMeshData(meshData, releaseMeshData);
+	}
 
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(offsetof(Vertex, uv)));
-		glEnableVertexAttribArray(2);
+	Mesh::Mesh(MeshData* meshData, GeometryPool* pool, bool releaseMeshData)
+		: mPool(pool)
+	{
+		EW_TRACE_SCOPE("Create mesh", "asset");
+		mAllocation = pool->allocate(*meshData);
+		takeMeshData(meshData, releaseMeshData);
+	}
 
+	void Mesh::takeMeshData(MeshData* meshData, bool releaseMeshData)
+	{
 		mNumIndices = (GLsizei)meshData->indices.size();
 		mNumVertices = (GLsizei)meshData->vertices.size();
+		mBounds = meshData->bounds.radius > 0.0f ? meshData->bounds : computeBounds(meshData->vertices);
+
+		if (releaseMeshData) {
+			//Swapping with empty vectors actually frees the memory, clear() would keep the capacity
+			std::vector<Vertex>().swap(meshData->vertices);
+			std::vector<unsigned int>().swap(meshData->indices);
+			meshData->bounds = mBounds;
+		}
+	}
+
+	Mesh::Mesh(Mesh&& other) noexcept
+		: mVAO(other.mVAO), mVBO(other.mVBO), mEBO(other.mEBO), mNumIndices(other.mNumIndices), mNumVertices(other.mNumVertices), mBounds(other.mBounds),
+		mPool(other.mPool), mAllocation(other.mAllocation)
+	{
+		other.mVAO = other.mVBO = other.mEBO = 0;
+		other.mNumIndices = other.mNumVertices = 0;
+		other.mPool = nullptr;
+	}
+
+	Mesh& Mesh::operator=(Mesh&& other) noexcept
+	{
+		if (this != &other) {
+			release();
+			std::swap(mVAO, other.mVAO);
+			std::swap(mVBO, other.mVBO);
+			std::swap(mEBO, other.mEBO);
+			std::swap(mNumIndices, other.mNumIndices);
+			std::swap(mNumVertices, other.mNumVertices);
+			std::swap(mPool, other.mPool);
+			std::swap(mAllocation, other.mAllocation);
+			mBounds = other.mBounds;
+		}
+		return *this;
 	}
 
 	Mesh::~Mesh()
 	{
+		release();
+	}
+
+	//Deleting name 0 is a no-op, so empty and moved from meshes are safe here
+	void Mesh::release()
+	{
+		if (mPool != nullptr) {
+			mPool->free(mAllocation);
+			mPool = nullptr;
+			mAllocation = GeometryAllocation();
+		}
+		GLState::get().forgetVertexArray(mVAO);
 		glDeleteVertexArrays(1, &mVAO);
 		glDeleteBuffers(1, &mVBO);
 		glDeleteBuffers(1, &mEBO);
+		mVAO = mVBO = mEBO = 0;
+		mNumIndices = mNumVertices = 0;
 	}
 
 	void Mesh::draw()
 	{
-		glBindVertexArray(mVAO);
+		//Indices are relative to the mesh's own vertices, the base vertex moves them to its range in the pool
+		if (mPool != nullptr) {
+			GLState::get().bindVertexArray(mPool->getVAO());
+			glDrawElementsBaseVertex(GL_TRIANGLES, mNumIndices, GL_UNSIGNED_INT, (void*)(mAllocation.firstIndex * sizeof(unsigned int)), (GLint)mAllocation.firstVertex);
+			return;
+		}
+		if (mVAO == 0) {
+			return;
+		}
+		GLState::get().bindVertexArray(mVAO);
 		glDrawElements(GL_TRIANGLES, mNumIndices, GL_UNSIGNED_INT, 0);
 	}
 
@@ -4,6 +4,7 @@
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include <vector>
+#include <cstdint>
 
 namespace ew {
 	struct Vertex {
@@ -17,25 +18,76 @@ namespace ew {
 		}
 	};
 
+	/// <summary>
+	/// Axis aligned box plus a sphere around the box's center, both in the mesh's local space
+	/// </summary>
+	struct Bounds {
+		glm::vec3 min = glm::vec3(0);
+		glm::vec3 max = glm::vec3(0);
+		float radius = 0.0f;
+		inline glm::vec3 getCenter()const { return (min + max) * 0.5f; }
+		inline glm::vec3 getExtents()const { return (max - min) * 0.5f; }
+	};
+
+	//Box around every vertex, and the smallest sphere centered on the box that holds them all
+	Bounds computeBounds(const std::vector<Vertex>& vertices);
+
 	/// <summary>
 	/// Just holds a bunch of vertex + face (indices) data
 	/// </summary>
 	struct MeshData {
 		std::vector<Vertex> vertices;
 		std::vector<unsigned int> indices;
+		//Filled in by the ShapeGen functions. Set it with computeBounds() when building vertices by hand.
+		Bounds bounds;
 	};
 
+	//Describes ew::Vertex to the bound VAO, reading from the bound GL_ARRAY_BUFFER
+	void setVertexAttributes();
+
+	/// <summary>
+	/// A mesh's share of a GeometryPool, counted in vertices and indices rather than bytes
+	/// </summary>
+	struct GeometryAllocation {
+		uint32_t firstVertex = 0;
+		uint32_t numVertices = 0;
+		uint32_t firstIndex = 0;
+		uint32_t numIndices = 0;
+	};
+
+	class GeometryPool;
+
 	/// <summary>
-	/// Holds OpenGL buffers, can be drawn
+	/// Holds OpenGL buffers, can be drawn.
+	/// Owns its buffers outright: it can be moved, which leaves the old Mesh empty, but not copied.
+	/// Given a GeometryPool it owns ranges of the pool's buffers instead, and draws with the pool's VAO.
 	/// </summary>
 	class Mesh {
 	public:
-		Mesh(MeshData* meshData);
+		//With releaseMeshData the vertex and index arrays are freed once they're on the GPU. Bounds are kept.
+		Mesh(MeshData* meshData, bool releaseMeshData = false);
+		//The pool must outlive the mesh
+		Mesh(MeshData* meshData, GeometryPool* pool, bool releaseMeshData = false);
+		Mesh(Mesh&& other) noexcept;
+		Mesh& operator=(Mesh&& other) noexcept;
 		~Mesh();
 		void draw();
+		//Deletes the GPU buffers, or gives the pool ranges back, now rather than in the destructor
+		void release();
+		inline bool isValid()const { return mVAO != 0 || mPool != nullptr; }
+		inline GeometryPool* getPool()const { return mPool; }
+		inline const GeometryAllocation& getAllocation()const { return mAllocation; }
+		inline const Bounds& getBounds()const { return mBounds; }
+		inline int getNumVertices()const { return mNumVertices; }
 	private:
-		GLuint mVAO, mVBO, mEBO;
-		GLsizei mNumIndices;
-		GLsizei mNumVertices;
+		Mesh(const Mesh& r) = delete;
+		Mesh& operator=(const Mesh& r) = delete;
+		void takeMeshData(MeshData* meshData, bool releaseMeshData);
+		GLuint mVAO = 0, mVBO = 0, mEBO = 0;
+		GLsizei mNumIndices = 0;
+		GLsizei mNumVertices = 0;
+		Bounds mBounds;
+		GeometryPool* mPool = nullptr;
+		GeometryAllocation mAllocation;
 	};
 }
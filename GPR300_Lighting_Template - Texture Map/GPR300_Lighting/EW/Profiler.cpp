@@ -0,0 +1,401 @@
+//Author: Eric Winebrenner
+
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include "../imgui/imgui.h"
+
+namespace ew {
+	static double percentile(const std::vector<double>& sorted, double fraction)
+	{
+		int rank = (int)std::ceil(fraction * sorted.size());
+		return sorted[std::min(std::max(rank, 1), (int)sorted.size()) - 1];
+	}
+
+	ProfileStats computeStats(const std::vector<double>& samples)
+	{
+		ProfileStats stats;
+		if (samples.empty()) {
+			return stats;
+		}
+		std::vector<double> sorted = samples;
+		std::sort(sorted.begin(), sorted.end());
+		double total = 0.0;
+		for (double sample : sorted) {
+			total += sample;
+		}
+		stats.mean = total / sorted.size();
+		stats.min = sorted.front();
+		stats.p50 = percentile(sorted, 0.5);
+		stats.p90 = percentile(sorted, 0.9);
+		stats.p95 = percentile(sorted, 0.95);
+		stats.p99 = percentile(sorted, 0.99);
+		stats.max = sorted.back();
+		return stats;
+	}
+
+	//GPU times are placed on the trace as if the GPU started the frame when the CPU did, so only durations and order are exact
+	static std::chrono::steady_clock::time_point offsetByMs(std::chrono::steady_clock::time_point time, double ms)
+	{
+		return time + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double, std::milli>(ms));
+	}
+
+	static double elapsedMs(std::chrono::steady_clock::time_point begin, std::chrono::steady_clock::time_point end)
+	{
+		return std::chrono::duration<double, std::milli>(end - begin).count();
+	}
+
+	void Profiler::History::push(double value)
+	{
+		if ((int)samples.size() < HISTORY_FRAMES) {
+			samples.push_back(value);
+			return;
+		}
+		samples[next] = value;
+		next = (next + 1) % HISTORY_FRAMES;
+	}
+
+	Profiler& Profiler::get()
+	{
+		static Profiler profiler;
+		return profiler;
+	}
+
+	GLuint Profiler::acquireQuery()
+	{
+		if (mFreeQueries.empty()) {
+			GLuint query;
+			glGenQueries(1, &query);
+			return query;
+		}
+		GLuint query = mFreeQueries.back();
+		mFreeQueries.pop_back();
+		return query;
+	}
+
+	void Profiler::beginFrame()
+	{
+		if (mFrameOpen) {
+			endFrame();
+		}
+		//Read whatever the GPU has finished, only waiting once too many frames have piled up
+		while (!mPendingFrames.empty() && resolveOldest(false)) {}
+		while ((int)mPendingFrames.size() >= MAX_FRAMES_IN_FLIGHT) {
+			resolveOldest(true);
+		}
+		if (!mEnabled) {
+			return;
+		}
+		mFrameOpen = true;
+		mThread = std::this_thread::get_id();
+		mCurrentFrame.frameNumber = mNextFrameNumber++;
+		mCurrentFrame.scopes.clear();
+		mCurrentFrame.beginQuery = acquireQuery();
+		glQueryCounter(mCurrentFrame.beginQuery, GL_TIMESTAMP);
+		mCurrentFrame.cpuBegin = std::chrono::steady_clock::now();
+	}
+
+	void Profiler::endFrame()
+	{
+		if (!mFrameOpen) {
+			return;
+		}
+		if (!mScopeStack.empty()) {
+			printf("Profiler: %d scope(s) still open at the end of the frame\n", (int)mScopeStack.size());
+			while (!mScopeStack.empty()) {
+				endScope();
+			}
+		}
+		mCurrentFrame.endQuery = acquireQuery();
+		glQueryCounter(mCurrentFrame.endQuery, GL_TIMESTAMP);
+		mCurrentFrame.cpuEnd = std::chrono::steady_clock::now();
+		TraceRecorder::get().addEvent("Frame", "frame", mCurrentFrame.cpuBegin, mCurrentFrame.cpuEnd);
+		mPendingFrames.push_back(std::move(mCurrentFrame));
+		mCurrentFrame = PendingFrame();
+		mFrameOpen = false;
+	}
+
+	int Profiler::findNode(int parent, const char* name)
+	{
+		const std::vector<int>& siblings = parent < 0 ? mRootNodes : mNodes[parent].children;
+		for (int node : siblings) {
+			if (mNodes[node].name == name) {
+				return node;
+			}
+		}
+		Node node;
+		node.name = name;
+		node.parent = parent;
+		node.depth = parent < 0 ? 0 : mNodes[parent].depth + 1;
+		mNodes.push_back(node);
+		int index = (int)mNodes.size() - 1;
+		(parent < 0 ? mRootNodes : mNodes[parent].children).push_back(index);
+		return index;
+	}
+
+	void Profiler::beginScope(const char* name)
+	{
+		if (!mFrameOpen || std::this_thread::get_id() != mThread) {
+			return;
+		}
+		PendingScope scope;
+		scope.name = name;
+		scope.node = findNode(mScopeStack.empty() ? -1 : mCurrentFrame.scopes[mScopeStack.back()].node, name);
+		scope.depth = (int)mScopeStack.size();
+		scope.beginQuery = acquireQuery();
+		scope.endQuery = acquireQuery();
+		glQueryCounter(scope.beginQuery, GL_TIMESTAMP);
+		scope.cpuBegin = std::chrono::steady_clock::now();
+		mScopeStack.push_back((int)mCurrentFrame.scopes.size());
+		mCurrentFrame.scopes.push_back(scope);
+	}
+
+	void Profiler::endScope()
+	{
+		if (mScopeStack.empty() || std::this_thread::get_id() != mThread) {
+			return;
+		}
+		PendingScope& scope = mCurrentFrame.scopes[mScopeStack.back()];
+		scope.cpuEnd = std::chrono::steady_clock::now();
+		glQueryCounter(scope.endQuery, GL_TIMESTAMP);
+		TraceRecorder::get().addEvent(scope.name, "frame", scope.cpuBegin, scope.cpuEnd);
+		mScopeStack.pop_back();
+	}
+
+	bool Profiler::resolveOldest(bool wait)
+	{
+		PendingFrame& pending = mPendingFrames.front();
+		//Timestamps land in order, so once the frame's last one is available all of them are
+		if (!wait) {
+			GLint available = 0;
+			glGetQueryObjectiv(pending.endQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) {
+				return false;
+			}
+		}
+		auto readTimestamp = [](GLuint query) {
+			GLuint64 timestamp;
+			glGetQueryObjectui64v(query, GL_QUERY_RESULT, &timestamp);
+			return timestamp;
+		};
+		GLuint64 frameBegin = readTimestamp(pending.beginQuery);
+		GLuint64 frameEnd = readTimestamp(pending.endQuery);
+
+		ProfileFrame frame;
+		frame.frameNumber = pending.frameNumber;
+		frame.cpuMs = elapsedMs(pending.cpuBegin, pending.cpuEnd);
+		frame.gpuMs = (frameEnd - frameBegin) / 1000000.0;
+		//Per node totals for this frame, a node can be opened more than once
+		std::vector<double> nodeCpuMs(mNodes.size(), -1.0);
+		std::vector<double> nodeGpuMs(mNodes.size(), 0.0);
+		for (const PendingScope& scope : pending.scopes) {
+			GLuint64 begin = readTimestamp(scope.beginQuery);
+			GLuint64 end = readTimestamp(scope.endQuery);
+			ProfileSample sample;
+			sample.node = scope.node;
+			sample.depth = scope.depth;
+			sample.cpuStartMs = elapsedMs(pending.cpuBegin, scope.cpuBegin);
+			sample.cpuMs = elapsedMs(scope.cpuBegin, scope.cpuEnd);
+			sample.gpuStartMs = (begin - frameBegin) / 1000000.0;
+			sample.gpuMs = (end - begin) / 1000000.0;
+			frame.samples.push_back(sample);
+			nodeCpuMs[scope.node] = std::max(nodeCpuMs[scope.node], 0.0) + sample.cpuMs;
+			nodeGpuMs[scope.node] += sample.gpuMs;
+			mFreeQueries.push_back(scope.beginQuery);
+			mFreeQueries.push_back(scope.endQuery);
+		}
+		for (int i = 0; i < (int)mNodes.size(); i++) {
+			if (nodeCpuMs[i] >= 0.0) {
+				mNodes[i].cpuHistory.push(nodeCpuMs[i]);
+				mNodes[i].gpuHistory.push(nodeGpuMs[i]);
+			}
+		}
+		TraceRecorder& trace = TraceRecorder::get();
+		if (trace.isEnabled()) {
+			if (mGpuTraceTrack < 0) {
+				mGpuTraceTrack = trace.addTrack("GPU");
+			}
+			trace.addEvent("Frame", "gpu", pending.cpuBegin, offsetByMs(pending.cpuBegin, frame.gpuMs), nullptr, mGpuTraceTrack);
+			for (int i = 0; i < (int)frame.samples.size(); i++) {
+				const ProfileSample& sample = frame.samples[i];
+				std::chrono::steady_clock::time_point begin = offsetByMs(pending.cpuBegin, sample.gpuStartMs);
+				trace.addEvent(pending.scopes[i].name, "gpu", begin, offsetByMs(begin, sample.gpuMs), nullptr, mGpuTraceTrack);
+			}
+		}
+		mFrameCpuHistory.push(frame.cpuMs);
+		mFrameGpuHistory.push(frame.gpuMs);
+		mFreeQueries.push_back(pending.beginQuery);
+		mFreeQueries.push_back(pending.endQuery);
+		mPendingFrames.pop_front();
+
+		if (mFrameCallback) {
+			mFrameCallback(frame);
+		}
+		mLastFrame = std::move(frame);
+		mHasLastFrame = true;
+		return true;
+	}
+
+	void Profiler::flush()
+	{
+		if (mFrameOpen) {
+			endFrame();
+		}
+		while (!mPendingFrames.empty()) {
+			resolveOldest(true);
+		}
+	}
+
+	ProfileStats Profiler::getCpuStats(int node)const
+	{
+		return computeStats(mNodes[node].cpuHistory.samples);
+	}
+
+	ProfileStats Profiler::getGpuStats(int node)const
+	{
+		return computeStats(mNodes[node].gpuHistory.samples);
+	}
+
+	//Bars for every scope of the last frame, scaled so the frame fills the width, children stacked below their parent
+	void Profiler::drawFlameGraph(const char* label, bool gpu)
+	{
+		const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+		double frameMs = gpu ? mLastFrame.gpuMs : mLastFrame.cpuMs;
+		int numRows = 1;
+		for (const ProfileSample& sample : mLastFrame.samples) {
+			numRows = std::max(numRows, sample.depth + 1);
+		}
+		ImGui::Text("%s %.3f ms", label, frameMs);
+		ImVec2 origin = ImGui::GetCursorScreenPos();
+		float width = std::max(ImGui::GetContentRegionAvail().x, 1.0f);
+		ImGui::Dummy(ImVec2(width, numRows * rowHeight));
+		if (frameMs <= 0.0) {
+			return;
+		}
+		ImDrawList* drawList = ImGui::GetWindowDrawList();
+		float scale = (float)(width / frameMs);
+		for (const ProfileSample& sample : mLastFrame.samples) {
+			double startMs = gpu ? sample.gpuStartMs : sample.cpuStartMs;
+			double ms = gpu ? sample.gpuMs : sample.cpuMs;
+			ImVec2 topLeft = ImVec2(origin.x + (float)startMs * scale, origin.y + sample.depth * rowHeight);
+			ImVec2 bottomRight = ImVec2(std::max(topLeft.x + (float)ms * scale, topLeft.x + 1.0f), topLeft.y + rowHeight - 1.0f);
+			//Golden ratio hue steps keep neighbouring nodes apart in color
+			ImU32 color = ImColor::HSV(fmodf(sample.node * 0.618f, 1.0f), 0.55f, 0.75f);
+			drawList->AddRectFilled(topLeft, bottomRight, color);
+			const char* name = mNodes[sample.node].name.c_str();
+			if (bottomRight.x - topLeft.x > ImGui::CalcTextSize(name).x + 4.0f) {
+				drawList->PushClipRect(topLeft, bottomRight, true);
+				drawList->AddText(ImVec2(topLeft.x + 2.0f, topLeft.y + 2.0f), IM_COL32(0, 0, 0, 255), name);
+				drawList->PopClipRect();
+			}
+			if (ImGui::IsMouseHoveringRect(topLeft, bottomRight)) {
+				ImGui::SetTooltip("%s\nCPU %.3f ms\nGPU %.3f ms", name, sample.cpuMs, sample.gpuMs);
+			}
+		}
+	}
+
+	void Profiler::drawNodeRow(int node)
+	{
+		ProfileStats cpu = getCpuStats(node);
+		ProfileStats gpu = getGpuStats(node);
+		ImGui::TableNextRow();
+		ImGui::TableNextColumn();
+		ImGui::Text("%*s%s", mNodes[node].depth * 2, "", mNodes[node].name.c_str());
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", cpu.mean);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", cpu.max);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", gpu.min);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", gpu.mean);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", gpu.p95);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", gpu.p99);
+		ImGui::TableNextColumn();
+		ImGui::Text("%.3f", gpu.max);
+		for (int child : mNodes[node].children) {
+			drawNodeRow(child);
+		}
+	}
+
+	void Profiler::setCounter(const char* name, double value)
+	{
+		if (!mEnabled) {
+			return;
+		}
+		auto counter = std::find_if(mCounters.begin(), mCounters.end(), [name](const Counter& c) { return c.name == name; });
+		if (counter == mCounters.end()) {
+			mCounters.push_back(Counter{ name, 0.0, History() });
+			counter = mCounters.end() - 1;
+		}
+		counter->last = value;
+		counter->history.push(value);
+	}
+
+	void Profiler::drawUI()
+	{
+		ImGui::Begin("Profiler");
+		bool enabled = mEnabled;
+		if (ImGui::Checkbox("Enabled", &enabled)) {
+			setEnabled(enabled);
+		}
+#if EW_TRACING
+		TraceRecorder& trace = TraceRecorder::get();
+		bool tracing = trace.isEnabled();
+		ImGui::SameLine();
+		if (ImGui::Checkbox("Record trace", &tracing)) {
+			trace.setEnabled(tracing);
+		}
+		ImGui::SameLine();
+		if (ImGui::Button("Save trace")) {
+			trace.writeJson("trace.json");
+		}
+#endif
+		ProfileStats cpuFrame = computeStats(mFrameCpuHistory.samples);
+		ProfileStats gpuFrame = computeStats(mFrameGpuHistory.samples);
+		ImGui::Text("Frame CPU %.2f ms avg, %.2f p95 | GPU %.2f ms avg, %.2f p95", cpuFrame.mean, cpuFrame.p95, gpuFrame.mean, gpuFrame.p95);
+		if (!mHasLastFrame) {
+			ImGui::Text("Waiting for the first frame");
+			ImGui::End();
+			return;
+		}
+		drawFlameGraph("CPU", false);
+		drawFlameGraph("GPU", true);
+		const ImGuiTableFlags tableFlags = ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit;
+		if (ImGui::BeginTable("ProfilerStats", 8, tableFlags)) {
+			const char* headers[] = { "Scope", "CPU avg", "CPU max", "GPU min", "GPU avg", "GPU p95", "GPU p99", "GPU max" };
+			for (const char* header : headers) {
+				ImGui::TableSetupColumn(header);
+			}
+			ImGui::TableHeadersRow();
+			for (int node : mRootNodes) {
+				drawNodeRow(node);
+			}
+			ImGui::EndTable();
+		}
+		if (!mCounters.empty() && ImGui::BeginTable("ProfilerCounters", 4, tableFlags)) {
+			const char* headers[] = { "Counter", "Last", "Avg", "Max" };
+			for (const char* header : headers) {
+				ImGui::TableSetupColumn(header);
+			}
+			ImGui::TableHeadersRow();
+			for (const Counter& counter : mCounters) {
+				ProfileStats stats = computeStats(counter.history.samples);
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn();
+				ImGui::TextUnformatted(counter.name.c_str());
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f", counter.last);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.1f", stats.mean);
+				ImGui::TableNextColumn();
+				ImGui::Text("%.0f", stats.max);
+			}
+			ImGui::EndTable();
+		}
+		ImGui::End();
+	}
+}
@@ -4,21 +4,146 @@
 #include "GL/glew.h"
 #include <glm/glm.hpp>
 #include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include <cstdint>
 
+/// <summary>
+/// FNV-1a hash of a uniform name. constexpr so names known at compile time cost nothing at runtime.
+/// </summary>
+constexpr uint32_t hashUniformName(std::string_view name) {
+	uint32_t hash = 2166136261u;
+	for (char c : name) {
+		hash ^= (uint8_t)c;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/// <summary>
+/// Pre-resolved uniform. Get one from Shader::getUniform() once, then set it every frame for free.
+/// Refers to a slot in the shader rather than a raw location so it stays valid across hot reloads.
+/// </summary>
+struct UniformHandle {
+	int slot = -1;
+	inline bool isValid()const { return slot >= 0; }
+};
+
+/// <summary>
+/// A vertex + fragment program, or a compute program, optionally compiled as several permutations.
+/// Each feature name given to the constructor becomes a "#define NAME" when its bit is set in the mask passed to
+/// selectVariant(), so features are resolved by the preprocessor instead of branching per fragment.
+/// Variants are compiled the first time they're selected.
+/// Owns its programs: it can be moved, which leaves the old Shader empty, but not copied.
+/// </summary>
 class Shader
 {
 public:
-	Shader(std::string vertexShaderPath, std::string fragmentShaderPath);
+	Shader(std::string vertexShaderPath, std::string fragmentShaderPath, std::vector<std::string> features = {});
+	//Compute-only program, dispatched with use() + glDispatchCompute
+	explicit Shader(std::string computeShaderPath);
+	Shader(Shader&& other) noexcept;
+	Shader& operator=(Shader&& other) noexcept;
+	~Shader();
 	void use();
-	void setFloat(std::string name, float value);
-	void setInt(std::string name, int value);
-	void setMat4(std::string name, const glm::mat4& value);
-	void setVec2(std::string name, const glm::vec2& value);
-	void setVec3(std::string name, const glm::vec3& value);
+	//Makes the variant for this feature bitmask current, compiling it if needed.
+	//With ARB_parallel_shader_compile the previous variant stays current until the new one is ready, so this never blocks.
+	void selectVariant(uint32_t featureMask);
+	//Starts compiling a variant in the background without selecting it
+	void prepareVariant(uint32_t featureMask);
+	inline uint32_t getVariant()const { return m_currentMask; }
+	//Linked programs are saved here with glGetProgramBinary and reloaded on later runs. Empty disables the cache.
+	static void setBinaryCacheDirectory(const std::string& directory);
+	inline bool isFromBinaryCache()const { return m_fromBinaryCache; }
+	//Milliseconds spent compiling and linking, or loading the cached binary
+	inline float getBuildTime()const { return m_buildTime; }
+	//False if the current variant failed to compile or link
+	inline bool isLinked()const { return m_current != nullptr && m_current->linked; }
+	//Watch every source file and rebuild the program when either changes. Uniform values carry over.
+	void setHotReload(bool enabled);
+	//Call once per frame. Returns true on the frame the rebuilt program is swapped in.
+	//With ARB_parallel_shader_compile the driver compiles in the background and this never blocks.
+	bool reloadIfChanged();
+	UniformHandle getUniform(std::string_view name) const;
+	UniformHandle getUniform(uint32_t nameHash) const;
+
+	void setFloat(std::string_view name, float value);
+	void setInt(std::string_view name, int value);
+	void setMat3(std::string_view name, const glm::mat3& value);
+	void setMat4(std::string_view name, const glm::mat4& value);
+	void setVec2(std::string_view name, const glm::vec2& value);
+	void setVec3(std::string_view name, const glm::vec3& value);
+	void setUint(std::string_view name, GLuint value);
+	void setVec4Array(std::string_view name, const glm::vec4* values, int count);
+
+	void setFloat(UniformHandle uniform, float value);
+	void setInt(UniformHandle uniform, int value);
+	void setMat3(UniformHandle uniform, const glm::mat3& value);
+	void setMat4(UniformHandle uniform, const glm::mat4& value);
+	void setVec2(UniformHandle uniform, const glm::vec2& value);
+	void setVec3(UniformHandle uniform, const glm::vec3& value);
+	void setUint(UniformHandle uniform, GLuint value);
+	void setVec4Array(UniformHandle uniform, const glm::vec4* values, int count);
 private:
 	Shader(const Shader& r) = delete;
+	Shader& operator=(const Shader& r) = delete;
+	//One source file of the program
+	struct Stage {
+		GLenum type;
+		std::string path;
+		std::string source;
+		int watchId = -1;
+	};
+	struct Variant {
+		GLuint program = 0;
+		bool linked = false;
+		//Location of each uniform slot in this program, -1 if it isn't active here
+		std::vector<GLint> slotLocations;
+	};
+	//A variant whose shaders are still compiling
+	struct PendingBuild {
+		uint32_t featureMask;
+		GLuint program;
+		//One per stage, empty once compiled or if the program came from the binary cache
+		std::vector<GLuint> shaders;
+		std::string cachePath;
+	};
+	Shader(std::vector<Stage> stages, std::vector<std::string> features);
 	std::string readFile(const std::string& filePath);
-	GLuint compileShader(const char* shaderSource, GLenum type);
-	GLuint m_id;
+	GLuint createShader(const char* shaderSource, GLenum type);
+	bool checkCompileStatus(GLuint shader, GLenum type);
+	std::string addDefines(const std::string& source, uint32_t featureMask);
+	void cacheUniformLocations(Variant& variant);
+	bool startBuild(uint32_t featureMask);
+	bool finishBuilds(bool wait);
+	bool finishBuild(PendingBuild& build);
+	void makeCurrent(uint32_t featureMask);
+	//Deletes every variant and any build still compiling
+	void release();
+	inline GLint getLocation(UniformHandle uniform)const {
+		return uniform.isValid() && uniform.slot < (int)m_current->slotLocations.size() ? m_current->slotLocations[uniform.slot] : -1;
+	}
+	//Stage paths joined with " + ", for log messages
+	std::string getName()const;
+	std::string getBinaryCachePath(const std::vector<std::string>& sources);
+	bool loadProgramBinary(GLuint program, const std::string& cachePath);
+	void saveProgramBinary(GLuint program, const std::string& cachePath);
+	static std::string s_binaryCacheDirectory;
+	//Program of the current variant
+	GLuint m_id = 0;
+	std::vector<Stage> m_stages;
+	std::vector<std::string> m_features;
+	bool m_fromBinaryCache = false;
+	float m_buildTime = 0.0f;
+	//Feature bitmask -> compiled program. Nodes never move, so m_current stays valid as variants are added.
+	std::unordered_map<uint32_t, Variant> m_variants;
+	std::vector<PendingBuild> m_pendingBuilds;
+	Variant* m_current = nullptr;
+	uint32_t m_currentMask = 0;
+	//Most recently requested mask, made current as soon as it finishes compiling
+	uint32_t m_requestedMask = 0;
+	//Uniform name hash -> slot, shared by all variants. Slots are never removed, so handles survive relinking.
+	std::unordered_map<uint32_t, int> m_uniformSlots;
+	bool m_hotReload = false;
 };
-
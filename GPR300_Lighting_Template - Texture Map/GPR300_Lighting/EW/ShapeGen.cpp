@@ -1,10 +1,12 @@
 //Author: Eric Winebrenner
 
 #include "ShapeGen.h"
+#include "Trace.h"
 #include <glm/gtc/type_ptr.hpp>
 
 namespace ew {
 	void createPlane(float width, float height, MeshData& meshData) {
+		EW_TRACE_SCOPE("createPlane", "asset");
 		meshData.vertices.clear();
 		meshData.indices.clear();
 		float halfWidth = width / 2.0f;
@@ -23,9 +25,11 @@ namespace ew {
 			0, 3, 2
 		};
 		meshData.indices.assign(&indices[0], &indices[6]);
+		meshData.bounds = computeBounds(meshData.vertices);
 	};
 
 	void createQuad(float width, float height, MeshData& meshData) {
+		EW_TRACE_SCOPE("createQuad", "asset");
 		meshData.vertices.clear();
 		meshData.indices.clear();
 		float halfWidth = width / 2.0f;
@@ -44,10 +48,12 @@ namespace ew {
 			0, 2, 3
 		};
 		meshData.indices.assign(&indices[0], &indices[6]);
+		meshData.bounds = computeBounds(meshData.vertices);
 	};
 
 	void createCube(float width, float height, float depth, MeshData& meshData)
 	{
+		EW_TRACE_SCOPE("createCube", "asset");
 		meshData.vertices.clear();
 		meshData.indices.clear();
 
@@ -125,10 +131,12 @@ namespace ew {
 			22, 23, 20
 		};
 		meshData.indices.assign(&indices[0], &indices[36]);
+		meshData.bounds = computeBounds(meshData.vertices);
 	}
 
 	void createSphere(float radius, int numSegments, MeshData& meshData)
 	{
+		EW_TRACE_SCOPE("createSphere", "asset");
 		meshData.vertices.clear();
 		meshData.indices.clear();
 
@@ -204,10 +212,12 @@ namespace ew {
 			meshData.indices.push_back(start + i);
 			meshData.indices.push_back(bottomIndex); //bottom cap center 
 		}
+		meshData.bounds = computeBounds(meshData.vertices);
 	}
 
 	void createCylinder(float height, float radius, int numSegments, MeshData& meshData)
 	{
+		EW_TRACE_SCOPE("createCylinder", "asset");
 		meshData.vertices.clear();
 		meshData.indices.clear();
 
@@ -285,6 +295,7 @@ namespace ew {
 			meshData.indices.push_back(start + 1);
 			meshData.indices.push_back(start + numSegments + 2);
 		}
+		meshData.bounds = computeBounds(meshData.vertices);
 	}
 
 }
@@ -0,0 +1,38 @@
+//Author: Eric Winebrenner
+
+#include "StorageBuffer.h"
+
+namespace ew {
+	//Smallest allocation so the binding is never left without storage
+	const GLsizeiptr MIN_STORAGE_BUFFER_SIZE = 16;
+
+	StorageBuffer::StorageBuffer(GLuint bindingPoint)
+		: mCapacity(MIN_STORAGE_BUFFER_SIZE), mBindingPoint(bindingPoint)
+	{
+		glGenBuffers(1, &mSSBO);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO);
+		glBufferData(GL_SHADER_STORAGE_BUFFER, mCapacity, NULL, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bindingPoint, mSSBO);
+	}
+
+	StorageBuffer::~StorageBuffer()
+	{
+		glDeleteBuffers(1, &mSSBO);
+	}
+
+	void StorageBuffer::upload(const void* data, GLsizeiptr size)
+	{
+		if (size <= 0) {
+			return;
+		}
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, mSSBO);
+		if (size > mCapacity) {
+			//Grow geometrically so a slowly rising light count doesn't reallocate every frame
+			while (mCapacity < size) {
+				mCapacity *= 2;
+			}
+			glBufferData(GL_SHADER_STORAGE_BUFFER, mCapacity, NULL, GL_DYNAMIC_DRAW);
+		}
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+	}
+}
@@ -0,0 +1,26 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <GL/glew.h>
+#include <vector>
+
+namespace ew {
+	/// <summary>
+	/// Owns a shader storage buffer bound to a fixed binding point.
+	/// Grows on upload when the data no longer fits.
+	/// </summary>
+	class StorageBuffer {
+	public:
+		StorageBuffer(GLuint bindingPoint);
+		~StorageBuffer();
+		void upload(const void* data, GLsizeiptr size);
+		template<typename T>
+		void upload(const std::vector<T>& data) { upload(data.data(), (GLsizeiptr)(data.size() * sizeof(T))); }
+		inline GLuint getBindingPoint()const { return mBindingPoint; }
+	private:
+		StorageBuffer(const StorageBuffer& r) = delete;
+		GLuint mSSBO;
+		GLsizeiptr mCapacity;
+		GLuint mBindingPoint;
+	};
+}
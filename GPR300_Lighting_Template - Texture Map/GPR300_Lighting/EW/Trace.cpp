@@ -0,0 +1,150 @@
+//Author: Eric Winebrenner
+
+#include "Trace.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+namespace ew {
+	TraceRecorder::TraceRecorder(int capacity)
+		: mEnabled(false), mEpoch(std::chrono::steady_clock::now()), mCapacity(capacity)
+	{
+	}
+
+	TraceRecorder& TraceRecorder::get()
+	{
+		static TraceRecorder recorder;
+		return recorder;
+	}
+
+	void TraceRecorder::setEnabled(bool enabled)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		if (EW_TRACING && enabled && mEvents.empty()) {
+			mEvents.resize(mCapacity);
+		}
+		mEnabled = EW_TRACING && enabled;
+	}
+
+	int TraceRecorder::getThreadTrack()
+	{
+		std::thread::id thread = std::this_thread::get_id();
+		auto existing = mThreadTracks.find(thread);
+		if (existing != mThreadTracks.end()) {
+			return existing->second;
+		}
+		int track = (int)mTrackNames.size();
+		mTrackNames.push_back("Thread " + std::to_string(track));
+		mThreadTracks[thread] = track;
+		return track;
+	}
+
+	void TraceRecorder::setThreadName(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTrackNames[getThreadTrack()] = name;
+	}
+
+	int TraceRecorder::addTrack(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mTrackNames.push_back(name);
+		return (int)mTrackNames.size() - 1;
+	}
+
+	void TraceRecorder::addEvent(const char* name, const char* category, std::chrono::steady_clock::time_point begin,
+		std::chrono::steady_clock::time_point end, const char* detail, int track)
+	{
+		if (!isEnabled()) {
+			return;
+		}
+		std::lock_guard<std::mutex> lock(mMutex);
+		TraceEvent& event = mEvents[mNext];
+		event.name = name;
+		event.category = category;
+		size_t detailLength = detail != nullptr ? std::min(strlen(detail), sizeof(event.detail) - 1) : 0;
+		if (detailLength > 0) {
+			memcpy(event.detail, detail, detailLength);
+		}
+		event.detail[detailLength] = '\0';
+		event.beginUs = std::chrono::duration<double, std::micro>(begin - mEpoch).count();
+		event.durationUs = std::chrono::duration<double, std::micro>(end - begin).count();
+		event.track = track >= 0 ? track : getThreadTrack();
+		mNext = (mNext + 1) % mCapacity;
+		mWrapped = mWrapped || mNext == 0;
+	}
+
+	void TraceRecorder::clear()
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mNext = 0;
+		mWrapped = false;
+	}
+
+	//Windows paths are full of backslashes
+	static void writeJsonString(std::ostream& stream, const char* text)
+	{
+		stream << '"';
+		for (const char* c = text; *c != '\0'; c++) {
+			if (*c == '"' || *c == '\\') {
+				stream << '\\';
+			}
+			stream << *c;
+		}
+		stream << '"';
+	}
+
+	bool TraceRecorder::writeJson(const std::string& filePath)
+	{
+		//Copied out so recording threads only wait for the copy, not the file
+		std::vector<TraceEvent> events;
+		std::vector<std::string> trackNames;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (mWrapped) {
+				events.assign(mEvents.begin() + mNext, mEvents.end());
+			}
+			events.insert(events.end(), mEvents.begin(), mEvents.begin() + mNext);
+			trackNames = mTrackNames;
+		}
+
+		std::ofstream file(filePath);
+		if (!file.is_open()) {
+			printf("Failed to open %s for writing\n", filePath.c_str());
+			return false;
+		}
+		file << std::fixed << std::setprecision(3);
+		file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+		const char* separator = "\n";
+		//Metadata events name the tracks and keep them in the order they were made
+		for (int i = 0; i < (int)trackNames.size(); i++) {
+			file << separator << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":";
+			writeJsonString(file, trackNames[i].c_str());
+			file << "}},\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"sort_index\":" << i << "}}";
+			separator = ",\n";
+		}
+		for (const TraceEvent& event : events) {
+			file << separator << "{\"name\":";
+			writeJsonString(file, event.name);
+			file << ",\"cat\":";
+			writeJsonString(file, event.category);
+			file << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.track << ",\"ts\":" << event.beginUs << ",\"dur\":" << event.durationUs;
+			if (event.detail[0] != '\0') {
+				file << ",\"args\":{\"detail\":";
+				writeJsonString(file, event.detail);
+				file << "}";
+			}
+			file << "}";
+			separator = ",\n";
+		}
+		file << "\n]}\n";
+		if (!file.good()) {
+			printf("Failed to write %s\n", filePath.c_str());
+			return false;
+		}
+		printf("Wrote %d trace events to %s\n", (int)events.size(), filePath.c_str());
+		return true;
+	}
+}
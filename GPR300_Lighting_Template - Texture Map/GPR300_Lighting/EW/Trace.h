@@ -0,0 +1,109 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Define as 0 to compile every trace point out. TraceRecorder still exists but never records.
+#ifndef EW_TRACING
+#define EW_TRACING 1
+#endif
+
+namespace ew {
+	/// <summary>
+	/// Timeline of named events from any thread, kept in a ring buffer and written as Chrome Trace Event JSON
+	/// for chrome://tracing or ui.perfetto.dev. Every thread gets its own track, extra tracks (eg. the GPU) can be added.
+	/// Off by default. When off, a trace point costs a single flag check.
+	/// Event names and categories are stored as pointers, so they must be string literals.
+	/// </summary>
+	class TraceRecorder {
+	public:
+		//Events kept before the oldest are overwritten
+		static const int DEFAULT_CAPACITY = 1 << 16;
+		TraceRecorder(int capacity = DEFAULT_CAPACITY);
+		void setEnabled(bool enabled);
+		inline bool isEnabled()const { return EW_TRACING && mEnabled.load(std::memory_order_relaxed); }
+		//Names the calling thread's track
+		void setThreadName(const std::string& name);
+		//Returns the id of a named track that isn't a thread
+		int addTrack(const std::string& name);
+		//Detail is copied and shows up in the event's args. Track -1 is the calling thread's.
+		void addEvent(const char* name, const char* category, std::chrono::steady_clock::time_point begin,
+			std::chrono::steady_clock::time_point end, const char* detail = nullptr, int track = -1);
+		//Writes the buffered events oldest first. Returns false if the file couldn't be written.
+		bool writeJson(const std::string& filePath);
+		void clear();
+		//Shared recorder used by TraceScope and the profiler
+		static TraceRecorder& get();
+	private:
+		TraceRecorder(const TraceRecorder& r) = delete;
+		struct TraceEvent {
+			const char* name;
+			const char* category;
+			//Empty for no detail, long paths are cut short
+			char detail[48];
+			double beginUs;
+			double durationUs;
+			int track;
+		};
+		//Caller holds mMutex
+		int getThreadTrack();
+
+		std::atomic<bool> mEnabled;
+		std::chrono::steady_clock::time_point mEpoch;
+		std::mutex mMutex;
+		//Allocated on first enable
+		std::vector<TraceEvent> mEvents;
+		int mCapacity;
+		int mNext = 0;
+		bool mWrapped = false;
+		std::map<std::thread::id, int> mThreadTracks;
+		std::vector<std::string> mTrackNames;
+	};
+
+	/// <summary>
+	/// Records the enclosing block as one event on the calling thread's track. Use through EW_TRACE_SCOPE so it compiles out.
+	/// </summary>
+	class TraceScope {
+	public:
+		TraceScope(const char* name, const char* category, const std::string& detail = std::string())
+		{
+			if (TraceRecorder::get().isEnabled()) {
+				mName = name;
+				mCategory = category;
+				mDetail = detail;
+				mBegin = std::chrono::steady_clock::now();
+			}
+		}
+		~TraceScope()
+		{
+			if (mName != nullptr) {
+				TraceRecorder::get().addEvent(mName, mCategory, mBegin, std::chrono::steady_clock::now(), mDetail.c_str());
+			}
+		}
+	private:
+		TraceScope(const TraceScope& r) = delete;
+		const char* mName = nullptr;
+		const char* mCategory = nullptr;
+		std::string mDetail;
+		std::chrono::steady_clock::time_point mBegin;
+	};
+}
+
+#define EW_TRACE_CONCAT_INNER(a, b) a##b
+#define EW_TRACE_CONCAT(a, b) EW_TRACE_CONCAT_INNER(a, b)
+#if EW_TRACING
+//Traces the rest of the enclosing block
+#define EW_TRACE_SCOPE(name, category) ew::TraceScope EW_TRACE_CONCAT(traceScope, __LINE__)(name, category)
+//Same with a detail string, eg. a file path. Detail is only evaluated while tracing.
+#define EW_TRACE_SCOPE_DETAIL(name, category, detail) ew::TraceScope EW_TRACE_CONCAT(traceScope, __LINE__)(name, category, \
+	ew::TraceRecorder::get().isEnabled() ? std::string(detail) : std::string())
+#else
+#define EW_TRACE_SCOPE(name, category)
+#define EW_TRACE_SCOPE_DETAIL(name, category, detail)
+#endif
@@ -13,6 +13,18 @@ namespace ew {
 		glm::mat4 getModelMatrix() {
 			return ew::translate(position) * ew::rotateX(rotation.x) * ew::rotateY(rotation.y) * ew::rotateZ(rotation.z) * ew::scale(scale);
 		}
+		//transpose(inverse(R * S)) is just R * S^-1, so no inversion is needed.
+		//Uniform scale only needs a single reciprocal.
+		glm::mat3 getNormalMatrix() {
+			glm::mat3 normalMatrix = glm::mat3(ew::rotateX(rotation.x) * ew::rotateY(rotation.y) * ew::rotateZ(rotation.z));
+			if (scale.x == scale.y && scale.y == scale.z) {
+				return normalMatrix * (1.0f / scale.x);
+			}
+			normalMatrix[0] /= scale.x;
+			normalMatrix[1] /= scale.y;
+			normalMatrix[2] /= scale.z;
+			return normalMatrix;
+		}
 		void reset() {
 			position = glm::vec3(0);
 			rotation = glm::vec3(0);
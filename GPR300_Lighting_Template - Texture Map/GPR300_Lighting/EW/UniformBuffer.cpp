@@ -0,0 +1,31 @@
+//Author: Eric Winebrenner
+
+#include "UniformBuffer.h"
+#include <stdio.h>
+
+namespace ew {
+	UniformBuffer::UniformBuffer(GLsizeiptr size, GLuint bindingPoint)
+		: mSize(size), mBindingPoint(bindingPoint)
+	{
+		glGenBuffers(1, &mUBO);
+		glBindBuffer(GL_UNIFORM_BUFFER, mUBO);
+		glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+		glBindBufferBase(GL_UNIFORM_BUFFER, bindingPoint, mUBO);
+	}
+
+	UniformBuffer::~UniformBuffer()
+	{
+		glDeleteBuffers(1, &mUBO);
+	}
+
+	//One upload for the whole block instead of a glUniform call per field
+	void UniformBuffer::update(const void* data, GLsizeiptr size, GLintptr offset)
+	{
+		if (offset + size > mSize) {
+			printf("Uniform buffer update out of range");
+			return;
+		}
+		glBindBuffer(GL_UNIFORM_BUFFER, mUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, data);
+	}
+}
@@ -7,6 +7,7 @@
 #include <glm/gtc/type_ptr.hpp>
 
 #include <stdio.h>
+#include <vector>
 
 #include <time.h>
 
@@ -21,8 +22,22 @@
 #include "EW/EwMath.h"
 #include "EW/Camera.h"
 #include "EW/Mesh.h"
+#include "EW/GeometryPool.h"
 #include "EW/Transform.h"
+#include "EW/TransformBatch.h"
+#include "EW/SceneGraph.h"
+#include "EW/FrustumCuller.h"
+#include "EW/BVH.h"
+#include "EW/HeadlessBenchmark.h"
+#include "EW/Profiler.h"
+#include "EW/Trace.h"
+#include "EW/GLState.h"
+#include "EW/RenderQueue.h"
 #include "EW/ShapeGen.h"
+#include "EW/UniformBuffer.h"
+#include "EW/LightBlock.h"
+#include "EW/LightClusters.h"
+#include "EW/TextureLoader.h"
 
 void processInput(GLFWwindow* window);
 void resizeFrameBufferCallback(GLFWwindow* window, int width, int height);
@@ -30,7 +45,8 @@ void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action,
 void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void mousePosCallback(GLFWwindow* window, double xpos, double ypos);
 void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
-GLuint createTexture(const char* filePath);
+GLuint createTexture(ew::TextureLoader& loader, const char* filePath, glm::vec4 placeholderColor = glm::vec4(0.5f, 0.5f, 0.5f, 1.0f));
+void spawnStressLights(std::vector<ew::PtLightData>& lights, int count, float radius);
 
 float lastFrameTime;
 float deltaTime;
@@ -42,6 +58,15 @@ double prevMouseX;
 double prevMouseY;
 bool firstMouseInput = false;
 
+//Cursor position is tracked even while unlocked, for picking
+double mouseX;
+double mouseY;
+bool pickRequested = false;
+
+//--headless renders --frames N frames offscreen along a fixed camera path, then prints timings as JSON
+bool headless = false;
+int headlessFrames = 300;
+
 /* Button to lock / unlock mouse
 * 1 = right, 2 = middle
 * Mouse will start locked. Unlock it to use UI
@@ -114,12 +139,103 @@ bool _OnlyRimLightingColor = false;
 bool _OtlnShader = false;
 //**************
 
-int main() {
+//Bits of the lit shader's feature mask, in the order of litFeatures
+enum LitFeature {
+	LIT_SCROLLING = 1 << 0,
+	LIT_CELL_SHADING = 1 << 1,
+	LIT_FLOOR_FUNC = 1 << 2,
+	LIT_RIM_LIGHTING = 1 << 3,
+	LIT_ONLY_RIM_COLOR = 1 << 4,
+	LIT_INVERSE_NORMAL_MATRIX = 1 << 5
+};
+
+//Passes in the order they're drawn, the top field of each draw's sort key
+enum DrawPass {
+	//Objects write 1 to the stencil buffer wherever they cover
+	PASS_STENCILED,
+	//The plane isn't outlined, so it leaves the stencil buffer alone
+	PASS_UNSTENCILED,
+	//Scaled up copies of the objects, drawn only where the stencil is still 0
+	PASS_OUTLINE
+};
+
+enum DrawShader {
+	SHADER_LIT,
+	SHADER_UNLIT,
+	SHADER_OUTLINING
+};
+
+//Texture sets. Bamboo and fabric stay bound to units 0 and 1 the whole time, so every lit draw shares one.
+enum DrawMaterial {
+	MATERIAL_NONE,
+	MATERIAL_BAMBOO_FABRIC
+};
+
+//What a queued draw needs once its turn comes
+struct DrawCommand {
+	ew::Mesh* mesh = nullptr;
+	DrawShader shader = SHADER_LIT;
+	//Scene graph node, for lit and unlit draws
+	int node = -1;
+	glm::vec3 color = glm::vec3(0);
+	//Outlines are scaled about the object's own origin, then moved into place
+	glm::mat4 model = glm::mat4(1);
+	glm::mat4 translation = glm::mat4(1);
+};
+
+//Stress test for clustered lighting
+int numStressLights = 0;
+float stressLightRadius = 2.0f;
+float stressLightOrbitSpeed = 0.2f;
+
+int main(int argc, char** argv) {
+	ew::TraceRecorder::get().setThreadName("Main");
+	//Uniform setter benchmark, runs in a hidden window once the shaders are built
+	bool benchUniforms = false;
+	//Vertex throughput benchmark of the normal matrix, runs in a hidden window once the meshes are made
+	bool benchNormals = false;
+	//CPU only benchmark, doesn't need a window
+	for (int i = 1; i < argc; i++) {
+		if (std::string(argv[i]) == "--bench-transforms") {
+			ew::benchmarkTransformBatch({ 1000, 100000, 1000000 });
+			return 0;
+		}
+		if (std::string(argv[i]) == "--bench-scene") {
+			ew::benchmarkSceneGraph();
+			return 0;
+		}
+		if (std::string(argv[i]) == "--bench-bvh") {
+			ew::benchmarkBVH({ 10000, 100000, 1000000 });
+			return 0;
+		}
+		//Recording from the start catches asset loading, F9 or exit writes trace.json
+		if (std::string(argv[i]) == "--trace") {
+			ew::TraceRecorder::get().setEnabled(true);
+		}
+		if (std::string(argv[i]) == "--headless") {
+			headless = true;
+		}
+		if (std::string(argv[i]) == "--frames" && i + 1 < argc) {
+			headlessFrames = atoi(argv[++i]);
+		}
+		if (std::string(argv[i]) == "--bench-uniforms") {
+			benchUniforms = true;
+		}
+		if (std::string(argv[i]) == "--bench-normals") {
+			benchNormals = true;
+		}
+	}
+
 	if (!glfwInit()) {
 		printf("glfw failed to init");
 		return 1;
 	}
 
+	//GLEW loads GL through the platform's own context API, so even headless runs need a window, just never shown.
+	//On machines without a GPU that context comes from Mesa's llvmpipe.
+	if (benchUniforms || benchNormals || headless) {
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
 	GLFWwindow* window = glfwCreateWindow(SCREEN_WIDTH, SCREEN_HEIGHT, "Lighting", 0, 0);
 	glfwMakeContextCurrent(window);
 
@@ -127,11 +243,13 @@ int main() {
 		printf("glew failed to init");
 		return 1;
 	}
+	//State changes go through the cache, which drops the ones that change nothing
+	ew::GLState& glState = ew::GLState::get();
 
 	//Enable the Depth Buffer
-	glEnable(GL_DEPTH_TEST);
-	glEnable(GL_STENCIL_TEST);
-	glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+	glState.enable(GL_DEPTH_TEST);
+	glState.enable(GL_STENCIL_TEST);
+	glState.stencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
 
 	glfwSetFramebufferSizeCallback(window, resizeFrameBufferCallback);
 	glfwSetKeyCallback(window, keyboardCallback);
@@ -152,13 +270,57 @@ int main() {
 	ImGui::StyleColorsDark();
 
 	//Used to draw shapes. This is the shader you will be completing.
-	Shader litShader("shaders/defaultLit.vert", "shaders/defaultLit.frag");
+	//Toggles are compiled in as #defines, so each combination gets its own program instead of branching per fragment
+	std::vector<std::string> litFeatures = { "SCROLLING", "CELL_SHADING", "FLOOR_FUNC", "RIM_LIGHTING", "ONLY_RIM_COLOR", "INVERSE_NORMAL_MATRIX" };
+	Shader litShader("shaders/defaultLit.vert", "shaders/defaultLit.frag", litFeatures);
 
 	//Used to draw light sphere
 	Shader unlitShader("shaders/defaultLit.vert", "shaders/unlit.frag");
 
+	//Uniforms set once per draw are resolved up front
+	UniformHandle litModelUniform = litShader.getUniform("_Model");
+	UniformHandle litNormalMatrixUniform = litShader.getUniform("_NormalMatrix");
+	UniformHandle unlitModelUniform = unlitShader.getUniform("_Model");
+	UniformHandle unlitColorUniform = unlitShader.getUniform("_Color");
+
+	//Light and material blocks are shared by every program that declares them
+	ew::UniformBuffer lightUBO(sizeof(ew::LightBlock), ew::LIGHT_BLOCK_BINDING);
+	ew::UniformBuffer materialUBO(sizeof(ew::MaterialBlock), ew::MATERIAL_BLOCK_BINDING);
+	ew::LightBlock lightBlock;
+	ew::MaterialBlock materialBlock;
+
+	//Point and spot lights are binned into view-space clusters every frame
+	ew::LightClusters lightClusters;
+	std::vector<ew::PtLightData> ptLightData;
+	std::vector<ew::SpLightData> spLightData;
+	std::vector<ew::PtLightData> stressLights;
+	int spawnedStressLights = -1;
+	float spawnedStressRadius = 0.0f;
+
 	//Stencil Shader
 	Shader outliningProgram("shaders/outlining.vert", "shaders/outlining.frag");
+	UniformHandle outliningModelUniform = outliningProgram.getUniform("_Model");
+	UniformHandle outliningTranslationUniform = outliningProgram.getUniform("_Translation");
+
+	//Every program, for startup timing and hot reloading
+	Shader* shaders[] = { &litShader, &unlitShader, &outliningProgram };
+
+	//Cold starts compile every program, warm starts load them from the binary cache
+	float totalBuildTime = 0.0f;
+	int numFromCache = 0;
+	for (Shader* shader : shaders) {
+		totalBuildTime += shader->getBuildTime();
+		numFromCache += shader->isFromBinaryCache() ? 1 : 0;
+		//Saving a shader file rebuilds it in place while the app keeps running
+		shader->setHotReload(true);
+	}
+	printf("Built %d shader programs in %.2f ms (%d from binary cache)\n", IM_ARRAYSIZE(shaders), totalBuildTime, numFromCache);
+
+	if (benchUniforms) {
+		ew::benchmarkUniformSetters(litShader, { "_Model", "_View", "_Projection" }, 100000);
+		glfwTerminate();
+		return 0;
+	}
 
 	ew::MeshData cubeMeshData;
 	ew::createCube(1.0f, 1.0f, 1.0f, cubeMeshData);
@@ -169,10 +331,19 @@ int main() {
 	ew::MeshData planeMeshData;
 	ew::createPlane(1.0f, 1.0f, planeMeshData);
 
-	ew::Mesh cubeMesh(&cubeMeshData);
-	ew::Mesh sphereMesh(&sphereMeshData);
-	ew::Mesh planeMesh(&planeMeshData);
-	ew::Mesh cylinderMesh(&cylinderMeshData);
+	//All meshes share one vertex and index buffer, so every draw uses the same VAO
+	ew::GeometryPool geometryPool;
+	//Vertices are only needed until they're uploaded, after that just the bounds are kept
+	ew::Mesh cubeMesh(&cubeMeshData, &geometryPool, true);
+	ew::Mesh sphereMesh(&sphereMeshData, &geometryPool, true);
+	ew::Mesh planeMesh(&planeMeshData, &geometryPool, true);
+	ew::Mesh cylinderMesh(&cylinderMeshData, &geometryPool, true);
+
+	if (benchNormals) {
+		ew::benchmarkNormalMatrix(litShader, LIT_INVERSE_NORMAL_MATRIX, litModelUniform, litNormalMatrixUniform, { &sphereMesh, &cylinderMesh }, 500);
+		glfwTerminate();
+		return 0;
+	}
 
 	material.ambientK = 0.25;
 	material.diffuseK = 0.5;
@@ -193,16 +364,16 @@ int main() {
 	float outlineThickness = 1.05f;
 
 	//Enable back face culling
-	glEnable(GL_CULL_FACE);
-	glCullFace(GL_BACK);
+	glState.enable(GL_CULL_FACE);
+	glState.cullFace(GL_BACK);
 
 	//Enable blending
-	glEnable(GL_BLEND);
-	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glState.enable(GL_BLEND);
+	glState.blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
 	//Enable depth testing
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	glState.enable(GL_DEPTH_TEST);
+	glState.depthFunc(GL_LESS);
 
 	//Initialize shape transforms
 	ew::Transform cubeTransform;
@@ -227,30 +398,126 @@ int main() {
 	//lightTransform2.scale = glm::vec3(0.5f);
 	//lightTransform2.position = glm::vec3(-1.0f, 5.0f, -1.0f);
 
-	glActiveTexture(GL_TEXTURE0);
-	GLuint bamboo = createTexture("../../Resources/Bamboo/Bamboo001A_4K_Color.jpg");
+	//Objects are scene graph nodes, so only the ones that move get their matrices rebuilt
+	ew::SceneGraph scene;
+	int cubeNode = scene.addNode(cubeTransform);
+	int sphereNode = scene.addNode(sphereTransform);
+	int cylinderNode = scene.addNode(cylinderTransform);
+	int planeNode = scene.addNode(planeTransform);
+	int lightNode1 = scene.addNode(lightTransform1);
+
+	//Objects outside the camera's frustum are skipped when drawing
+	scene.update();
+	ew::FrustumCuller frustumCuller;
+	int cubeObject = frustumCuller.add(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode));
+	int sphereObject = frustumCuller.add(sphereMesh.getBounds(), scene.getWorldMatrix(sphereNode));
+	int cylinderObject = frustumCuller.add(cylinderMesh.getBounds(), scene.getWorldMatrix(cylinderNode));
+	int planeObject = frustumCuller.add(planeMesh.getBounds(), scene.getWorldMatrix(planeNode));
+	int lightObject1 = frustumCuller.add(sphereMesh.getBounds(), scene.getWorldMatrix(lightNode1));
+
+	//Same objects in the same order as the frustum culler, so they share indices
+	ew::BVH sceneBVH;
+	sceneBVH.build({
+		ew::transformBounds(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode)),
+		ew::transformBounds(sphereMesh.getBounds(), scene.getWorldMatrix(sphereNode)),
+		ew::transformBounds(cylinderMesh.getBounds(), scene.getWorldMatrix(cylinderNode)),
+		ew::transformBounds(planeMesh.getBounds(), scene.getWorldMatrix(planeNode)),
+		ew::transformBounds(sphereMesh.getBounds(), scene.getWorldMatrix(lightNode1)),
+	});
+	const char* objectNames[] = { "Cube", "Sphere", "Cylinder", "Plane", "Light" };
+	int pickedObject = -1;
+	float pickedDistance = 0.0f;
+	std::vector<int> litObjects;
+
+	//Draws are queued each frame and run in sort key order, so each program is bound once per pass
+	ew::RenderQueue renderQueue;
+	std::vector<DrawCommand> drawCommands;
+
+	//Decodes on worker threads so the first frame doesn't wait on 4K JPEGs
+	ew::TextureLoader textureLoader;
+
+	glState.activeTexture(GL_TEXTURE0);
+	GLuint bamboo = createTexture(textureLoader, "../../Resources/Bamboo/Bamboo001A_4K_Color.jpg");
 	
-	glActiveTexture(GL_TEXTURE1);
-	GLuint fabric = createTexture("../../Resources/Fabric/Fabric061_4K_Color.jpg");
+	glState.activeTexture(GL_TEXTURE1);
+	GLuint fabric = createTexture(textureLoader, "../../Resources/Fabric/Fabric061_4K_Color.jpg");
 
-	while (!glfwWindowShouldClose(window)) {
-		processInput(window);
+	//Headless frames are drawn offscreen, a hidden window's own framebuffer may not have any pixels
+	ew::OffscreenTarget offscreenTarget;
+	if (headless) {
+		offscreenTarget.create(SCREEN_WIDTH, SCREEN_HEIGHT);
+	}
+	//Where each frame ends up, 0 for the window
+	GLuint screenFramebuffer = offscreenTarget.getFramebuffer();
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFramebuffer);
+	ew::Profiler& profiler = ew::Profiler::get();
+	ew::FrameRecorder frameRecorder;
+	if (headless) {
+		frameRecorder.attach(profiler, ew::HEADLESS_WARMUP_FRAMES);
+	}
+	int frameIndex = 0;
+
+	while (headless ? frameIndex < ew::HEADLESS_WARMUP_FRAMES + headlessFrames : !glfwWindowShouldClose(window)) {
+		profiler.beginFrame();
+		if (!headless) {
+			processInput(window);
+		}
 		glClearColor(bgColor.r,bgColor.g,bgColor.b, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
+		textureLoader.update();
+		for (Shader* shader : shaders) {
+			shader->reloadIfChanged();
+		}
+
 		ImGui_ImplOpenGL3_NewFrame();
 		ImGui_ImplGlfw_NewFrame();
 		ImGui::NewFrame();
 
-		float time = (float)glfwGetTime();
+		float time = headless ? frameIndex * ew::HEADLESS_TIMESTEP : (float)glfwGetTime();
+		if (headless) {
+			ew::followBenchmarkPath(camera, time);
+		}
 		deltaTime = time - lastFrameTime;
 		lastFrameTime = time;
 
 		//UPDATE
 		cubeTransform.rotation.x += deltaTime;
+		scene.setLocalTransform(cubeNode, cubeTransform);
+		if (lightTransform1.position != scene.getLocalTransform(lightNode1).position) {
+			scene.setLocalTransform(lightNode1, lightTransform1);
+		}
+		scene.update();
+		frustumCuller.setModelMatrix(cubeObject, scene.getWorldMatrix(cubeNode));
+		frustumCuller.setModelMatrix(lightObject1, scene.getWorldMatrix(lightNode1));
+		frustumCuller.cull(camera.getFrustum());
+		sceneBVH.setObjectBounds(cubeObject, ew::transformBounds(cubeMesh.getBounds(), scene.getWorldMatrix(cubeNode)));
+		sceneBVH.setObjectBounds(lightObject1, ew::transformBounds(sphereMesh.getBounds(), scene.getWorldMatrix(lightNode1)));
+		sceneBVH.refit();
+		if (pickRequested) {
+			glm::vec2 ndc = glm::vec2(0.0f);
+			if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED) {
+				int windowWidth, windowHeight;
+				glfwGetWindowSize(window, &windowWidth, &windowHeight);
+				ndc = glm::vec2((float)mouseX / windowWidth * 2.0f - 1.0f, 1.0f - (float)mouseY / windowHeight * 2.0f);
+			}
+			pickedObject = sceneBVH.raycast(camera.getPosition(), camera.getRayDirection(ndc), &pickedDistance);
+			pickRequested = false;
+		}
+		//Objects within light 1's reach, which ends at its linear attenuation distance
+		litObjects.clear();
+		sceneBVH.querySphere(lightTransform1.position, ptLight1.linearAtt, litObjects);
 
 		//Draw
-		litShader.use();
+		profiler.beginScope("Scene");
+		uint32_t litVariant = 0;
+		if (scrolling) litVariant |= LIT_SCROLLING;
+		if (cellShadingEnabled) litVariant |= LIT_CELL_SHADING;
+		//Floor only matters when cell shading, so don't build a separate program for it otherwise
+		if (cellShadingEnabled && floorFuncEnabled) litVariant |= LIT_FLOOR_FUNC;
+		if (RimLightingEnabled) litVariant |= LIT_RIM_LIGHTING;
+		if (_OnlyRimLightingColor) litVariant |= LIT_ONLY_RIM_COLOR;
+		litShader.selectVariant(litVariant);
 		litShader.setMat4("_Projection", camera.getProjectionMatrix());
 		litShader.setMat4("_View", camera.getViewMatrix());
 
@@ -258,117 +525,171 @@ int main() {
 		 
 		//Quincy Code Cell Shading
 		//**************************
-		litShader.setVec3("_DirLight[0].color", dirLight.color);
-		litShader.setVec3("_DirLight[0].direction", normalize(dirLight.direction));
-		litShader.setFloat("_DirLight[0].intensity", dirLight.intensity);
-		litShader.setInt("CellShadingEnabled", cellShadingEnabled);
+		lightBlock.dirLights[0].color = dirLight.color;
+		lightBlock.dirLights[0].direction = normalize(dirLight.direction);
+		lightBlock.dirLights[0].intensity = dirLight.intensity;
 		litShader.setInt("toon_color_levels", toon_color_levels);
-		litShader.setInt("floorFuncEnabled", floorFuncEnabled); 
-	    litShader.setInt("RimLightingEnabled", RimLightingEnabled);
 		litShader.setFloat("_RimLightPower", _RimLightPower);
-		litShader.setInt("_OnlyRimLightingColor", _OnlyRimLightingColor);
 		//*******************************
 
-		litShader.setVec3("_PtLight[0].position", lightTransform1.position);
-		litShader.setVec3("_PtLight[0].color", ptLight1.color);
-		litShader.setFloat("_PtLight[0].intensity", ptLight1.intensity);
-		litShader.setFloat("_PtLight[0].linearAtt", ptLight1.linearAtt);
-
-		//litShader.setVec3("_PtLight[1].position", lightTransform2.position);
-		//litShader.setVec3("_PtLight[1].color", ptLight2.color);
-		//litShader.setFloat("_PtLight[1].intensity", ptLight2.intensity);
-		//litShader.setFloat("_PtLight[1].linearAtt", ptLight2.linearAtt);
-
-		//litShader.setVec3("_SpLight[0].color", spLight.color);
-		//litShader.setVec3("_SpLight[0].position", spLight.position);
-		//litShader.setVec3("_SpLight[0].direction", normalize(spLight.direction));
-		//litShader.setFloat("_SpLight[0].intensity", spLight.intensity);
-		//litShader.setFloat("_SpLight[0].linearAtt", spLight.linearAtt);
-		//litShader.setFloat("_SpLight[0].minAngle", cos(spLight.minAngle / 180 * 3.14159));
-		//litShader.setFloat("_SpLight[0].maxAngle", cos(spLight.maxAngle / 180 * 3.14159));
-		//litShader.setFloat("_SpLight[0].falloffCurve", spLight.falloffCurve);
-
-		litShader.setInt("numDirLights", 1);
-		litShader.setInt("numPtLights", 1);
-		//litShader.setInt("numSpLights", 1);
+		ptLightData.clear();
+		spLightData.clear();
+
+		ew::PtLightData ptLightData1;
+		ptLightData1.position = lightTransform1.position;
+		ptLightData1.color = ptLight1.color;
+		ptLightData1.intensity = ptLight1.intensity;
+		ptLightData1.linearAtt = ptLight1.linearAtt;
+		ptLightData.push_back(ptLightData1);
+
+		//ew::PtLightData ptLightData2;
+		//ptLightData2.position = lightTransform2.position;
+		//ptLightData2.color = ptLight2.color;
+		//ptLightData2.intensity = ptLight2.intensity;
+		//ptLightData2.linearAtt = ptLight2.linearAtt;
+		//ptLightData.push_back(ptLightData2);
+
+		//ew::SpLightData spLightData1;
+		//spLightData1.color = spLight.color;
+		//spLightData1.position = spLight.position;
+		//spLightData1.direction = normalize(spLight.direction);
+		//spLightData1.intensity = spLight.intensity;
+		//spLightData1.linearAtt = spLight.linearAtt;
+		//spLightData1.minAngle = cos(spLight.minAngle / 180 * 3.14159);
+		//spLightData1.maxAngle = cos(spLight.maxAngle / 180 * 3.14159);
+		//spLightData1.falloffCurve = spLight.falloffCurve;
+		//spLightData.push_back(spLightData1);
+
+		//Stress lights orbit the scene so they get re-binned every frame
+		if (numStressLights != spawnedStressLights || stressLightRadius != spawnedStressRadius) {
+			spawnStressLights(stressLights, numStressLights, stressLightRadius);
+			spawnedStressLights = numStressLights;
+			spawnedStressRadius = stressLightRadius;
+		}
+		float orbitAngle = time * stressLightOrbitSpeed;
+		for (const ew::PtLightData& stressLight : stressLights) {
+			ew::PtLightData orbiting = stressLight;
+			orbiting.position.x = stressLight.position.x * cos(orbitAngle) - stressLight.position.z * sin(orbitAngle);
+			orbiting.position.z = stressLight.position.x * sin(orbitAngle) + stressLight.position.z * cos(orbitAngle);
+			ptLightData.push_back(orbiting);
+		}
+
+		lightClusters.setDepthRange(camera.getNearPlane(), camera.getFarPlane());
+		lightClusters.build(ptLightData, spLightData, camera.getViewMatrix(), camera.getProjectionMatrix(), SCREEN_WIDTH, SCREEN_HEIGHT);
+
+		lightBlock.numDirLights = 1;
+
+		//One upload for every light, shared by all programs using LightBlock
+		lightUBO.update(lightBlock);
 
 		litShader.setVec3("_CameraPos", camera.getPosition());
 
 		//Set some material uniforms
-		litShader.setVec3("_Material.color", material.color);
-		litShader.setInt("Scrolling", scrolling);
-		litShader.setFloat("Time", (float)glfwGetTime() * scrollSpeed);
-		litShader.setFloat("_Material.ambientK", material.ambientK);
-		litShader.setFloat("_Material.diffuseK", material.diffuseK);
-		litShader.setFloat("_Material.specularK", material.specularK);
-		litShader.setFloat("_Material.shininess", material.shininess);
+		materialBlock.material.color = material.color;
+		litShader.setFloat("Time", time * scrollSpeed);
+		materialBlock.material.ambientK = material.ambientK;
+		materialBlock.material.diffuseK = material.diffuseK;
+		materialBlock.material.specularK = material.specularK;
+		materialBlock.material.shininess = material.shininess;
+		materialUBO.update(materialBlock);
 
 		litShader.setInt("first", 0);
 		litShader.setInt("second", 1);
 
-		//Stencil Shader Things
-		glStencilFunc(GL_ALWAYS, 1, 0xFF);
-		glStencilMask(0xFF);
-
-		//Draw cube
-		litShader.setMat4("_Model", cubeTransform.getModelMatrix());
-		cubeMesh.draw();
-
-		//Draw sphere
-		litShader.setMat4("_Model", sphereTransform.getModelMatrix());
-		sphereMesh.draw();
-
-		//Draw cylinder
-		litShader.setMat4("_Model", cylinderTransform.getModelMatrix());
-		cylinderMesh.draw();
-
-		//Draw light as a small sphere using unlit shader, ironically.
-		unlitShader.use();
+		//Uniforms are set on the programs directly, each is bound when its first draw comes up
 		unlitShader.setMat4("_Projection", camera.getProjectionMatrix());
 		unlitShader.setMat4("_View", camera.getViewMatrix());
-		unlitShader.setMat4("_Model", lightTransform1.getModelMatrix());
-		unlitShader.setVec3("_Color", ptLight1.color);
-		sphereMesh.draw();
-		//unlitShader.setMat4("_Model", lightTransform2.getModelMatrix());
-		//unlitShader.setVec3("_Color", ptLight2.color);
-		//sphereMesh.draw();
-
-		//Draw plane while ignoring the stencil buffer
-		glDisable(GL_STENCIL_TEST);
-		litShader.use();
-		litShader.setMat4("_Model", planeTransform.getModelMatrix());
-		planeMesh.draw();
-		glEnable(GL_STENCIL_TEST);
-
-		//More Stencil Shader Things
-		glStencilFunc(GL_NOTEQUAL, 1, 0xFF);
-		glStencilMask(0x00);
-		glDisable(GL_DEPTH_TEST);
-		outliningProgram.use();
 		outliningProgram.setMat4("_Projection", camera.getProjectionMatrix());
 		outliningProgram.setMat4("_View", camera.getViewMatrix());
 		outliningProgram.setFloat("_Outlining", outlineThickness);
 		outliningProgram.setVec3("_Color", outlineColor);
 
-		//Draw cube outline
-		outliningProgram.setMat4("_Model", cubeTransform.getModelMatrixWithoutTranslation());
-		outliningProgram.setMat4("_Translation", cubeTransform.getTranslationMatrix());
-		cubeMesh.draw();
-
-		//Draw sphere outline
-		outliningProgram.setMat4("_Model", sphereTransform.getModelMatrixWithoutTranslation());
-		outliningProgram.setMat4("_Translation", sphereTransform.getTranslationMatrix());
-		sphereMesh.draw();
-
-		//Draw cylinder outline
-		outliningProgram.setMat4("_Model", cylinderTransform.getModelMatrixWithoutTranslation());
-		outliningProgram.setMat4("_Translation", cylinderTransform.getTranslationMatrix());
-		cylinderMesh.draw();
-
-		//Even More Stencil Shader Things
-		glStencilMask(0xFF);
-		glStencilFunc(GL_ALWAYS, 0, 0xFF);
-		glEnable(GL_DEPTH_TEST);
+		//Queue every draw
+		renderQueue.clear();
+		drawCommands.clear();
+		glm::mat4 viewMatrix = camera.getViewMatrix();
+		auto submitDraw = [&](DrawPass pass, DrawMaterial material, const DrawCommand& command) {
+			//Distance to the object's origin, close enough to order whole objects
+			glm::vec3 position = command.node >= 0 ? glm::vec3(scene.getWorldMatrix(command.node)[3]) : glm::vec3(command.translation[3]);
+			float viewDepth = -(viewMatrix * glm::vec4(position, 1.0f)).z;
+			uint32_t depthBucket = ew::RenderQueue::getDepthBucket(viewDepth, camera.getFarPlane());
+			renderQueue.submit(ew::RenderQueue::makeOpaqueKey(pass, command.shader, material, depthBucket), (int)drawCommands.size());
+			drawCommands.push_back(command);
+		};
+		if (frustumCuller.isVisible(cubeObject)) {
+			submitDraw(PASS_STENCILED, MATERIAL_BAMBOO_FABRIC, { &cubeMesh, SHADER_LIT, cubeNode });
+		}
+		if (frustumCuller.isVisible(sphereObject)) {
+			submitDraw(PASS_STENCILED, MATERIAL_BAMBOO_FABRIC, { &sphereMesh, SHADER_LIT, sphereNode });
+		}
+		if (frustumCuller.isVisible(cylinderObject)) {
+			submitDraw(PASS_STENCILED, MATERIAL_BAMBOO_FABRIC, { &cylinderMesh, SHADER_LIT, cylinderNode });
+		}
+		//Draw light as a small sphere using unlit shader, ironically.
+		if (frustumCuller.isVisible(lightObject1)) {
+			submitDraw(PASS_STENCILED, MATERIAL_NONE, { &sphereMesh, SHADER_UNLIT, lightNode1, ptLight1.color });
+		}
+		if (frustumCuller.isVisible(planeObject)) {
+			submitDraw(PASS_UNSTENCILED, MATERIAL_BAMBOO_FABRIC, { &planeMesh, SHADER_LIT, planeNode });
+		}
+		//Outlines aren't culled, they're drawn scaled up so can reach past their object's bounds
+		submitDraw(PASS_OUTLINE, MATERIAL_NONE, { &cubeMesh, SHADER_OUTLINING, -1, glm::vec3(0), cubeTransform.getModelMatrixWithoutTranslation(), cubeTransform.getTranslationMatrix() });
+		submitDraw(PASS_OUTLINE, MATERIAL_NONE, { &sphereMesh, SHADER_OUTLINING, -1, glm::vec3(0), sphereTransform.getModelMatrixWithoutTranslation(), sphereTransform.getTranslationMatrix() });
+		submitDraw(PASS_OUTLINE, MATERIAL_NONE, { &cylinderMesh, SHADER_OUTLINING, -1, glm::vec3(0), cylinderTransform.getModelMatrixWithoutTranslation(), cylinderTransform.getTranslationMatrix() });
+
+		//Run them in key order, changing stencil and depth state only where the pass changes
+		renderQueue.sort();
+		int currentPass = -1;
+		for (const ew::RenderItem& item : renderQueue.getItems()) {
+			int pass = (int)ew::RenderQueue::getPass(item.key);
+			if (pass != currentPass) {
+				currentPass = pass;
+				switch (pass) {
+				case PASS_STENCILED:
+					glState.enable(GL_STENCIL_TEST);
+					glState.stencilFunc(GL_ALWAYS, 1, 0xFF);
+					glState.stencilMask(0xFF);
+					glState.enable(GL_DEPTH_TEST);
+					break;
+				case PASS_UNSTENCILED:
+					glState.disable(GL_STENCIL_TEST);
+					glState.enable(GL_DEPTH_TEST);
+					break;
+				case PASS_OUTLINE:
+					glState.enable(GL_STENCIL_TEST);
+					glState.stencilFunc(GL_NOTEQUAL, 1, 0xFF);
+					glState.stencilMask(0x00);
+					glState.disable(GL_DEPTH_TEST);
+					break;
+				}
+			}
+			const DrawCommand& command = drawCommands[item.command];
+			switch (command.shader) {
+			case SHADER_LIT:
+				litShader.use();
+				litShader.setMat4(litModelUniform, scene.getWorldMatrix(command.node));
+				litShader.setMat3(litNormalMatrixUniform, scene.getWorldNormalMatrix(command.node));
+				break;
+			case SHADER_UNLIT:
+				unlitShader.use();
+				unlitShader.setMat4(unlitModelUniform, scene.getWorldMatrix(command.node));
+				unlitShader.setVec3(unlitColorUniform, command.color);
+				break;
+			case SHADER_OUTLINING:
+				outliningProgram.use();
+				outliningProgram.setMat4(outliningModelUniform, command.model);
+				outliningProgram.setMat4(outliningTranslationUniform, command.translation);
+				break;
+			}
+			command.mesh->draw();
+		}
+
+		//Back to what the stencil clear and the next frame expect
+		glState.enable(GL_STENCIL_TEST);
+		glState.stencilMask(0xFF);
+		glState.stencilFunc(GL_ALWAYS, 0, 0xFF);
+		glState.enable(GL_DEPTH_TEST);
+		profiler.endScope();
 
 		//Draw UI
 		ImGui::Begin("Material");
@@ -437,16 +758,66 @@ int main() {
 		//ImGui::SliderFloat("Falloff Curve", &spLight.falloffCurve, 0, 1);
 		//ImGui::End();
 
+		ImGui::Begin("Clustered Lights");
+		ImGui::SliderInt("Stress Lights", &numStressLights, 0, 4096);
+		ImGui::SliderFloat("Stress Light Radius", &stressLightRadius, 0.25f, 5.0f);
+		ImGui::SliderFloat("Stress Orbit Speed", &stressLightOrbitSpeed, 0.0f, 2.0f);
+		ImGui::Text("Lights: %d", (int)ptLightData.size() + (int)spLightData.size());
+		ImGui::Text("Clusters: %d", lightClusters.getNumClusters());
+		ImGui::Text("Light indices: %d", lightClusters.getNumIndices());
+		ImGui::Text("Max lights per cluster: %d", lightClusters.getMaxLightsPerCluster());
+		ImGui::Text("Frame time: %.2f ms", deltaTime * 1000.0f);
+		ImGui::End();
+
+		ImGui::Begin("Culling");
+		ImGui::Text("Drawn: %d", frustumCuller.getNumDrawn());
+		ImGui::Text("Frustum culled: %d", frustumCuller.getNumCulled());
+		ImGui::End();
+
+		ImGui::Begin("Picking");
+		ImGui::Text("Picked: %s", pickedObject >= 0 ? objectNames[pickedObject] : "nothing");
+		if (pickedObject >= 0) {
+			ImGui::Text("Distance: %.2f", pickedDistance);
+		}
+		ImGui::Text("Objects lit by light 1:");
+		for (int object : litObjects) {
+			if (object != lightObject1) {
+				ImGui::BulletText("%s", objectNames[object]);
+			}
+		}
+		ImGui::End();
+
 		ImGui::Begin("Outline");
 		ImGui::ColorEdit3("Color", &outlineColor.r);
 		ImGui::SliderFloat("Thickness", &outlineThickness, 1, 2);
 		ImGui::End();
 
+		profiler.drawUI();
+
 		ImGui::Render();
+		profiler.beginScope("UI");
 		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+		profiler.endScope();
+		profiler.setCounter("GL state calls issued", glState.getNumIssued());
+		profiler.setCounter("GL state calls filtered", glState.getNumFiltered());
+		glState.resetCounters();
+		profiler.endFrame();
 		glfwPollEvents();
 
-		glfwSwapBuffers(window);
+		if (!headless) {
+			glfwSwapBuffers(window);
+		}
+		frameIndex++;
+	}
+
+	if (headless) {
+		profiler.flush();
+		frameRecorder.printJson(stdout, "Texture Map", SCREEN_WIDTH, SCREEN_HEIGHT);
+	}
+	if (ew::TraceRecorder::get().isEnabled()) {
+		//Puts the last frames' GPU times on the trace
+		profiler.flush();
+		ew::TraceRecorder::get().writeJson("trace.json");
 	}
 
 	glfwTerminate();
@@ -458,7 +829,7 @@ void resizeFrameBufferCallback(GLFWwindow* window, int width, int height)
 	SCREEN_WIDTH = width;
 	SCREEN_HEIGHT = height;
 	camera.setAspectRatio((float)SCREEN_WIDTH / SCREEN_HEIGHT);
-	glViewport(0, 0, width, height);
+	ew::GLState::get().viewport(0, 0, width, height);
 }
 //Author: Eric Winebrenner
 void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action, int mods)
@@ -473,6 +844,9 @@ void keyboardCallback(GLFWwindow* window, int keycode, int scancode, int action,
 		camera.setPitch(0.0f);
 		firstMouseInput = false;
 	}
+	if (keycode == GLFW_KEY_F9 && action == GLFW_PRESS) {
+		ew::TraceRecorder::get().writeJson("trace.json");
+	}
 	if (keycode == GLFW_KEY_1 && action == GLFW_PRESS) {
 		wireFrame = !wireFrame;
 		glPolygonMode(GL_FRONT_AND_BACK, wireFrame ? GL_LINE : GL_FILL);
@@ -489,6 +863,8 @@ void mouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset)
 //Author: Eric Winebrenner
 void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
 {
+	mouseX = xpos;
+	mouseY = ypos;
 	if (glfwGetInputMode(window, GLFW_CURSOR) != GLFW_CURSOR_DISABLED) {
 		return;
 	}
@@ -514,6 +890,10 @@ void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 		glfwSetInputMode(window, GLFW_CURSOR, inputMode);
 		glfwGetCursorPos(window, &prevMouseX, &prevMouseY);
 	}
+	//Pick under the cursor, or the middle of the screen while it's locked
+	if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !ImGui::GetIO().WantCaptureMouse) {
+		pickRequested = true;
+	}
 }
 
 //Author: Eric Winebrenner
@@ -547,53 +927,36 @@ void processInput(GLFWwindow* window) {
 	camera.setPosition(position);
 }
 
-//Create a function that loads a tecture from a file and returns a handle to it.
-GLuint createTexture(const char* filePath) {
-
-	//Generate a texture name
-	GLuint texture;
-	glGenTextures(1, &texture);
+//Queue a texture to load in the background and return a handle to it straight away.
+//It shows placeholderColor until the loader has decoded and uploaded the file.
+GLuint createTexture(ew::TextureLoader& loader, const char* filePath, glm::vec4 placeholderColor) {
+	const GLenum wrapModes[] = { GL_CLAMP_TO_EDGE, GL_CLAMP_TO_BORDER, GL_REPEAT, GL_MIRRORED_REPEAT };
 
-	//Bind our name to GL_TEXTURE_2D to make it a 2D texture.
-	glBindTexture(GL_TEXTURE_2D, texture);
-
-	//Load texture data as file
-	int width, height, numComponents;
-	unsigned char* textureData = stbi_load(filePath, &width, &height, &numComponents, 0);
-	if (textureData == NULL) {
-		printf("Texture data did not work");
-	}
-
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, textureData);
-
-	//Wrapping
-	switch (currentWrapMode) {
-		case 0:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-			break;
-		case 1:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-			break;
-		case 2:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-			break;
-		case 3:
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_MIRRORED_REPEAT);
-			glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_MIRRORED_REPEAT);
-			break;
-	}
+	ew::TextureSettings settings;
+	settings.wrapMode = wrapModes[currentWrapMode];
 
 	//When magnififying, use nearest neighbor sampling
-	glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	settings.magFilter = GL_NEAREST;
 
 	//When minifying, use bilinear sampling
-	glTextureParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_LINEAR);
+	settings.minFilter = GL_NEAREST_MIPMAP_LINEAR;
 
-	glGenerateMipmap(GL_TEXTURE_2D);
-	
-	return texture;
+	settings.placeholderColor = placeholderColor;
+	return loader.load(filePath, settings);
 }
 
+//Scatters point lights around the cube/sphere/cylinder/plane set. Seeded so the same count gives the same layout.
+void spawnStressLights(std::vector<ew::PtLightData>& lights, int count, float radius) {
+	lights.clear();
+	lights.reserve(count);
+	srand(1234);
+	auto random01 = []() { return (float)rand() / (float)RAND_MAX; };
+	for (int i = 0; i < count; i++) {
+		ew::PtLightData light;
+		light.position = glm::vec3(random01() * 10.0f - 5.0f, random01() * 2.5f - 0.9f, random01() * 10.0f - 5.0f);
+		light.color = glm::vec3(random01(), random01(), random01());
+		light.intensity = 0.5f;
+		light.linearAtt = radius;
+		lights.push_back(light);
+	}
+}
@@ -4,6 +4,14 @@ layout (location = 1) in vec3 vNormal;
 layout (location = 2) in vec2 uv;
 
 uniform mat4 _Model;
+//transpose(inverse(mat3(_Model))), computed on the CPU by ew::Transform::getNormalMatrix()
+uniform mat3 _NormalMatrix;
+#ifdef INVERSE_NORMAL_MATRIX
+//What every vertex used to do before the CPU took over, only compiled for --bench-normals
+#define NORMAL_MATRIX transpose(inverse(mat3(_Model)))
+#else
+#define NORMAL_MATRIX _NormalMatrix
+#endif
 uniform mat4 _View;
 uniform mat4 _Projection;
 
@@ -15,7 +23,7 @@ out struct Vertex{
     vec2 Uv;
 }v_out;
 
-uniform bool Scrolling;
+//SCROLLING is defined by the Shader variant, see main.cpp
 uniform float Time;
 
 void main(){    
@@ -28,18 +36,17 @@ void main(){
     v_out.Eye = normalize(-viewSpacePos);//vector towards cam/eye
     //********************************
 
-    v_out.WorldNormal = transpose(inverse(mat3(_Model))) * vNormal;
+    v_out.WorldNormal = NORMAL_MATRIX * vNormal;
     gl_Position = _Projection * _View * _Model * vec4(vPos,1);
 
-    if(Scrolling) {
-        vec2 temp = uv;
-        temp.y += mod(Time,1);
-        if(temp.y > 1) {
-            temp.y--;
-        }
-        v_out.Uv = temp;
-    }
-    else {
-        v_out.Uv = uv;
+#ifdef SCROLLING
+    vec2 temp = uv;
+    temp.y += mod(Time,1);
+    if(temp.y > 1) {
+        temp.y--;
     }
+    v_out.Uv = temp;
+#else
+    v_out.Uv = uv;
+#endif
 }
@@ -0,0 +1,239 @@
+//Author: Eric Winebrenner
+
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace ew {
+	static uint16_t packRGB565(const float* color) {
+		int r = (int)std::round(std::clamp(color[0], 0.0f, 255.0f) * 31.0f / 255.0f);
+		int g = (int)std::round(std::clamp(color[1], 0.0f, 255.0f) * 63.0f / 255.0f);
+		int b = (int)std::round(std::clamp(color[2], 0.0f, 255.0f) * 31.0f / 255.0f);
+		return (uint16_t)((r << 11) | (g << 5) | b);
+	}
+
+	static void unpackRGB565(uint16_t packed, float* color) {
+		int r = (packed >> 11) & 31;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (float)((r << 3) | (r >> 2));
+		color[1] = (float)((g << 2) | (g >> 4));
+		color[2] = (float)((b << 3) | (b >> 2));
+	}
+
+	static float distanceSquared(const float* a, const float* b) {
+		float dr = a[0] - b[0], dg = a[1] - b[1], db = a[2] - b[2];
+		return dr * dr + dg * dg + db * db;
+	}
+
+	//Picks the nearest of the 4 palette entries for each pixel. Returns the total squared error.
+	static float fitBC1Indices(const float pixels[16][3], uint16_t c0, uint16_t c1, uint32_t& indices) {
+		float palette[4][3];
+		unpackRGB565(c0, palette[0]);
+		unpackRGB565(c1, palette[1]);
+		for (int c = 0; c < 3; c++) {
+			palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+			palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+		}
+
+		indices = 0;
+		float totalError = 0.0f;
+		for (int i = 0; i < 16; i++) {
+			int best = 0;
+			float bestError = distanceSquared(pixels[i], palette[0]);
+			for (int p = 1; p < 4; p++) {
+				float error = distanceSquared(pixels[i], palette[p]);
+				if (error < bestError) {
+					bestError = error;
+					best = p;
+				}
+			}
+			indices |= (uint32_t)best << (i * 2);
+			totalError += bestError;
+		}
+		return totalError;
+	}
+
+	//BC1 only decodes 4 colors when c0 > c1, so order the endpoints and remap indices to match
+	static void orderBC1Endpoints(uint16_t& c0, uint16_t& c1, uint32_t& indices) {
+		if (c0 >= c1) {
+			return;
+		}
+		std::swap(c0, c1);
+		//Swapping endpoints swaps 0<->1 and 2<->3, which is flipping the low bit of every index
+		indices ^= 0x55555555u;
+	}
+
+	void compressBC1Block(const uint8_t* rgba, uint8_t* out) {
+		float pixels[16][3];
+		float mean[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; i++) {
+			for (int c = 0; c < 3; c++) {
+				pixels[i][c] = rgba[i * 4 + c];
+				mean[c] += pixels[i][c] / 16.0f;
+			}
+		}
+
+		//Principal axis of the block's colors by power iteration on the covariance matrix
+		float cov[6] = { 0, 0, 0, 0, 0, 0 };
+		for (int i = 0; i < 16; i++) {
+			float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+			cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+			cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+		}
+		float axis[3] = { 1, 1, 1 };
+		for (int iter = 0; iter < 8; iter++) {
+			float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+			float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+			float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+			float length = std::max(std::max(std::abs(x), std::abs(y)), std::abs(z));
+			if (length < 1e-6f) {
+				break;
+			}
+			axis[0] = x / length; axis[1] = y / length; axis[2] = z / length;
+		}
+
+		//Endpoints are the pixels furthest along the axis in each direction
+		int minIndex = 0, maxIndex = 0;
+		float minDot = 1e30f, maxDot = -1e30f;
+		for (int i = 0; i < 16; i++) {
+			float d = pixels[i][0] * axis[0] + pixels[i][1] * axis[1] + pixels[i][2] * axis[2];
+			if (d < minDot) { minDot = d; minIndex = i; }
+			if (d > maxDot) { maxDot = d; maxIndex = i; }
+		}
+
+		uint16_t c0 = packRGB565(pixels[maxIndex]);
+		uint16_t c1 = packRGB565(pixels[minIndex]);
+		uint32_t indices = 0;
+		if (c0 != c1) {
+			if (c0 < c1) {
+				std::swap(c0, c1);
+			}
+			float error = fitBC1Indices(pixels, c0, c1, indices);
+
+			//One least squares refit of both endpoints given the chosen indices
+			const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+			float aa = 0, ab = 0, bb = 0;
+			float ax[3] = { 0, 0, 0 }, bx[3] = { 0, 0, 0 };
+			for (int i = 0; i < 16; i++) {
+				float a = weights[(indices >> (i * 2)) & 3];
+				float b = 1.0f - a;
+				aa += a * a; ab += a * b; bb += b * b;
+				for (int c = 0; c < 3; c++) {
+					ax[c] += a * pixels[i][c];
+					bx[c] += b * pixels[i][c];
+				}
+			}
+			float det = aa * bb - ab * ab;
+			if (std::abs(det) > 1e-6f) {
+				float end0[3], end1[3];
+				for (int c = 0; c < 3; c++) {
+					end0[c] = (ax[c] * bb - bx[c] * ab) / det;
+					end1[c] = (bx[c] * aa - ax[c] * ab) / det;
+				}
+				uint16_t r0 = packRGB565(end0);
+				uint16_t r1 = packRGB565(end1);
+				if (r0 != r1) {
+					uint32_t refitIndices;
+					float refitError = fitBC1Indices(pixels, r0, r1, refitIndices);
+					if (refitError < error) {
+						c0 = r0;
+						c1 = r1;
+						indices = refitIndices;
+						orderBC1Endpoints(c0, c1, indices);
+					}
+				}
+			}
+		}
+
+		out[0] = (uint8_t)(c0 & 0xFF);
+		out[1] = (uint8_t)(c0 >> 8);
+		out[2] = (uint8_t)(c1 & 0xFF);
+		out[3] = (uint8_t)(c1 >> 8);
+		for (int i = 0; i < 4; i++) {
+			out[4 + i] = (uint8_t)((indices >> (i * 8)) & 0xFF);
+		}
+	}
+
+	void compressBC4Block(const uint8_t* values, int stride, uint8_t* out) {
+		int minValue = 255, maxValue = 0;
+		for (int i = 0; i < 16; i++) {
+			minValue = std::min(minValue, (int)values[i * stride]);
+			maxValue = std::max(maxValue, (int)values[i * stride]);
+		}
+
+		out[0] = (uint8_t)maxValue;
+		out[1] = (uint8_t)minValue;
+		uint64_t indices = 0;
+		if (maxValue != minValue) {
+			//a0 > a1 selects the 8 value mode: a0, a1, then 6 evenly spaced values between them
+			int palette[8];
+			palette[0] = maxValue;
+			palette[1] = minValue;
+			for (int i = 2; i < 8; i++) {
+				palette[i] = ((8 - i) * maxValue + (i - 1) * minValue) / 7;
+			}
+			for (int i = 0; i < 16; i++) {
+				int value = values[i * stride];
+				int best = 0;
+				int bestError = std::abs(value - palette[0]);
+				for (int p = 1; p < 8; p++) {
+					int error = std::abs(value - palette[p]);
+					if (error < bestError) {
+						bestError = error;
+						best = p;
+					}
+				}
+				indices |= (uint64_t)best << (i * 3);
+			}
+		}
+		for (int i = 0; i < 6; i++) {
+			out[2 + i] = (uint8_t)((indices >> (i * 8)) & 0xFF);
+		}
+	}
+
+	void compressBC3Block(const uint8_t* rgba, uint8_t* out) {
+		compressBC4Block(rgba + 3, 4, out);
+		compressBC1Block(rgba, out + 8);
+	}
+
+	void compressBC5Block(const uint8_t* rgba, uint8_t* out) {
+		compressBC4Block(rgba, 4, out);
+		compressBC4Block(rgba + 1, 4, out + 8);
+	}
+
+	std::vector<uint8_t> compressImage(BlockFormat format, const uint8_t* rgba, int width, int height) {
+		std::vector<uint8_t> compressed(blockCompressedSize(format, width, height));
+		int blockSize = bytesPerBlock(format);
+		int blocksX = std::max(1, (width + 3) / 4);
+		int blocksY = std::max(1, (height + 3) / 4);
+
+		uint8_t block[64];
+		uint8_t* out = compressed.data();
+		for (int by = 0; by < blocksY; by++) {
+			for (int bx = 0; bx < blocksX; bx++) {
+				for (int y = 0; y < 4; y++) {
+					int srcY = std::min(by * 4 + y, height - 1);
+					for (int x = 0; x < 4; x++) {
+						int srcX = std::min(bx * 4 + x, width - 1);
+						memcpy(&block[(y * 4 + x) * 4], &rgba[((size_t)srcY * width + srcX) * 4], 4);
+					}
+				}
+				switch (format) {
+				case BlockFormat::BC1:
+					compressBC1Block(block, out);
+					break;
+				case BlockFormat::BC3:
+					compressBC3Block(block, out);
+					break;
+				case BlockFormat::BC5:
+					compressBC5Block(block, out);
+					break;
+				}
+				out += blockSize;
+			}
+		}
+		return compressed;
+	}
+}
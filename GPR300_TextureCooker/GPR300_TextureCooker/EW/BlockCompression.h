@@ -0,0 +1,20 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "DDSFile.h"
+
+namespace ew {
+	//Each block encoder takes a 4x4 block of RGBA8 pixels, row major (64 bytes)
+	void compressBC1Block(const uint8_t* rgba, uint8_t* out);
+	void compressBC3Block(const uint8_t* rgba, uint8_t* out);
+	void compressBC5Block(const uint8_t* rgba, uint8_t* out);
+	//Single channel block. values are 16 bytes, stride bytes apart.
+	void compressBC4Block(const uint8_t* values, int stride, uint8_t* out);
+
+	/// <summary>
+	/// Block compresses a whole RGBA8 image. Edge blocks of sizes that aren't a multiple of 4 repeat the last row/column.
+	/// </summary>
+	std::vector<uint8_t> compressImage(BlockFormat format, const uint8_t* rgba, int width, int height);
+}
@@ -0,0 +1,90 @@
+//Author: Eric Winebrenner
+
+#include "TextureCooker.h"
+#include "BlockCompression.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ew {
+	static uint8_t toByte(float value) {
+		return (uint8_t)std::clamp((int)std::round(value), 0, 255);
+	}
+
+	std::vector<uint8_t> downsample(const uint8_t* rgba, int width, int height, bool normalMap) {
+		int newWidth = std::max(1, width / 2);
+		int newHeight = std::max(1, height / 2);
+		std::vector<uint8_t> result((size_t)newWidth * newHeight * 4);
+
+		for (int y = 0; y < newHeight; y++) {
+			//Clamp so 1 pixel wide/tall sources still work, and odd sizes pick up their last row
+			int y0 = std::min(y * 2, height - 1);
+			int y1 = (y == newHeight - 1) ? height - 1 : std::min(y * 2 + 1, height - 1);
+			for (int x = 0; x < newWidth; x++) {
+				int x0 = std::min(x * 2, width - 1);
+				int x1 = (x == newWidth - 1) ? width - 1 : std::min(x * 2 + 1, width - 1);
+
+				float sum[4] = { 0, 0, 0, 0 };
+				int count = 0;
+				for (int sy = y0; sy <= y1; sy++) {
+					for (int sx = x0; sx <= x1; sx++) {
+						const uint8_t* texel = &rgba[((size_t)sy * width + sx) * 4];
+						for (int c = 0; c < 4; c++) {
+							sum[c] += texel[c];
+						}
+						count++;
+					}
+				}
+
+				uint8_t* dst = &result[((size_t)y * newWidth + x) * 4];
+				if (normalMap) {
+					//Average in [-1,1] and renormalize so lower mips don't get shorter, flatter normals
+					float n[3];
+					float length = 0.0f;
+					for (int c = 0; c < 3; c++) {
+						n[c] = (sum[c] / count) / 127.5f - 1.0f;
+						length += n[c] * n[c];
+					}
+					length = std::sqrt(length);
+					if (length < 1e-6f) {
+						n[0] = 0.0f; n[1] = 0.0f; n[2] = 1.0f;
+						length = 1.0f;
+					}
+					for (int c = 0; c < 3; c++) {
+						dst[c] = toByte((n[c] / length + 1.0f) * 127.5f);
+					}
+					dst[3] = toByte(sum[3] / count);
+				}
+				else {
+					for (int c = 0; c < 4; c++) {
+						dst[c] = toByte(sum[c] / count);
+					}
+				}
+			}
+		}
+		return result;
+	}
+
+	DDSImage cookTexture(const uint8_t* rgba, int width, int height, const CookSettings& settings) {
+		DDSImage image;
+		image.format = settings.format;
+		image.width = width;
+		image.height = height;
+
+		std::vector<uint8_t> level(rgba, rgba + (size_t)width * height * 4);
+		int levelWidth = width, levelHeight = height;
+		while (true) {
+			std::vector<uint8_t> blocks = compressImage(settings.format, level.data(), levelWidth, levelHeight);
+			DDSMip mip = { levelWidth, levelHeight, image.data.size(), blocks.size() };
+			image.mips.push_back(mip);
+			image.data.insert(image.data.end(), blocks.begin(), blocks.end());
+
+			if (levelWidth == 1 && levelHeight == 1) {
+				break;
+			}
+			level = downsample(level.data(), levelWidth, levelHeight, settings.normalMap);
+			levelWidth = std::max(1, levelWidth / 2);
+			levelHeight = std::max(1, levelHeight / 2);
+		}
+		return image;
+	}
+}
@@ -0,0 +1,22 @@
+//Author: Eric Winebrenner
+
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "DDSFile.h"
+
+namespace ew {
+	struct CookSettings {
+		BlockFormat format = BlockFormat::BC1;
+		//Mips average unit vectors and renormalize instead of averaging colors
+		bool normalMap = false;
+	};
+
+	/// <summary>
+	/// Builds the full mip chain of an RGBA8 image on the CPU and block compresses every level.
+	/// </summary>
+	DDSImage cookTexture(const uint8_t* rgba, int width, int height, const CookSettings& settings);
+
+	//Box filtered half size RGBA8 image. Odd sizes fold the last row/column into the previous texel.
+	std::vector<uint8_t> downsample(const uint8_t* rgba, int width, int height, bool normalMap);
+}
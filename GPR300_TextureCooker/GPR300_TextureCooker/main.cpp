@@ -0,0 +1,112 @@
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "EW/DDSFile.h"
+#include "EW/TextureCooker.h"
+
+//Offline converter from source images (jpg/png/tga...) to block compressed, fully mipmapped .dds files.
+//The lighting templates' TextureLoader picks up a .dds sitting next to the image it was asked to load.
+
+const char* formatNames[] = { "BC1", "BC3", "BC5" };
+
+void printUsage() {
+	printf("Usage: GPR300_TextureCooker [--normal] [--bc1 | --bc3 | --bc5] <image> [<image> ...]\n");
+	printf("  Writes <image>.dds next to each input.\n");
+	printf("  --normal  Treat inputs as tangent space normal maps (BC5, renormalized mips).\n");
+	printf("            Files with \"Normal\" in their name are treated as normal maps automatically.\n");
+	printf("  --bcN     Force a block format. Otherwise BC5 for normal maps, BC3 with alpha, BC1 without.\n");
+	printf("Example: GPR300_TextureCooker ../../Resources/Bamboo/Bamboo001A_4K_Color.jpg ../../Resources/Bamboo/Bamboo001A_4K_NormalGL.jpg\n");
+}
+
+std::string outputPath(const std::string& inputPath) {
+	size_t dot = inputPath.find_last_of('.');
+	size_t slash = inputPath.find_last_of("/\\");
+	if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+		return inputPath + ".dds";
+	}
+	return inputPath.substr(0, dot) + ".dds";
+}
+
+int main(int argc, char** argv) {
+	bool forceNormalMap = false;
+	bool forceFormat = false;
+	ew::BlockFormat format = ew::BlockFormat::BC1;
+	std::vector<std::string> inputs;
+
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--normal") {
+			forceNormalMap = true;
+		}
+		else if (arg == "--bc1" || arg == "--bc3" || arg == "--bc5") {
+			forceFormat = true;
+			format = arg == "--bc1" ? ew::BlockFormat::BC1 : arg == "--bc3" ? ew::BlockFormat::BC3 : ew::BlockFormat::BC5;
+		}
+		else if (arg == "--help" || arg == "-h") {
+			printUsage();
+			return 0;
+		}
+		else if (arg.size() > 1 && arg[0] == '-') {
+			printf("Unknown option %s\n", arg.c_str());
+			printUsage();
+			return 1;
+		}
+		else {
+			inputs.push_back(arg);
+		}
+	}
+
+	if (inputs.empty()) {
+		printUsage();
+		return 1;
+	}
+
+	int numFailed = 0;
+	for (const std::string& input : inputs) {
+		auto startTime = std::chrono::steady_clock::now();
+
+		int width, height, numComponents;
+		//Always expand to RGBA so the encoders only deal with one layout
+		unsigned char* pixels = stbi_load(input.c_str(), &width, &height, &numComponents, 4);
+		if (pixels == NULL) {
+			printf("Failed to load %s: %s\n", input.c_str(), stbi_failure_reason());
+			numFailed++;
+			continue;
+		}
+
+		ew::CookSettings settings;
+		settings.normalMap = forceNormalMap || input.find("Normal") != std::string::npos;
+		if (forceFormat) {
+			settings.format = format;
+		}
+		else if (settings.normalMap) {
+			settings.format = ew::BlockFormat::BC5;
+		}
+		else {
+			settings.format = (numComponents == 2 || numComponents == 4) ? ew::BlockFormat::BC3 : ew::BlockFormat::BC1;
+		}
+
+		ew::DDSImage image = ew::cookTexture(pixels, width, height, settings);
+		stbi_image_free(pixels);
+
+		std::string output = outputPath(input);
+		if (!ew::writeDDS(output, image)) {
+			numFailed++;
+			continue;
+		}
+
+		float seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - startTime).count();
+		float sourceMB = (float)width * height * 4 / (1024.0f * 1024.0f);
+		float cookedMB = (float)image.data.size() / (1024.0f * 1024.0f);
+		printf("%s -> %s: %dx%d, %d mips, %s%s, %.1f MB RGBA8 -> %.1f MB (%.2fs)\n",
+			input.c_str(), output.c_str(), width, height, (int)image.mips.size(),
+			formatNames[(int)settings.format], settings.normalMap ? " normal map" : "",
+			sourceMB, cookedMB, seconds);
+	}
+	return numFailed == 0 ? 0 : 1;
+}
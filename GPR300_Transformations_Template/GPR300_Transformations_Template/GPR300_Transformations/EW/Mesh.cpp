@@ -27,6 +27,9 @@ Mesh::~Mesh()
 	glDeleteVertexArrays(1, &mVAO);
 	glDeleteBuffers(1, &mVBO);
 	glDeleteBuffers(1, &mEBO);
+	if (mInstanceVBO != 0) {
+		glDeleteBuffers(1, &mInstanceVBO);
+	}
 }
 
 void Mesh::draw()
@@ -34,3 +37,31 @@ void Mesh::draw()
 	glBindVertexArray(mVAO);
 	glDrawElements(GL_TRIANGLES, mNumIndices, GL_UNSIGNED_INT, 0);
 }
+
+void Mesh::setInstanceMatrices(const glm::mat4* matrices, GLsizei count)
+{
+	glBindVertexArray(mVAO);
+	if (mInstanceVBO == 0) {
+		glGenBuffers(1, &mInstanceVBO);
+		glBindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+
+		//A mat4 attribute takes 4 consecutive locations, one per column
+		for (GLuint i = 0; i < 4; i++) {
+			glVertexAttribPointer(2 + i, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (const void*)(sizeof(glm::vec4) * i));
+			glEnableVertexAttribArray(2 + i);
+			glVertexAttribDivisor(2 + i, 1);
+		}
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, mInstanceVBO);
+	glBufferData(GL_ARRAY_BUFFER, count * sizeof(glm::mat4), matrices, GL_STATIC_DRAW);
+	mNumInstances = count;
+}
+
+void Mesh::drawInstanced(GLsizei count)
+{
+	if (count > mNumInstances) {
+		count = mNumInstances;
+	}
+	glBindVertexArray(mVAO);
+	glDrawElementsInstanced(GL_TRIANGLES, mNumIndices, GL_UNSIGNED_INT, 0, count);
+}
@@ -26,8 +26,14 @@ public:
 	Mesh(MeshData* meshData);
 	~Mesh();
 	void draw();
+	//Uploads one model matrix per instance. They're read as vertex attributes 2-5 (a mat4) advancing once per instance.
+	void setInstanceMatrices(const glm::mat4* matrices, GLsizei count);
+	//Draws count copies in a single call, using the matrices from setInstanceMatrices
+	void drawInstanced(GLsizei count);
 private:
 	GLuint mVAO, mVBO, mEBO;
+	GLuint mInstanceVBO = 0;
 	GLsizei mNumIndices;
 	GLsizei mNumVertices;
+	GLsizei mNumInstances = 0;
 };
\ No newline at end of file
@@ -69,6 +69,11 @@ void Shader::setVec2(std::string name, const glm::vec2& value)
 	glProgramUniform2f(m_id, glGetUniformLocation(m_id, name.c_str()), value.x, value.y);
 }
 
+GLint Shader::getUniformLocation(const std::string& name)const
+{
+	return glGetUniformLocation(m_id, name.c_str());
+}
+
 
 std::string Shader::readFile(const std::string& filePath)
 {
@@ -13,6 +13,8 @@ public:
 	void setMat4(std::string name, const glm::mat4& value);
 	void setVec2(std::string name, const glm::vec2& value);
 	void setVec3(std::string name, const glm::vec3& value);
+	//The set functions look the name up on every call. Look it up once here for uniforms set in a loop.
+	GLint getUniformLocation(const std::string& name)const;
 private:
 	Shader(const Shader& r) = delete;
 	std::string readFile(const std::string& filePath);
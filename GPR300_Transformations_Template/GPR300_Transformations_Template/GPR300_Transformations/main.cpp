@@ -19,6 +19,10 @@
 #include "EW/ShapeGen.h"
 
 #include <cmath>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <stdlib.h>
 
 //using namespace glm;
 
@@ -32,7 +36,7 @@ int SCREEN_WIDTH = 1080;
 int SCREEN_HEIGHT = 720;
 
 float NEAR_PLANE = 0.01;
-float FAR_PLANE = 100;
+float FAR_PLANE = 500;
 
 double prevMouseX;
 double prevMouseY;
@@ -54,6 +58,34 @@ float fieldOfView = 1;
 float orthographicHeight = 10;
 bool orthographicToggle = false;
 
+//Set with --cubes N
+int numCubes = 100000;
+//One glDrawElementsInstanced for the whole field, or one glUniformMatrix4fv + glDrawElements per cube
+bool instancedDrawing = true;
+//Set with --sphere N. Draws spheres of N segments in place of the cubes, so the field can be made vertex bound instead of draw call bound.
+int sphereSegments = 0;
+int numMeshTriangles = 0;
+
+//Frame times in ms for the on-screen graph and the report printed on exit
+const int FRAME_GRAPH_LENGTH = 240;
+float frameGraph[FRAME_GRAPH_LENGTH];
+//Kept per draw path so toggling "Instanced" mid-run doesn't mix the two in the report
+std::vector<float> instancedFrameTimes;
+std::vector<float> perObjectFrameTimes;
+
+float randomRange(float min, float max) {
+	return min + (max - min) * ((float)rand() / RAND_MAX);
+}
+
+void printUsage() {
+	printf("Usage: GPR300_Transformations [--cubes N] [--per-object] [--sphere N]\n");
+	printf("  --cubes N       Number of cubes in the field (default %d)\n", numCubes);
+	printf("  --per-object    Start with one draw call per cube instead of instancing\n");
+	printf("  --sphere N      Draw a sphere with N segments in place of each cube\n");
+}
+
+void printFrameTimeReport(const char* drawPath, const std::vector<float>& frameTimes);
+
 class Transform {
 public:
 	Transform(glm::vec3 p, glm::vec3 r, glm::vec3 s);
@@ -214,7 +246,24 @@ void Camera::Update() {
 	orthographic = orthographicToggle;
 }
 
-int main() {
+int main(int argc, char** argv) {
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--cubes" && i + 1 < argc) {
+			numCubes = std::max(atoi(argv[++i]), 1);
+		}
+		else if (arg == "--per-object") {
+			instancedDrawing = false;
+		}
+		else if (arg == "--sphere" && i + 1 < argc) {
+			sphereSegments = std::max(atoi(argv[++i]), 3);
+		}
+		else {
+			printUsage();
+			return arg == "--help" || arg == "-h" ? 0 : 1;
+		}
+	}
+
 	if (!glfwInit()) {
 		printf("glfw failed to init");
 		return 1;
@@ -228,6 +277,9 @@ int main() {
 		return 1;
 	}
 
+	//Don't let vsync hide the difference between the two draw paths
+	glfwSwapInterval(0);
+
 	glfwSetFramebufferSizeCallback(window, resizeFrameBufferCallback);
 	glfwSetKeyCallback(window, keyboardCallback);
 
@@ -241,9 +293,16 @@ int main() {
 	ImGui::StyleColorsDark();
 
 	Shader shader("shaders/vertexShader.vert", "shaders/fragmentShader.frag");
+	Shader instancedShader("shaders/instancedVertexShader.vert", "shaders/fragmentShader.frag");
 
 	MeshData cubeMeshData;
-	createCube(1.0f, 1.0f, 1.0f, cubeMeshData);
+	if (sphereSegments > 0) {
+		createSphere(0.5f, sphereSegments, cubeMeshData);
+	}
+	else {
+		createCube(1.0f, 1.0f, 1.0f, cubeMeshData);
+	}
+	numMeshTriangles = (int)cubeMeshData.indices.size() / 3;
 
 	Mesh cubeMesh(&cubeMeshData);
 
@@ -259,18 +318,36 @@ int main() {
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LESS);
 
-	//Array of cubes
-	Transform *cubes[5];
+	//Field of cubes, spread out so density stays about the same whatever the count
+	float fieldSize = std::cbrt((float)numCubes) * 1.5f;
+	std::vector<Transform> cubes;
+	cubes.reserve(numCubes);
 	srand(time_t(0));
-	for (int i = 0; i < 5; i++) {
-		cubes[i] = new Transform(glm::vec3((rand() % 10) - 5, (rand() % 10) - 5, (rand() % 10) - 5),
-								glm::vec3((rand() % 360), (rand() % 360), (rand() % 360)),
-								glm::vec3((rand() % 5) + 0.1, (rand() % 5) + 0.1, (rand() % 5) + 0.1));
+	for (int i = 0; i < numCubes; i++) {
+		cubes.push_back(Transform(glm::vec3(randomRange(-fieldSize, fieldSize), randomRange(-fieldSize, fieldSize), randomRange(-fieldSize, fieldSize)) * 0.5f,
+								glm::vec3(randomRange(0, 6.28f), randomRange(0, 6.28f), randomRange(0, 6.28f)),
+								glm::vec3(randomRange(0.2f, 1.0f), randomRange(0.2f, 1.0f), randomRange(0.2f, 1.0f))));
 	}
 
+	//The cubes don't move, so both paths share matrices built once up front and only differ in how they're submitted
+	std::vector<glm::mat4> cubeModelMatrices(numCubes);
+	for (int i = 0; i < numCubes; i++) {
+		cubeModelMatrices[i] = cubes[i].GetModelMatrix();
+	}
+	cubeMesh.setInstanceMatrices(cubeModelMatrices.data(), numCubes);
+	printf("%d cubes, %d triangles each, %s\n", numCubes, numMeshTriangles, instancedDrawing ? "instanced" : "per-object draws");
+
+	orbitRadius = std::max(orbitRadius, fieldSize);
+
 	Transform coob(glm::vec3(0, 0, 0), glm::vec3(45, 45, 45), glm::vec3(1, 1, 1));
 
 	Camera cam;
+	int frameNumber = 0;
+	//Path the previous frame was drawn with, which is what deltaTime measures
+	bool lastFrameInstanced = instancedDrawing;
+
+	//Looked up once, setMat4 would look it up again for every cube
+	GLint modelLocation = shader.getUniformLocation("_Model");
 
 	while (!glfwWindowShouldClose(window)) {
 		glClearColor(bgColor.r,bgColor.g,bgColor.b, 1.0f);
@@ -284,15 +361,37 @@ int main() {
 		deltaTime = time - lastFrameTime;
 		lastFrameTime = time;
 
+		//The first delta covers startup, so it's left out
+		if (frameNumber++ > 0) {
+			float frameMs = deltaTime * 1000.0f;
+			(lastFrameInstanced ? instancedFrameTimes : perObjectFrameTimes).push_back(frameMs);
+			std::rotate(frameGraph, frameGraph + 1, frameGraph + FRAME_GRAPH_LENGTH);
+			frameGraph[FRAME_GRAPH_LENGTH - 1] = frameMs;
+		}
+
+		//The graph only ever shows one path
+		if (instancedDrawing != lastFrameInstanced) {
+			std::fill(frameGraph, frameGraph + FRAME_GRAPH_LENGTH, 0.0f);
+			lastFrameInstanced = instancedDrawing;
+		}
+
 		//Draw
-		shader.use();
-		shader.setMat4("_View", cam.GetViewMatrix());
-		shader.setMat4("_Projection", cam.GetProjectionMatrix());
-		//shader.setMat4("_Model", coob.GetModelMatrix());
-		//cubeMesh.draw();
-		for (int i = 0; i < sizeof(cubes) / sizeof(cubes[0]); i++) {
-			shader.setMat4("_Model", cubes[i]->GetModelMatrix());
-			cubeMesh.draw();
+		if (instancedDrawing) {
+			instancedShader.use();
+			instancedShader.setMat4("_View", cam.GetViewMatrix());
+			instancedShader.setMat4("_Projection", cam.GetProjectionMatrix());
+			cubeMesh.drawInstanced(numCubes);
+		}
+		else {
+			shader.use();
+			shader.setMat4("_View", cam.GetViewMatrix());
+			shader.setMat4("_Projection", cam.GetProjectionMatrix());
+			//shader.setMat4("_Model", coob.GetModelMatrix());
+			//cubeMesh.draw();
+			for (int i = 0; i < numCubes; i++) {
+				glUniformMatrix4fv(modelLocation, 1, GL_FALSE, glm::value_ptr(cubeModelMatrices[i]));
+				cubeMesh.draw();
+			}
 		}
 
 		//Draw UI
@@ -304,8 +403,12 @@ int main() {
 		else {
 			ImGui::SliderFloat("Field of View", &fieldOfView, 0.0f, 3.14f);
 		}
-		ImGui::SliderFloat("Orbit Radius", &orbitRadius, 1.0f, 50.0f);
+		ImGui::SliderFloat("Orbit Radius", &orbitRadius, 1.0f, 200.0f);
 		ImGui::SliderFloat("Orbit Speed", &orbitSpeed, 0.0f, 10.0f);
+		ImGui::Checkbox("Instanced", &instancedDrawing);
+		ImGui::Text("%d cubes, %d draw calls, %d triangles each", numCubes, instancedDrawing ? 1 : numCubes, numMeshTriangles);
+		ImGui::Text("Frame: %.2f ms (%.0f fps)", deltaTime * 1000.0f, 1.0f / std::max(deltaTime, 0.0001f));
+		ImGui::PlotLines("Frame ms", frameGraph, FRAME_GRAPH_LENGTH, 0, NULL, 0.0f, FLT_MAX, ImVec2(0, 60));
 		ImGui::End();
 		cam.Update();
 
@@ -316,10 +419,31 @@ int main() {
 		glfwSwapBuffers(window);
 	}
 
+	printFrameTimeReport("instanced", instancedFrameTimes);
+	printFrameTimeReport("per-object draws", perObjectFrameTimes);
 	glfwTerminate();
 	return 0;
 }
 
+void printFrameTimeReport(const char* drawPath, const std::vector<float>& frameTimes)
+{
+	if (frameTimes.empty()) {
+		return;
+	}
+	std::vector<float> sorted = frameTimes;
+	std::sort(sorted.begin(), sorted.end());
+	auto percentile = [&sorted](float p) {
+		return sorted[std::min((size_t)(p * sorted.size()), sorted.size() - 1)];
+	};
+	float total = 0;
+	for (float ms : sorted) {
+		total += ms;
+	}
+	printf("Frame times over %d frames (%d cubes, %d triangles each, %s):\n", (int)sorted.size(), numCubes, numMeshTriangles, drawPath);
+	printf("  avg %.3f ms, min %.3f, p50 %.3f, p95 %.3f, p99 %.3f, max %.3f\n",
+		total / sorted.size(), sorted.front(), percentile(0.5f), percentile(0.95f), percentile(0.99f), sorted.back());
+}
+
 void resizeFrameBufferCallback(GLFWwindow* window, int width, int height)
 {
 	glViewport(0, 0, width, height);
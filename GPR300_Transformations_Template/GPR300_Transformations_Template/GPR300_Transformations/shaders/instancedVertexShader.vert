@@ -0,0 +1,15 @@
+#version 450                          
+layout (location = 0) in vec3 vPos;  
+layout (location = 1) in vec3 vNormal;
+//Per instance, see Mesh::setInstanceMatrices
+layout (location = 2) in mat4 iModel;
+
+out vec3 Normal;
+
+uniform mat4 _View;
+uniform mat4 _Projection;
+
+void main(){ 
+    Normal = vNormal;
+    gl_Position = _Projection * _View * iModel * vec4(vPos,1);
+}